@@ -78,7 +78,7 @@ def exit_action(errcode):
 
 algorithms = ['gridrec', 'art', 'fbp', 'bart', 'mlem', 'osem', 'sirt',
               'ospml_hybrid', 'ospml_quad', 'pml_hybrid', 'pml_quad',
-              'tv', 'grad']
+              'tv', 'grad', 'cgls', 'lsqr']
 
 
 image_quality = {}
@@ -57,7 +57,8 @@
 void DLL
      gridrec(const float* data, int dy, int dt, int dx, const float* center,
              const float* theta, float* recon, int ngridx, int ngridy,
-             const char fname[16], const float* filter_par);
+             const char fname[16], const float* filter_par,
+             const int* roi);
 
 float*
 malloc_vector_f(size_t n);
@@ -67,4 +67,11 @@ DLL void
 upsample(const float* data, int dx, int dy, int dz, int level, int axis,
          float* out);
 
+DLL int
+pair_opposite(const float* theta, int dt, float tol, int* mate);
+
+DLL void
+fold_360(const float* data, int dy, int dt, int dx, const float* center,
+         const int* mate, int shift, int dxo, float* out);
+
 #endif
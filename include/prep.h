@@ -52,9 +52,40 @@
 #    define DLL __declspec(dllexport)
 #else
 #    define DLL
+// Dynamic flat-field correction of dt x dy x dx projections. The nf flats
+// are reduced to ncomp eigenflats (ncomp <= 0 picks them by the Kaiser
+// rule) and each projection fits its own flat on a grid downsampled by ds
+// in niter least-squares sweeps. flats are the raw flat fields, dark the
+// dy x dx mean dark field.
+DLL void
+normalize_dynamic(const float* data, int dt, int dy, int dx,
+                  const float* flats, int nf, const float* dark, int ncomp,
+                  int ds, int niter, int use_cutoff, float cutoff, float* out,
+                  int num_thread);
+
 #endif
 
 DLL void
 normalize_bg(float* data, int dx, int dy, int dz, int nair);
 
+// Flat/dark correction of dt x dy x dx projections in one sweep. data is
+// float (u16 = 0) or uint16 (u16 = 1); flat and dark are dy x dx means.
+// Writes dy x dt x dx sinograms when sino is set.
+DLL void
+normalize_log(const void* data, int u16, int dt, int dy, int dx,
+              const float* flat, const float* dark, int use_cutoff,
+              float cutoff, int minus_log, int use_nonfinite, float nonfinite,
+              int sino, float* out, int num_thread);
+
+// Dynamic flat-field correction of dt x dy x dx projections. The nf flats
+// are reduced to ncomp eigenflats (ncomp <= 0 picks them by the Kaiser
+// rule) and each projection fits its own flat on a grid downsampled by ds
+// in niter least-squares sweeps. flats are the raw flat fields, dark the
+// dy x dx mean dark field.
+DLL void
+normalize_dynamic(const float* data, int dt, int dy, int dx,
+                  const float* flats, int nf, const float* dark, int ncomp,
+                  int ds, int niter, int use_cutoff, float cutoff, float* out,
+                  int num_thread);
+
 #endif
@@ -56,7 +56,16 @@
 #endif
 
 DLL void
-remove_stripe_sf(float* data, int dx, int dy, int dz, int size, int istart,
-                 int iend);
+remove_stripe_sf(float* data, int dx, int dy, int dz, int size,
+                 int num_thread);
+
+// Sorting-based removal of the stripes of the dy sinograms of a dx x dy x dz
+// stack, in place. method is "sort" (algorithm 3 with a median of size),
+// "large" (algorithm 5), "dead" (algorithm 6) or "all" (6 then 3 with a
+// median of sm_size).
+DLL void
+remove_stripe_sorting(float* data, int dx, int dy, int dz,
+                      const char* method, float snr, int size, int sm_size,
+                      int num_thread);
 
 #endif
\ No newline at end of file
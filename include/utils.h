@@ -66,97 +66,159 @@
 
 void DLL
      project(const float* obj, int oy, int ox, int oz, float* data, int dy, int dt,
-             int dx, const float* center, const float* theta);
+             int dx, const float* center, const float* theta,
+             const char* projector, float sod, float sdd, const float* blur_u,
+             int nu, const float* blur_v, int nv, float flux, float noise,
+             int seed, int emission, int num_thread);
+
+void DLL
+     phantom(const double* ell, int nell, float* obj, int n0, int n1, int n2,
+             int supersample, int num_thread);
+
+void DLL
+     phantom_project(const double* ell, int nell, int n0, int n1, int n2,
+                     float* data, int dt, int dx, const float* center,
+                     const float* theta, int num_thread);
 
 void DLL
      project2(const float* objx, const float* objy, int oy, int ox, int oz,
               float* data, int dy, int dt, int dx, const float* center,
-              const float* theta);
+              const float* theta, int num_thread);
 
 void DLL
      project3(const float* objx, const float* objy, const float* objz, int oy,
               int ox, int oz, float* data, int dy, int dt, int dx,
-              const float* center, const float* theta, int axis);
+              const float* center, const float* theta, int axis,
+              int num_thread);
 
 // Reconstruction algorithms
+//
+// geom is the geometry of the rays, NULL for parallel rays through a grid
+// centered on the rotation axis, or 4 floats in pixels:
+//   geom[0], geom[1]  offset of the grid center from the rotation axis
+//   geom[2]           source to rotation axis distance, 0 for parallel rays
+//   geom[3]           source to detector distance, 0 for parallel rays
 
 void DLL
      art(const float* data, int dy, int dt, int dx, const float* center,
-         const float* theta, float* recon, int ngridx, int ngridy, int num_iter);
+         const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+         const char* projector, const unsigned char* mask, const float* geom,
+         int num_thread);
 
 void DLL
      bart(const float* data, int dy, int dt, int dx, const float* center,
           const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-          int          num_block,
-          const float* ind_block);  // TODO: I think this should be int *
+          int num_block, const int* ind_block, int num_order,
+          const char* projector, const unsigned char* mask, const float* geom,
+          const char* backprojector, int num_thread);
+
+void DLL
+     cgls(const float* data, int dy, int dt, int dx, const float* center,
+          const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+          float damp, float tol, const char* projector,
+          const unsigned char* mask, const float* geom);
 
 void DLL
      fbp(const float* data, int dy, int dt, int dx, const float* center,
          const float* theta, float* recon, int ngridx, int ngridy,
-         const char name[16], const float* filter_par);
+         const char name[16], const float* filter_par, const char* projector,
+         const unsigned char* mask, const float* geom,
+         const char* backprojector);
 
 void DLL
      grad(const float* data, int dy, int dt, int dx, const float* center,
           const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-          const float* reg_pars);
+          const float* reg_pars, const char* projector,
+          const unsigned char* mask, const float* geom,
+          const char* backprojector, float* state);
+
+int DLL
+    grad_state_size(int dt, int dx, int ngridx, int ngridy);
+
+void DLL
+     lsqr(const float* data, int dy, int dt, int dx, const float* center,
+          const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+          float damp, float tol, const char* projector,
+          const unsigned char* mask, const float* geom);
 
 void DLL
      mlem(const float* data, int dy, int dt, int dx, const float* center,
-          const float* theta, float* recon, int ngridx, int ngridy, int num_iter);
+          const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+          const char* projector, const unsigned char* mask, const float* geom,
+          const char* backprojector);
 
 void DLL
      osem(const float* data, int dy, int dt, int dx, const float* center,
           const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-          int num_block, const float* ind_block);
+          int num_block, const int* ind_block, int num_order,
+          const char* projector, const unsigned char* mask, const float* geom,
+          const char* backprojector);
 
 void DLL
      ospml_hybrid(const float* data, int dy, int dt, int dx, const float* center,
                   const float* theta, float* recon, int ngridx, int ngridy,
                   int num_iter, const float* reg_pars, int num_block,
-                  const float* ind_block);
+                  const int* ind_block, int num_order, const char* projector,
+                  const unsigned char* mask, const float* geom,
+                  const char* backprojector, int neighbors);
 
 void DLL
      ospml_quad(const float* data, int dy, int dt, int dx, const float* center,
                 const float* theta, float* recon, int ngridx, int ngridy,
                 int num_iter, const float* reg_pars, int num_block,
-                const float* ind_block);
+                const int* ind_block, int num_order, const char* projector,
+                const unsigned char* mask, const float* geom,
+                const char* backprojector, int neighbors);
 
 void DLL
      pml_hybrid(const float* data, int dy, int dt, int dx, const float* center,
                 const float* theta, float* recon, int ngridx, int ngridy,
-                int num_iter, const float* reg_pars);
+                int num_iter, const float* reg_pars, const char* projector,
+                const unsigned char* mask, const float* geom,
+                const char* backprojector, int neighbors);
 
 void DLL
      pml_quad(const float* data, int dy, int dt, int dx, const float* center,
-              const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-              const float* reg_pars);
+              const float* theta, float* recon, int ngridx, int ngridy,
+              int num_iter, const float* reg_pars, const char* projector,
+              const unsigned char* mask, const float* geom,
+              const char* backprojector, int neighbors);
 
 void DLL
      sirt(const float* data, int dy, int dt, int dx, const float* center,
-          const float* theta, float* recon, int ngridx, int ngridy, int num_iter);
+          const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+          const char* projector, const unsigned char* mask, const float* geom,
+          const char* backprojector);
 
 void DLL
      tv(const float* data, int dy, int dt, int dx, const float* center,
         const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-        const float* reg_pars);
+        const float* reg_pars, const char* projector,
+        const unsigned char* mask, const float* geom, const char* backprojector,
+        int tv_3d, float* state);
+
+int DLL
+    tv_state_size(int dt, int dx, int ngridx, int ngridy);
 
 void DLL
      vector(const float* data, int dy, int dt, int dx, const float* center,
-            const float* theta, float* recon1, float* recon2, int ngridx, int ngridy,
-            int num_iter);
+            const float* theta, float* recon1, float* recon2, int ngridx,
+            int ngridy, int num_iter, int num_thread);
 
 void DLL
      vector2(const float* data1, const float* data2, int dy, int dt, int dx,
              const float* center1, const float* center2, const float* theta1,
              const float* theta2, float* recon1, float* recon2, float* recon3,
-             int ngridx, int ngridy, int num_iter, int axis1, int axis2);
+             int ngridx, int ngridy, int num_iter, int axis1, int axis2,
+             int num_thread);
 
 void DLL
      vector3(const float* data1, const float* data2, const float* data3, int dy,
              int dt, int dx, const float* center1, const float* center2,
              const float* center3, const float* theta1, const float* theta2,
              const float* theta3, float* recon1, float* recon2, float* recon3,
-             int ngridx, int ngridy, int num_iter, int axis1, int axis2, int axis3);
+             int ngridx, int ngridy, int num_iter, int axis1, int axis2,
+             int axis3, int num_thread);
 
 // Utility functions for data simultation
 
@@ -207,4 +269,305 @@ void DLL
                    float vx, float vy, const float* modelx, const float* modely,
                    const float* modelz, int axis, float* simdata);
 
+// Slices of vector fields. The slice s normal to axis 0, 1 or 2 of a volume
+// of ngridx x ngridy planes, which must be a cube for axes 1 and 2, holds
+// pixel m, n at field_voxel in the volume. Its projections measure the two
+// components field_comps of the field, x and y for axis 0, y and z for
+// axis 1, and x and z for axis 2.
+static inline int
+field_voxel(int axis, int s, int m, int n, int ngridx, int ngridy)
+{
+    switch(axis)
+    {
+        case 1: return s + m * ngridy + n * ngridx * ngridy;
+        case 2: return m + s * ngridy + n * ngridx * ngridy;
+        default: return n + m * ngridy + s * ngridx * ngridy;
+    }
+}
+
+static inline void
+field_comps(int axis, int* c0, int* c1)
+{
+    *c0 = (axis == 1) ? 1 : 0;
+    *c1 = (axis == 0) ? 1 : 2;
+}
+
+// Strides of the slice, row and column of the slices normal to an axis,
+// the index of field_voxel being s * st[0] + m * st[1] + n * st[2]
+static inline void
+field_strides(int axis, int ngridx, int ngridy, int* st)
+{
+    st[0] = (axis == 1) ? 1 : (axis == 2) ? ngridy : ngridx * ngridy;
+    st[1] = (axis == 2) ? 1 : ngridy;
+    st[2] = (axis == 0) ? 1 : ngridx * ngridy;
+}
+
+// Copy the n0 x n1 x n2 box of src with the strides sst into dst with the
+// strides dst_st. The box is copied in small cubes which stay in cache on
+// both sides, so that transposing a volume costs about as much as copying
+// it whatever the strides.
+void DLL
+     copy_box(const float* src, const int* sst, float* dst, const int* dst_st,
+              int n0, int n1, int n2);
+
+// Projection models
+
+#define PROJ_SIDDON 0    // exact intersection length (default)
+#define PROJ_JOSEPH 1    // linear interpolation along the dominant axis
+#define PROJ_DISTANCE 2  // detector/pixel boundary overlap
+
+// Backprojectors
+
+#define BACKPROJ_RAY 0    // scatter along the traced rays (default)
+#define BACKPROJ_PIXEL 1  // pixel-driven gather from the detector bins
+
+// State of the ray tracer shared by the forward and back projectors. All
+// projection models produce the pixel indices (indi) and weights (dist) of
+// one ray with the calc_dist convention that csize - 1 entries are valid,
+// so the same weights drive both directions and the pair stays matched.
+typedef struct
+{
+    int    model;     // one of PROJ_*
+    int    ngridx;    // grid size along x
+    int    ngridy;    // grid size along y
+    int    dx;        // number of detector pixels
+    float  mov;       // rotation axis offset for the current slice
+    int    quadrant;  // quadrant of the current projection angle
+    float  sin_p;     // sine of the current projection angle
+    float  cos_p;     // cosine of the current projection angle
+    float  roix;      // x offset of the grid center from the rotation axis
+    float  roiy;      // y offset of the grid center from the rotation axis
+    float  sod;       // source to rotation axis distance, 0 for parallel rays
+    float  sdd;       // source to detector distance, 0 for parallel rays
+    float  shift;     // detector shift of the grid center at this angle
+    float* gridx;
+    float* gridy;
+    float* coordx;
+    float* coordy;
+    float* ax;
+    float* ay;
+    float* bx;
+    float* by;
+    float* coorx;
+    float* coory;
+    int*   indi;  // pixel indices crossed by the ray
+    float* dist;  // pixel weights along the ray
+    const unsigned char* mask;  // support of the grid, NULL for all pixels
+    float radius;  // rays further from the grid center miss the support
+    int    gather;  // one of BACKPROJ_*
+    int    dt;      // number of projection angles
+    float* resid;   // values recorded per ray for the gather, dt x (dx + 2)
+    float* hits;    // 1 for the recorded rays crossing the grid, dt x (dx + 2)
+    unsigned char* used;  // projections recorded since the last gather
+    int    nthreads;  // threads splitting the tiles of the gather
+} ray_tracer;
+
+// True when pixel i of a slice lies outside the support mask
+static inline int
+outside(const unsigned char* mask, int i)
+{
+    return mask != NULL && !mask[i];
+}
+
+int DLL
+    get_projector(const char* name);
+
+void DLL
+     init_tracer(ray_tracer* ray, int model, const unsigned char* mask,
+                 int ngridx, int ngridy, int dx);
+
+void DLL
+     free_tracer(ray_tracer* ray);
+
+void DLL
+     tracer_geom(ray_tracer* ray, const float* geom);
+
+void DLL
+     tracer_slice(ray_tracer* ray, float center);
+
+void DLL
+     tracer_angle(ray_tracer* ray, float theta);
+
+int DLL
+    trace_ray(ray_tracer* ray, int d);
+
+int DLL
+    get_backprojector(const char* name);
+
+void DLL
+     init_backprojector(ray_tracer* ray, int mode, int dt);
+
+void DLL
+     backproject_slice(ray_tracer* ray, const float* theta, float* out,
+                       float* weight);
+
+// Backproject upd along the ray through detector pixel d of projection p
+// into out, and the ray weights into weight unless it is NULL. The
+// ray-driven backprojector scatters along the traced ray; the pixel-driven
+// one records upd, which backproject_slice gathers pixel by pixel.
+static inline void
+backproject_entries(ray_tracer* ray, int p, int d, int csize, const int* indi,
+                    const float* dist, float upd, float* out, float* weight)
+{
+    if(ray->gather == BACKPROJ_PIXEL)
+    {
+        ray->resid[p * (ray->dx + 2) + d + 1] = upd;
+        ray->hits[p * (ray->dx + 2) + d + 1]  = (csize > 1) ? 1.0f : 0.0f;
+        ray->used[p]                          = 1;
+        return;
+    }
+    for(int n = 0; n < csize - 1; n++)
+    {
+        out[indi[n]] += upd * dist[n];
+        if(weight != NULL)
+            weight[indi[n]] += dist[n];
+    }
+}
+
+static inline void
+backproject_ray(ray_tracer* ray, int p, int d, int csize, float upd,
+                float* out, float* weight)
+{
+    backproject_entries(ray, p, d, csize, ray->indi, ray->dist, upd, out,
+                        weight);
+}
+
+// Upper bound on the memory of the rays cached by all the solvers of the
+// process together
+#define RAY_CACHE_BYTES (256 << 20)
+
+// Rays of one slice traced once and replayed by every iteration. When the
+// rays of a slice do not fit in what is left of RAY_CACHE_BYTES, fetch_ray
+// traces them again instead.
+typedef struct
+{
+    int     dt;     // number of projection angles
+    int     dx;     // number of detector pixels
+    int     ready;  // the rays of a slice geometry were traced
+    int     full;   // all rays of that geometry are cached
+    int     angle;  // projection angle set on the tracer, -1 for none
+    float   mov;    // rotation axis offset of the cached slice
+    size_t  size;   // number of cached entries
+    size_t  cap;
+    size_t* start;  // first entry of each ray, dt * dx + 1
+    int*    indi;
+    float*  dist;
+} ray_cache;
+
+void DLL
+     init_ray_cache(ray_cache* rc, int dt, int dx);
+
+void DLL
+     free_ray_cache(ray_cache* rc);
+
+int DLL
+    cache_slice(ray_cache* rc, ray_tracer* ray, const float* theta,
+                float center);
+
+int DLL
+    fetch_ray(ray_cache* rc, ray_tracer* ray, const float* theta, int p, int d,
+              const int** indi, const float** dist);
+
+// Matched projector pair over the cached rays of a slice: project_rays sets
+// the sinogram sino (dt x dx) to the projection of the slice x, and
+// backproject_rays adds the ray-driven backprojection of sino to out.
+void DLL
+     project_rays(ray_cache* rc, ray_tracer* ray, const float* theta,
+                  const float* x, float* sino);
+
+void DLL
+     backproject_rays(ray_cache* rc, ray_tracer* ray, const float* theta,
+                      const float* sino, float* out);
+
+// Scale each slice of recon, a model of the object such as a gridrec
+// reconstruction, by the factor that best fits its projections to the data
+// in the least-squares sense, to start an iterative algorithm from it.
+// Pixels outside the support are zeroed, and with positive the others are
+// raised to the small positive value that the multiplicative updates of the
+// EM algorithms need.
+void DLL
+     scale_init(const float* data, int dy, int dt, int dx, const float* center,
+                const float* theta, float* recon, int ngridx, int ngridy,
+                const char* projector, const unsigned char* mask,
+                const float* geom, int positive);
+
+// Subset os of an ordered-subset method holds the projections order[beg] to
+// order[end - 1] of the projection order of the iteration, a row of the
+// num_order x dt ind_block array. The first dt % num_block subsets hold one
+// projection more than the others.
+void DLL
+     subset_range(int dt, int num_block, int os, int* beg, int* end);
+
+#define PRIOR_QUAD 0    // quadratic neighbor weights
+#define PRIOR_HYBRID 1  // quadratic weights damped by the neighbor difference
+
+// Neighborhood prior of the penalized-likelihood algorithms. Slices are
+// copied into ghost-padded planes, so that every pixel sees a full stencil
+// and the weights of neighbors off the grid or outside the support are
+// zeroed by the presence and validity planes instead of by special cases.
+typedef struct
+{
+    int    dy;      // number of slices
+    int    ngridx;  // grid size along x
+    int    ngridy;  // grid size along y
+    int    nbr;     // 8 for the in-slice neighbors, 26 across slices
+    int    nq;      // number of neighbors of the stencil
+    int    plane[26];  // padded plane of each neighbor, 1 for slice s
+    int    off[26];    // offset of each neighbor within its plane
+    float  wq[26];     // inverse distance of each neighbor
+    float* pad;        // padded planes of slices s - 1, s and s + 1
+    float* present;    // 1 on the padded grid, 0 on the ghosts
+    float* valid;      // present and inside the support
+    float* zero;       // plane of the slices off the volume
+    float* sumf;       // row accumulators of the stencil
+    float* sumg;
+    float* sumw;
+} prior_engine;
+
+void DLL
+     init_prior(prior_engine* pr, const unsigned char* mask, int dy,
+                int ngridx, int ngridy, int nbr);
+
+void DLL
+     free_prior(prior_engine* pr);
+
+void DLL
+     prior_slice(prior_engine* pr, const float* recon, int s, int type,
+                 const float* reg_pars, float* F, float* G);
+
+// Threads of a parallel region. run_team runs work(team, tid, arg) on
+// nthreads threads, tid = 0 being the calling thread, and returns when all
+// of them are done. Builds without pthreads run a single thread.
+typedef struct thread_team thread_team;
+
+void DLL
+     run_team(int nthreads, void (*work)(thread_team*, int, void*),
+              void* arg);
+
+// Wait until every thread of the team reached the barrier
+void DLL
+     team_barrier(thread_team* team);
+
+// Number of threads of the team
+int DLL
+    team_size(const thread_team* team);
+
+// Part beg to end - 1 of the range 0 to n - 1 taken by thread tid
+static inline void
+team_range(const thread_team* team, int tid, int n, int* beg, int* end)
+{
+    int nt = team_size(team);
+    *beg   = (int) ((long long) n * tid / nt);
+    *end   = (int) ((long long) n * (tid + 1) / nt);
+}
+
+void DLL
+     calc_joseph(int ngridx, int ngridy, float yi, float sin_p, float cos_p,
+                 float radius, int* csize, int* indi, float* dist);
+
+void DLL
+     calc_distance(int ngridx, int ngridy, float yi, float sin_p, float cos_p,
+                   float pitch, float radius, int* csize, int* indi,
+                   float* dist);
+
 #endif
@@ -84,14 +84,15 @@ def configure():
     # default algorithm choices
     available_algorithms = ['gridrec', 'art', 'fbp', 'bart', 'mlem', 'osem',
                             'sirt', 'ospml_hybrid', 'ospml_quad', 'pml_hybrid',
-                            'pml_quad', 'tv', 'grad']
+                            'pml_quad', 'tv', 'grad', 'cgls', 'lsqr']
     # default phantom choices
     available_phantoms = ["baboon", "cameraman", "barbara", "checkerboard",
                           "lena", "peppers", "shepp2d", "shepp3d"]
     # choices for algorithms
     algorithm_choices = ['gridrec', 'art', 'fbp', 'bart', 'mlem', 'osem',
-                         'sirt', 'ospml_hybrid', 'ospml_quad', 'pml_hybrid',
-                         'pml_quad', 'tv', 'grad', 'none', 'all']
+                         'ossart', 'sirt', 'ospml_hybrid', 'ospml_quad',
+                         'pml_hybrid', 'pml_quad', 'tv', 'grad', 'cgls',
+                         'lsqr', 'none', 'all']
     # phantom choices
     phantom_choices = ["baboon", "cameraman", "barbara", "checkerboard",
                        "lena", "peppers", "shepp2d", "shepp3d", "none", "all"]
@@ -102,7 +103,7 @@ def configure():
     # default algorithm choices
     default_algorithms = ['gridrec', 'art', 'fbp', 'bart', 'mlem', 'osem',
                           'sirt', 'ospml_hybrid', 'ospml_quad', 'pml_hybrid',
-                          'pml_quad', 'tv', 'grad']
+                          'pml_quad', 'tv', 'grad', 'cgls', 'lsqr']
     # default phantom choices
     default_phantoms = ["baboon", "cameraman", "barbara", "checkerboard",
                         "lena", "peppers", "shepp2d", "shepp3d"]
@@ -43,121 +43,157 @@
 
 #include "utils.h"
 
-void
-art(const float* data, int dy, int dt, int dx, const float* center,
-    const float* theta, float* recon, int ngridx, int ngridy, int num_iter)
+// Rays per chunk of a projection. With several threads, the even chunks
+// and then the odd ones are updated concurrently. In parallel geometry,
+// chunks of the same parity are a chunk apart, further than the footprint
+// of a pixel on the detector, so their rays cross disjoint pixels. The
+// order of the rays is the same for any number of threads above one, and a
+// single thread keeps the order of the detector.
+#define ART_CHUNK 8
+
+typedef struct
 {
-    float* gridx   = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy   = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx  = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy  = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by      = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi    = (int*) malloc((ngridx + ngridy) * sizeof(int));
-    float* simdata = (float*) malloc((dy * dt * dx) * sizeof(float));
+    const float*         data;
+    int                  dy;
+    int                  dt;
+    int                  dx;
+    const float*         center;
+    const float*         theta;
+    float*               recon;
+    int                  ngridx;
+    int                  ngridy;
+    int                  num_iter;
+    int                  model;
+    const unsigned char* mask;
+    const float*         geom;
+    float*               simdata;
+} art_args;
+
+static void
+art_thread(thread_team* team, int tid, void* arg)
+{
+    const art_args* a = (const art_args*) arg;
 
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL && simdata != NULL);
+    ray_tracer ray;
+    init_tracer(&ray, a->model, a->mask, a->ngridx, a->ngridy, a->dx);
+    tracer_geom(&ray, a->geom);
+    int*   indi = ray.indi;
+    float* dist = ray.dist;
 
-    int   s, p, d, i, n;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
+    int   s, p, d, i, n, c, parity;
+    int   csize;
     float upd;
     int   ind_data, ind_recon;
+    int   chunk_beg, chunk_end, d_end;
+    int   num_chunk = (a->dx + ART_CHUNK - 1) / ART_CHUNK;
+    int   num_phase = (team_size(team) > 1) ? 2 : 1;
 
-    for(i = 0; i < num_iter; i++)
+    for(i = 0; i < a->num_iter; i++)
     {
         // initialize simdata to zero
-        memset(simdata, 0, dy * dt * dx * sizeof(float));
+        if(tid == 0)
+            memset(a->simdata, 0, a->dy * a->dt * a->dx * sizeof(float));
+        team_barrier(team);
 
-        preprocessing(ngridx, ngridy, dx, center[0], &mov, gridx,
-                      gridy);  // Outputs: mov, gridx, gridy
+        tracer_slice(&ray, a->center[0]);
 
         // For each projection angle
-        for(p = 0; p < dt; p++)
+        for(p = 0; p < a->dt; p++)
         {
             // Calculate the sin and cos values
             // of the projection angle and find
             // at which quadrant on the cartesian grid.
-            theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-            quadrant = calc_quadrant(theta_p);
-            sin_p    = sinf(theta_p);
-            cos_p    = cosf(theta_p);
+            tracer_angle(&ray, a->theta[p]);
 
-            // For each detector pixel
-            for(d = 0; d < dx; d++)
+            // The even chunks, then the odd ones
+            for(parity = 0; parity < num_phase; parity++)
             {
-                // Calculate coordinates
-                xi = -ngridx - ngridy;
-                yi = 0.5f * (1 - dx) + d + mov;
-                calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx, gridy,
-                            coordx, coordy);
-
-                // Merge the (coordx, gridy) and (gridx, coordy)
-                trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                            &asize, ax, ay, &bsize, bx, by);
-
-                // Sort the array of intersection points (ax, ay) and
-                // (bx, by). The new sorted intersection points are
-                // stored in (coorx, coory). Total number of points
-                // are csize.
-                sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                   &csize, coorx, coory);
-
-                // Calculate the distances (dist) between the
-                // intersection points (coorx, coory). Find the
-                // indices of the pixels on the reconstruction grid.
-                calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist);
-
-                // Calculate dist*dist
-                float sum_dist2 = 0.0f;
-                for(n = 0; n < csize - 1; n++)
+                team_range(team, tid,
+                           (num_chunk - parity + num_phase - 1) / num_phase,
+                           &chunk_beg, &chunk_end);
+                for(c = chunk_beg; c < chunk_end; c++)
                 {
-                    sum_dist2 += dist[n] * dist[n];
-                }
+                    d     = (num_phase * c + parity) * ART_CHUNK;
+                    d_end = (d + ART_CHUNK < a->dx) ? d + ART_CHUNK : a->dx;
 
-                if(sum_dist2 != 0.0f)
-                {
-                    // For each slice
-                    for(s = 0; s < dy; s++)
+                    // For each detector pixel
+                    for(; d < d_end; d++)
                     {
-                        // Calculate simdata
-                        calc_simdata(s, p, d, ngridx, ngridy, dt, dx, csize,
-                                     indi, dist, recon,
-                                     simdata);  // Output: simdata
-
-                        // Update
-                        ind_data  = d + p * dx + s * dt * dx;
-                        ind_recon = s * ngridx * ngridy;
-                        upd = (data[ind_data] - simdata[ind_data]) / sum_dist2;
+                        // Find the indices (indi) of the pixels on the
+                        // reconstruction grid crossed by the ray and their
+                        // weights (dist) for the selected projection model.
+                        csize = trace_ray(&ray, d);
+
+                        // Calculate dist*dist
+                        float sum_dist2 = 0.0f;
                         for(n = 0; n < csize - 1; n++)
                         {
-                            recon[indi[n] + ind_recon] += upd * dist[n];
+                            sum_dist2 += dist[n] * dist[n];
+                        }
+
+                        if(sum_dist2 != 0.0f)
+                        {
+                            // For each slice
+                            for(s = 0; s < a->dy; s++)
+                            {
+                                // Calculate simdata
+                                calc_simdata(s, p, d, a->ngridx, a->ngridy,
+                                             a->dt, a->dx, csize, indi, dist,
+                                             a->recon,
+                                             a->simdata);  // Output: simdata
+
+                                // Update
+                                ind_data  = d + p * a->dx + s * a->dt * a->dx;
+                                ind_recon = s * a->ngridx * a->ngridy;
+                                upd = (a->data[ind_data] -
+                                       a->simdata[ind_data]) /
+                                      sum_dist2;
+                                for(n = 0; n < csize - 1; n++)
+                                {
+                                    a->recon[indi[n] + ind_recon] +=
+                                        upd * dist[n];
+                                }
+                            }
                         }
                     }
                 }
+                team_barrier(team);
             }
         }
     }
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+    free_tracer(&ray);
+}
+
+void
+art(const float* data, int dy, int dt, int dx, const float* center,
+    const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+    const char* projector, const unsigned char* mask, const float* geom,
+    int num_thread)
+{
+    float* simdata = (float*) malloc((dy * dt * dx) * sizeof(float));
+
+    assert(simdata != NULL);
+
+    art_args args = { .data     = data,
+                      .dy       = dy,
+                      .dt       = dt,
+                      .dx       = dx,
+                      .center   = center,
+                      .theta    = theta,
+                      .recon    = recon,
+                      .ngridx   = ngridx,
+                      .ngridy   = ngridy,
+                      .num_iter = num_iter,
+                      .model    = get_projector(projector),
+                      .mask     = mask,
+                      .geom     = geom,
+                      .simdata  = simdata };
+
+    // Fan rays converge, so chunks of the same parity may cross the same
+    // pixels: a fan beam is updated on one thread.
+    if(geom != NULL && geom[3] > 0.0f)
+        num_thread = 1;
+    run_team(num_thread, art_thread, &args);
+
     free(simdata);
 }
@@ -43,160 +43,306 @@
 
 #include "utils.h"
 
-void
-bart(const float* data, int dy, int dt, int dx, const float* center,
-     const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-     int          num_block,
-     const float* ind_block)  // TODO: I think ind_block should be int*
+typedef struct
 {
-    float* gridx    = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy    = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx   = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy   = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi     = (int*) malloc((ngridx + ngridy) * sizeof(int));
-    float* simdata  = (float*) malloc((dy * dt * dx) * sizeof(float));
-    float* sum_dist = (float*) malloc((ngridx * ngridy) * sizeof(float));
-    float* update   = (float*) malloc((ngridx * ngridy) * sizeof(float));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL && simdata != NULL &&
-           sum_dist != NULL && update != NULL);
-
-    int   s, q, p, d, i, n, os;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
-    float upd;
-    int   ind_data, ind_recon;
-    float sum_dist2;
-    int   subset_ind1, subset_ind2;
-
-    for(i = 0; i < num_iter; i++)
-    {
-        // initialize simdata to zero
-        memset(simdata, 0, dy * dt * dx * sizeof(float));
+    const float*         data;
+    int                  dy;
+    int                  dt;
+    int                  dx;
+    const float*         center;
+    const float*         theta;
+    float*               recon;
+    int                  ngridx;
+    int                  ngridy;
+    int                  num_iter;
+    int                  num_block;
+    const int*           ind_block;
+    int                  num_order;
+    int                  model;
+    const unsigned char* mask;
+    const float*         geom;
+    ray_tracer*          gather;     // tracer of the backprojector
+    ray_cache*           rays;       // rays of the slice, read by all threads
+    int                  fresh;      // new slice geometry, set by thread 0
+    float*               sum_dist2;  // row sum of every ray
+    float*               sens;       // column sums of every subset
+    float*               sum_dist;   // one image per thread
+    float*               update;     // one image per thread
+} bart_args;
 
-        // For each slice
-        for(s = 0; s < dy; s++)
+// Rays are read from the cache shared by the threads when it holds the
+// slice, and traced by each thread otherwise.
+static int
+bart_ray(const bart_args* a, ray_tracer* ray, int p, int d, const int** indi,
+         const float** dist)
+{
+    if(a->rays->full)
+        return fetch_ray(a->rays, ray, a->theta, p, d, indi, dist);
+    *indi = ray->indi;
+    *dist = ray->dist;
+    return trace_ray(ray, d);
+}
+
+// Sum the images of the threads into the first one
+static void
+bart_reduce(thread_team* team, int tid, float* img, int npix)
+{
+    const int nt = team_size(team);
+
+    int n, t, n_beg, n_end;
+
+    team_range(team, tid, npix, &n_beg, &n_end);
+    for(n = n_beg; n < n_end; n++)
+    {
+        for(t = 1; t < nt; t++)
         {
-            preprocessing(ngridx, ngridy, dx, center[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
+            img[n] += img[t * npix + n];
+        }
+    }
+}
+
+// The threads split the projections of each subset. Every thread
+// backprojects into its own images, which are summed once the subset is
+// done, so the rays of a subset are updated concurrently without conflicts.
+// Slices are independent, so each one runs all of its iterations over the
+// same cached rays.
+static void
+bart_thread(thread_team* team, int tid, void* arg)
+{
+    bart_args* a    = (bart_args*) arg;
+    const int  npix = a->ngridx * a->ngridy;
+    const int  nt   = team_size(team);
+
+    ray_tracer ray;
+    init_tracer(&ray, a->model, a->mask, a->ngridx, a->ngridy, a->dx);
+    tracer_geom(&ray, a->geom);
+
+    float* sum_dist = a->sum_dist + tid * npix;
+    float* update   = a->update + tid * npix;
+
+    int          s, q, p, d, i, n, t, os;
+    int          csize;
+    const int*   indi;
+    const float* dist;
+    float        sim, upd;
+    int          ind_data, ind_recon;
+    int          subset_beg, subset_end;
+    int          q_beg, q_end, n_beg, n_end;
+    float        num, den;
+    float*       weight;
+    const int*   order;
 
-            subset_ind1 = dt / num_block;
-            subset_ind2 = subset_ind1;
+    for(s = 0; s < a->dy; s++)
+    {
+        ind_recon = s * npix;
+
+        // The rays of the previous slice are no longer read
+        team_barrier(team);
+        tracer_slice(&ray, a->center[s]);
+        if(tid == 0)
+        {
+            tracer_slice(a->gather, a->center[s]);
+            a->fresh = cache_slice(a->rays, &ray, a->theta, a->center[s]);
+        }
+        team_barrier(team);
 
-            // For each ordered-subset num_subset
-            for(os = 0; os < num_block + 1; os++)
+        // Row sums (sum_dist2) of every ray and column sums (sens) of every
+        // subset, kept while the slice geometry does not change. The column
+        // sums are accumulated along with the update when the subsets
+        // change between iterations.
+        if(a->fresh)
+        {
+            team_range(team, tid, a->dt, &q_beg, &q_end);
+            for(p = q_beg; p < q_end; p++)
             {
-                if(os == num_block)
+                if(!a->rays->full)
+                    tracer_angle(&ray, a->theta[p]);
+                for(d = 0; d < a->dx; d++)
                 {
-                    subset_ind2 = dt % num_block;
+                    csize = bart_ray(a, &ray, p, d, &indi, &dist);
+
+                    a->sum_dist2[d + p * a->dx] = 0.0f;
+                    for(n = 0; n < csize - 1; n++)
+                    {
+                        a->sum_dist2[d + p * a->dx] += dist[n] * dist[n];
+                    }
                 }
+            }
+            team_barrier(team);
 
-                // initialize sum_dist and update to zero
-                memset(sum_dist, 0, (ngridx * ngridy) * sizeof(float));
-                memset(update, 0, (ngridx * ngridy) * sizeof(float));
+            for(os = 0; os < a->num_block && a->num_order == 1; os++)
+            {
+                subset_range(a->dt, a->num_block, os, &subset_beg,
+                             &subset_end);
+                team_range(team, tid, subset_end - subset_beg, &q_beg,
+                           &q_end);
 
-                // For each projection angle
-                for(q = 0; q < subset_ind2; q++)
+                memset(sum_dist, 0, npix * sizeof(float));
+                memset(update, 0, npix * sizeof(float));
+                for(q = subset_beg + q_beg; q < subset_beg + q_end; q++)
                 {
-                    p = ind_block[q + os * subset_ind1];
+                    p = a->ind_block[q];
+                    if(!a->rays->full)
+                        tracer_angle(&ray, a->theta[p]);
+                    for(d = 0; d < a->dx; d++)
+                    {
+                        csize = bart_ray(a, &ray, p, d, &indi, &dist);
+                        backproject_entries(a->gather, p, d, csize, indi, dist,
+                                            0.0f, update, sum_dist);
+                    }
+                }
+                team_barrier(team);
+
+                if(tid == 0)
+                    backproject_slice(a->gather, a->theta, update, sum_dist);
+                team_barrier(team);
+
+                bart_reduce(team, tid, a->sum_dist, npix);
+                team_barrier(team);
 
-                    // Calculate the sin and cos values
-                    // of the projection angle and find
-                    // at which quadrant on the cartesian grid.
-                    theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-                    quadrant = calc_quadrant(theta_p);
-                    sin_p    = sinf(theta_p);
-                    cos_p    = cosf(theta_p);
+                if(tid == 0)
+                    memcpy(a->sens + os * npix, a->sum_dist,
+                           npix * sizeof(float));
+                team_barrier(team);
+            }
+        }
+
+        for(i = 0; i < a->num_iter; i++)
+        {
+            order = a->ind_block + (i % a->num_order) * a->dt;
+
+            // Update the slice after each subset
+            for(os = 0; os < a->num_block; os++)
+            {
+                subset_range(a->dt, a->num_block, os, &subset_beg,
+                             &subset_end);
+                team_range(team, tid, subset_end - subset_beg, &q_beg,
+                           &q_end);
+
+                weight = (a->num_order > 1) ? sum_dist : NULL;
+                memset(update, 0, npix * sizeof(float));
+                if(weight != NULL)
+                    memset(weight, 0, npix * sizeof(float));
+
+                // For each projection angle of the subset
+                for(q = subset_beg + q_beg; q < subset_beg + q_end; q++)
+                {
+                    p = order[q];
+                    if(!a->rays->full)
+                        tracer_angle(&ray, a->theta[p]);
 
                     // For each detector pixel
-                    for(d = 0; d < dx; d++)
+                    for(d = 0; d < a->dx; d++)
                     {
-                        // Calculate coordinates
-                        xi = -ngridx - ngridy;
-                        yi = 0.5f * (1 - dx) + d + mov;
-                        calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                    gridy, coordx, coordy);
-
-                        // Merge the (coordx, gridy) and (gridx, coordy)
-                        trim_coords(ngridx, ngridy, coordx, coordy, gridx,
-                                    gridy, &asize, ax, ay, &bsize, bx, by);
-
-                        // Sort the array of intersection points (ax, ay) and
-                        // (bx, by). The new sorted intersection points are
-                        // stored in (coorx, coory). Total number of points
-                        // are csize.
-                        sort_intersections(quadrant, asize, ax, ay, bsize, bx,
-                                           by, &csize, coorx, coory);
-
-                        // Calculate the distances (dist) between the
-                        // intersection points (coorx, coory). Find the
-                        // indices of the pixels on the reconstruction grid.
-                        calc_dist(ngridx, ngridy, csize, coorx, coory, indi,
-                                  dist);
-
-                        // Calculate simdata
-                        calc_simdata(s, p, d, ngridx, ngridy, dt, dx, csize,
-                                     indi, dist, recon,
-                                     simdata);  // Output: simdata
-
-                        // Calculate dist*dist
-                        sum_dist2 = 0.0f;
+                        csize = bart_ray(a, &ray, p, d, &indi, &dist);
+
+                        sim = 0.0f;
                         for(n = 0; n < csize - 1; n++)
                         {
-                            sum_dist2 += dist[n] * dist[n];
-                            sum_dist[indi[n]] += dist[n];
+                            sim += a->recon[indi[n] + ind_recon] * dist[n];
                         }
 
-                        // Update
-                        if(sum_dist2 != 0.0f)
+                        upd = 0.0f;
+                        if(a->sum_dist2[d + p * a->dx] != 0.0f)
                         {
-                            ind_data = d + p * dx + s * dt * dx;
-                            upd      = (data[ind_data] - simdata[ind_data]) /
-                                  sum_dist2;
-                            for(n = 0; n < csize - 1; n++)
-                            {
-                                update[indi[n]] += upd * dist[n];
-                            }
+                            ind_data = d + p * a->dx + s * a->dt * a->dx;
+                            upd      = (a->data[ind_data] - sim) /
+                                  a->sum_dist2[d + p * a->dx];
                         }
+                        backproject_entries(a->gather, p, d, csize, indi, dist,
+                                            upd, update, weight);
                     }
                 }
+                team_barrier(team);
+
+                if(tid == 0)
+                    backproject_slice(a->gather, a->theta, update, weight);
+                team_barrier(team);
 
-                for(n = 0; n < ngridx * ngridy; n++)
+                team_range(team, tid, npix, &n_beg, &n_end);
+                for(n = n_beg; n < n_end; n++)
                 {
-                    if(sum_dist[n] != 0.0)
+                    num = 0.0f;
+                    den = 0.0f;
+                    for(t = 0; t < nt; t++)
                     {
-                        ind_recon = s * ngridx * ngridy;
-                        recon[n + ind_recon] += update[n] / sum_dist[n];
+                        num += a->update[t * npix + n];
+                        if(weight != NULL)
+                            den += a->sum_dist[t * npix + n];
+                    }
+                    if(weight == NULL)
+                        den = a->sens[os * npix + n];
+                    if(den != 0.0f)
+                    {
+                        a->recon[n + ind_recon] += num / den;
                     }
                 }
+                team_barrier(team);
             }
         }
     }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
-    free(simdata);
+    free_tracer(&ray);
+}
+
+void
+bart(const float* data, int dy, int dt, int dx, const float* center,
+     const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+     int num_block, const int* ind_block, int num_order,
+     const char* projector, const unsigned char* mask, const float* geom,
+     const char* backprojector, int num_thread)
+{
+    const int nt    = (num_thread > 1) ? num_thread : 1;
+    const int npix  = ngridx * ngridy;
+    const int nsens = (num_order == 1) ? num_block : 0;
+
+    ray_tracer gather;
+    init_tracer(&gather, get_projector(projector), mask, ngridx, ngridy, dx);
+    tracer_geom(&gather, geom);
+    init_backprojector(&gather, get_backprojector(backprojector), dt);
+    // The other threads wait at a barrier while the first one gathers
+    gather.nthreads = nt;
+    ray_cache rays;
+    init_ray_cache(&rays, dt, dx);
+
+    float* sum_dist2 = (float*) malloc((dt * dx) * sizeof(float));
+    float* sens      = (float*) malloc((nsens * npix + 1) * sizeof(float));
+    float* sum_dist  = (float*) malloc((nt * npix) * sizeof(float));
+    float* update    = (float*) malloc((nt * npix) * sizeof(float));
+
+    assert(sum_dist2 != NULL && sens != NULL && sum_dist != NULL &&
+           update != NULL);
+
+    bart_args args = { .data      = data,
+                       .dy        = dy,
+                       .dt        = dt,
+                       .dx        = dx,
+                       .center    = center,
+                       .theta     = theta,
+                       .recon     = recon,
+                       .ngridx    = ngridx,
+                       .ngridy    = ngridy,
+                       .num_iter  = num_iter,
+                       .num_block = num_block,
+                       .ind_block = ind_block,
+                       .num_order = num_order,
+                       .model     = get_projector(projector),
+                       .mask      = mask,
+                       .geom      = geom,
+                       .gather    = &gather,
+                       .rays      = &rays,
+                       .fresh     = 0,
+                       .sum_dist2 = sum_dist2,
+                       .sens      = sens,
+                       .sum_dist  = sum_dist,
+                       .update    = update };
+
+    run_team(nt, bart_thread, &args);
+
+    free_ray_cache(&rays);
+    free_tracer(&gather);
+    free(sum_dist2);
+    free(sens);
     free(sum_dist);
     free(update);
 }
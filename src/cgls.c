@@ -0,0 +1,144 @@
+// Copyright (c) 2015, UChicago Argonne, LLC. All rights reserved.
+
+// Copyright 2015. UChicago Argonne, LLC. This software was produced
+// under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+// Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+// U.S. Department of Energy. The U.S. Government has rights to use,
+// reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+// UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+// ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+// modified to produce derivative works, such modified software should
+// be clearly marked, so as not to confuse it with the version available
+// from ANL.
+
+// Additionally, redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the following
+// conditions are met:
+
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+
+//     * Neither the name of UChicago Argonne, LLC, Argonne National
+//       Laboratory, ANL, the U.S. Government, nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+// Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "utils.h"
+
+// Conjugate gradient on the normal equations (CGLS) of the damped least
+// squares problem min |R x - data|^2 + damp^2 |x|^2, slice by slice. The
+// iterations of a slice stop early once the residual of the normal
+// equations falls below tol times its initial value.
+void
+cgls(const float* data, int dy, int dt, int dx, const float* center,
+     const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+     float damp, float tol, const char* projector,
+     const unsigned char* mask, const float* geom)
+{
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy,
+                dx);
+    tracer_geom(&ray, geom);
+    ray_cache rays;
+    init_ray_cache(&rays, dt, dx);
+
+    // Workspace of a slice: the residual and the projected search direction
+    // in data space, the gradient and the search direction in image space.
+    const int npix  = ngridx * ngridy;
+    const int nsino = dt * dx;
+    float*    resid = (float*) malloc(nsino * sizeof(float));
+    float*    proj  = (float*) malloc(nsino * sizeof(float));
+    float*    grad  = (float*) malloc(npix * sizeof(float));
+    float*    dir   = (float*) malloc(npix * sizeof(float));
+
+    assert(resid != NULL && proj != NULL && grad != NULL && dir != NULL);
+
+    int    s, i, n;
+    float* x;
+    double gamma, gamma0, gamma1, delta, alpha, beta;
+    double damp2 = (double) damp * damp;
+
+    for(s = 0; s < dy; s++)
+    {
+        x = recon + s * npix;
+        cache_slice(&rays, &ray, theta, center[s]);
+
+        // resid = data - R x, grad = R^* resid - damp^2 x
+        project_rays(&rays, &ray, theta, x, proj);
+        for(n = 0; n < nsino; n++)
+            resid[n] = data[n + s * nsino] - proj[n];
+        memset(grad, 0, npix * sizeof(float));
+        backproject_rays(&rays, &ray, theta, resid, grad);
+
+        gamma = 0.0;
+        for(n = 0; n < npix; n++)
+        {
+            grad[n] -= damp2 * x[n];
+            dir[n] = grad[n];
+            gamma += (double) grad[n] * grad[n];
+        }
+        gamma0 = gamma;
+
+        for(i = 0; i < num_iter && gamma > 0.0; i++)
+        {
+            // Step along dir minimizing the damped residual
+            project_rays(&rays, &ray, theta, dir, proj);
+            delta = 0.0;
+            for(n = 0; n < nsino; n++)
+                delta += (double) proj[n] * proj[n];
+            for(n = 0; n < npix; n++)
+                delta += damp2 * dir[n] * dir[n];
+            if(delta <= 0.0)
+                break;
+            alpha = gamma / delta;
+
+            for(n = 0; n < npix; n++)
+                x[n] += alpha * dir[n];
+            for(n = 0; n < nsino; n++)
+                resid[n] -= alpha * proj[n];
+
+            memset(grad, 0, npix * sizeof(float));
+            backproject_rays(&rays, &ray, theta, resid, grad);
+            gamma1 = 0.0;
+            for(n = 0; n < npix; n++)
+            {
+                grad[n] -= damp2 * x[n];
+                gamma1 += (double) grad[n] * grad[n];
+            }
+            if(gamma1 <= (double) tol * tol * gamma0)
+                break;
+
+            // Next direction, conjugate to the previous ones
+            beta  = gamma1 / gamma;
+            gamma = gamma1;
+            for(n = 0; n < npix; n++)
+                dir[n] = grad[n] + beta * dir[n];
+        }
+    }
+
+    free_ray_cache(&rays);
+    free_tracer(&ray);
+    free(resid);
+    free(proj);
+    free(grad);
+    free(dir);
+}
@@ -46,37 +46,24 @@
 void
 fbp(const float* data, int dy, int dt, int dx, const float* center,
     const float* theta, float* recon, int ngridx, int ngridy, const char* fname,
-    const float* filter_par)
+    const float* filter_par, const char* projector,
+    const unsigned char* mask, const float* geom, const char* backprojector)
 {
-    float* gridx  = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi   = (int*) malloc((ngridx + ngridy) * sizeof(int));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL);
-
-    int   s, p, d, n;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy,
+                dx);
+    tracer_geom(&ray, geom);
+    init_backprojector(&ray, get_backprojector(backprojector), dt);
+
+    int   s, p, d;
+    int   csize;
     int   ind_data, ind_recon;
 
     // For each slice
     for(s = 0; s < dy; s++)
     {
-        preprocessing(ngridx, ngridy, dx, center[s], &mov, gridx,
-                      gridy);  // Outputs: mov, gridx, gridy
+        tracer_slice(&ray, center[s]);
+        ind_recon = s * ngridx * ngridy;
 
         // For each projection angle
         for(p = 0; p < dt; p++)
@@ -84,57 +71,24 @@ fbp(const float* data, int dy, int dt, int dx, const float* center,
             // Calculate the sin and cos values
             // of the projection angle and find
             // at which quadrant on the cartesian grid.
-            theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-            quadrant = calc_quadrant(theta_p);
-            sin_p    = sinf(theta_p);
-            cos_p    = cosf(theta_p);
+            tracer_angle(&ray, theta[p]);
 
             // For each detector pixel
             for(d = 0; d < dx; d++)
             {
-                // Calculate coordinates
-                xi = -ngridx - ngridy;
-                yi = 0.5f * (1 - dx) + d + mov;
-                calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx, gridy,
-                            coordx, coordy);
-
-                // Merge the (coordx, gridy) and (gridx, coordy)
-                trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                            &asize, ax, ay, &bsize, bx, by);
-
-                // Sort the array of intersection points (ax, ay) and
-                // (bx, by). The new sorted intersection points are
-                // stored in (coorx, coory). Total number of points
-                // are csize.
-                sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                   &csize, coorx, coory);
-
-                // Calculate the distances (dist) between the
-                // intersection points (coorx, coory). Find the
-                // indices of the pixels on the reconstruction grid.
-                calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist);
+                // Find the indices (indi) of the pixels on the
+                // reconstruction grid crossed by the ray and their
+                // weights (dist) for the selected projection model.
+                csize = trace_ray(&ray, d);
 
                 // Update
-                ind_recon = s * ngridx * ngridy;
-                ind_data  = d + p * dx + s * dt * dx;
-                for(n = 0; n < csize - 1; n++)
-                {
-                    recon[indi[n] + ind_recon] += data[ind_data] * dist[n];
-                }
+                ind_data = d + p * dx + s * dt * dx;
+                backproject_ray(&ray, p, d, csize, data[ind_data],
+                                recon + ind_recon, NULL);
             }
         }
+        backproject_slice(&ray, theta, recon + ind_recon, NULL);
     }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+    free_tracer(&ray);
 }
@@ -43,215 +43,184 @@
 
 #include "utils.h"
 
+// The state of a slice kept between calls: a header, then the planes of
+// the current iterate (recon scaled by 1/r), of the previous iterate and of
+// the previous gradient for the Barzilai-Borwein step.
+enum
+{
+    GRAD_STARTED,  // nonzero once the slice was initialized
+    GRAD_ITER,     // iterations done so far
+    GRAD_HEADER
+};
+
+enum
+{
+    GRAD_RECON,
+    GRAD_RECON0,
+    GRAD_GRAD0,
+    GRAD_PLANES
+};
+
+int
+grad_state_size(int dt, int dx, int ngridx, int ngridy)
+{
+    return GRAD_HEADER + GRAD_PLANES * ngridx * ngridy;
+}
+
 void
 grad(const float* data, int dy, int dt, int dx, const float* center,
      const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-     const float* reg_pars)
+     const float* reg_pars, const char* projector,
+     const unsigned char* mask, const float* geom, const char* backprojector,
+     float* state)
 {
-    float* gridx    = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy    = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx   = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy   = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi     = (int*) malloc((ngridx + ngridy) * sizeof(int));
-    float* simdata  = (float*) malloc((dy * dt * dx) * sizeof(float));
-    float* sum_dist = (float*) malloc((ngridx * ngridy) * sizeof(float));
-
-    float* prox1  = (float*) malloc((dy * dt * dx) * sizeof(float));
-    float* grad   = (float*) malloc((dy * ngridx * ngridy) * sizeof(float));
-    float* grad0  = (float*) malloc((dy * ngridx * ngridy) * sizeof(float));
-    float* recon0 = (float*) malloc((dy * ngridx * ngridy) * sizeof(float));
-    float* lambda = (float*) malloc((dy) * sizeof(float));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL && simdata != NULL &&
-           sum_dist != NULL && grad != NULL && grad0 != NULL &&
-           recon0 != NULL && lambda != NULL);
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy,
+                dx);
+    tracer_geom(&ray, geom);
+    init_backprojector(&ray, get_backprojector(backprojector), dt);
+    int*   indi = ray.indi;
+    float* dist = ray.dist;
+
+    const int npix = ngridx * ngridy;
+    const int size = grad_state_size(dt, dx, ngridx, ngridy);
+
+    // Without a state from the caller, the state lives for this call only.
+    float* owned = NULL;
+    if(state == NULL)
+    {
+        owned = (float*) calloc((size_t) dy * size, sizeof(float));
+        state = owned;
+    }
+
+    float* simdata  = (float*) malloc((dt * dx) * sizeof(float));
+    float* sum_dist = (float*) malloc(npix * sizeof(float));
+    float* grad     = (float*) malloc(npix * sizeof(float));
+
+    assert(state != NULL && simdata != NULL && sum_dist != NULL &&
+           grad != NULL);
 
     int    s, p, d, i, n;
-    int    quadrant;
-    float  theta_p, sin_p, cos_p;
-    float  mov, xi, yi;
-    int    asize, bsize, csize;
+    int    csize;
     double upd;
-    int    ind_data, ind_recon;
+    float  prox1;
+    float  lambda;
     float  sum_dist2;
-    int    ix, iy;
+    float *head, *x, *recon0, *grad0;
 
     // scaling constant r such that r*R(r*R^*(data)) ~ data
     float r;
 
     r = 1 / sqrt(dx * dt / 2.0);
 
-    // scale initial guess
+    // Slices are independent, so each one runs all of its iterations in
+    // turn, resuming where the previous call stopped.
     for(s = 0; s < dy; s++)
     {
-        ind_recon = s * ngridx * ngridy;
-        for(iy = 0; iy < ngridy; iy++)
-            for(ix = 0; ix < ngridx; ix++)
-                recon[ind_recon + iy * ngridx + ix] /= r;
-    }
+        head   = state + (size_t) s * size;
+        x      = head + GRAD_HEADER + GRAD_RECON * npix;
+        recon0 = head + GRAD_HEADER + GRAD_RECON0 * npix;
+        grad0  = head + GRAD_HEADER + GRAD_GRAD0 * npix;
 
-    memset(grad0, 0, dy * ngridx * ngridy * sizeof(float));
-    memset(prox1, 0, dy * dt * dx * sizeof(float));
-    memcpy(recon0, recon, dy * ngridx * ngridy * sizeof(float));
+        if(!head[GRAD_STARTED])
+        {
+            // scale initial guess
+            for(n = 0; n < npix; n++)
+                x[n] = recon[s * npix + n] / r;
+            memset(grad0, 0, npix * sizeof(float));
+            memcpy(recon0, x, npix * sizeof(float));
+            head[GRAD_ITER]    = 0.0f;
+            head[GRAD_STARTED] = 1.0f;
+        }
 
-    // Iterations
-    for(i = 0; i < num_iter; i++)
-    {
-        // initialize simdata and grad to 0
-        memset(simdata, 0, dy * dt * dx * sizeof(float));
-        memset(grad, 0, dy * ngridx * ngridy * sizeof(float));
+        tracer_slice(&ray, center[s]);
 
-        // compute gradient, grad = 2*R^*(R(recon)-data)
-        // For each slice
-        for(s = 0; s < dy; s++)
+        // Iterations
+        for(i = 0; i < num_iter; i++)
         {
-            ind_recon = s * ngridx * ngridy;
-            // compute proximal of the projections
-            preprocessing(ngridx, ngridy, dx, center[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            // initialize sum_dist and update to zero
-            memset(sum_dist, 0, (ngridx * ngridy) * sizeof(float));
+            // initialize simdata, grad and sum_dist to 0
+            memset(simdata, 0, dt * dx * sizeof(float));
+            memset(grad, 0, npix * sizeof(float));
+            memset(sum_dist, 0, npix * sizeof(float));
 
+            // compute gradient, grad = 2*R^*(R(recon)-data)
             // For each projection angle
             for(p = 0; p < dt; p++)
             {
                 // Calculate the sin and cos values
                 // of the projection angle and find
                 // at which quadrant on the cartesian grid.
-                theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
+                tracer_angle(&ray, theta[p]);
 
                 // For each detector pixel
                 for(d = 0; d < dx; d++)
                 {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = 0.5f * (1 - dx) + d + mov;
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist);
+                    // Find the indices (indi) of the pixels on the
+                    // reconstruction grid crossed by the ray and their
+                    // weights (dist) for the selected projection model.
+                    csize = trace_ray(&ray, d);
 
                     // Calculate simdata
-                    calc_simdata(s, p, d, ngridx, ngridy, dt, dx, csize, indi,
-                                 dist, recon,
+                    calc_simdata(0, p, d, ngridx, ngridy, dt, dx, csize, indi,
+                                 dist, x,
                                  simdata);  // Output: simdata
 
-                    ind_data        = d + p * dx + s * dt * dx;
-                    prox1[ind_data] = simdata[ind_data] * r - data[ind_data];
+                    prox1 = simdata[d + p * dx] * r -
+                            data[d + p * dx + s * dt * dx];
 
                     // Calculate dist*dist
                     sum_dist2 = 0.0f;
                     for(n = 0; n < csize - 1; n++)
                     {
                         sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indi[n]] += dist[n];
                     }
 
+                    upd = 0;
                     if(sum_dist2 != 0.0f)
-                        for(n = 0; n < csize - 1; n++)
-                            grad[ind_recon + indi[n]] +=
-                                2 * r * prox1[ind_data] * dist[n];
+                        upd = 2 * r * prox1;
+                    backproject_ray(&ray, p, d, csize, upd, grad, sum_dist);
                 }
             }
-        }
+            backproject_slice(&ray, theta, grad, sum_dist);
 
-        // compute the gradient step
-        for(s = 0; s < dy; s++)
-        {
+            // compute the gradient step
             if(reg_pars[0] < 0)
             {
-                if(i == 0)
+                if(head[GRAD_ITER] == 0.0f)
                     // first gradient step (small)
-                    lambda[s] = 1e-3;
+                    lambda = 1e-3;
                 else
                 {
-                    upd       = 0;
-                    lambda[s] = 0;
-                    ind_recon = s * ngridx * ngridy;
-                    for(iy = 0; iy < ngridy; iy++)
-                        for(ix = 0; ix < ngridx; ix++)
-                        {
-                            lambda[s] +=
-                                (recon[ind_recon + iy * ngridx + ix] -
-                                 recon0[ind_recon + iy * ngridx + ix]) *
-                                (grad[ind_recon + iy * ngridx + ix] -
-                                 grad0[ind_recon + iy * ngridx + ix]);
-                            upd += (grad[ind_recon + iy * ngridx + ix] -
-                                    grad0[ind_recon + iy * ngridx + ix]) *
-                                   (grad[ind_recon + iy * ngridx + ix] -
-                                    grad0[ind_recon + iy * ngridx + ix]);
-                        }
-                    lambda[s] /= upd;
+                    upd    = 0;
+                    lambda = 0;
+                    for(n = 0; n < npix; n++)
+                    {
+                        lambda += (x[n] - recon0[n]) * (grad[n] - grad0[n]);
+                        upd += (grad[n] - grad0[n]) * (grad[n] - grad0[n]);
+                    }
+                    lambda /= upd;
                 }
             }
             else
-                lambda[s] = reg_pars[0];
+                lambda = reg_pars[0];
+
+            // save previous iterations
+            memcpy(grad0, grad, npix * sizeof(float));
+            memcpy(recon0, x, npix * sizeof(float));
+            // update, recon = recon - lambda*grad
+            for(n = 0; n < npix; n++)
+                x[n] -= lambda * grad[n];
+            head[GRAD_ITER] += 1.0f;
         }
-        // save previous iterations
-        memcpy(grad0, grad, dy * ngridx * ngridy * sizeof(float));
-        memcpy(recon0, recon, dy * ngridx * ngridy * sizeof(float));
-        // update, recon = recon - lambda*grad
-        for(s = 0; s < dy; s++)
-        {
-            ind_recon = s * ngridx * ngridy;
-            for(iy = 0; iy < ngridy; iy++)
-                for(ix = 0; ix < ngridx; ix++)
-                    recon[ind_recon + iy * ngridx + ix] -=
-                        lambda[s] * grad[ind_recon + iy * ngridx + ix];
-        }
-    }
 
-    // scale result
-    for(s = 0; s < dy; s++)
-    {
-        ind_recon = s * ngridx * ngridy;
-        for(iy = 0; iy < ngridy; iy++)
-            for(ix = 0; ix < ngridx; ix++)
-                recon[ind_recon + iy * ngridx + ix] *= r;
+        // scale result
+        for(n = 0; n < npix; n++)
+            recon[s * npix + n] = r * x[n];
     }
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+
+    free_tracer(&ray);
+    free(owned);
     free(simdata);
     free(sum_dist);
-    free(prox1);
-    free(recon0);
-    free(grad0);
     free(grad);
 }
@@ -91,7 +91,7 @@ pthread_mutex_t lock;
 void
 gridrec(const float* data, int dy, int dt, int dx, const float* center,
         const float* theta, float* recon, int ngridx, int ngridy,
-        const char* fname, const float* filter_par)
+        const char* fname, const float* filter_par, const int* roi)
 {
     int    s, p, iu, iv;
     int    j;
@@ -131,6 +131,19 @@ gridrec(const float* data, int dy, int dt, int dx, const float* center,
     const int M02   = pdim2 - 1;
     const int M2    = pdim2;
 
+    // Region of interest (first row, first column, rows, columns) of the
+    // ngridx x ngridy grid written to recon, which holds only this region.
+    const int r0 = (roi != NULL) ? roi[0] : 0;
+    const int c0 = (roi != NULL) ? roi[1] : 0;
+    const int nr = (roi != NULL) ? roi[2] : ngridx;
+    const int nc = (roi != NULL) ? roi[3] : ngridy;
+
+    // Rows of H[][] feeding the columns of the region, in wrap-around order
+    // they form at most two contiguous runs starting at H[u0] and H[0].
+    const int u0    = (c0 + (pdim - ngridy) / 2 + M2) & (pdim - 1);
+    const int nrun1 = (nc < pdim - u0) ? nc : pdim - u0;
+    const int nrun2 = nc - nrun1;
+
     unsigned char filter2d = filter_is_2d(fname);
 
     // Allocate storage for various arrays.
@@ -196,6 +209,43 @@ gridrec(const float* data, int dy, int dt, int dx, const float* center,
     DftiSetValue(forward_2d, DFTI_THREAD_LIMIT,
                  1); /* FFT should run sequentially to avoid oversubscription */
     DftiCommitDescriptor(forward_2d);
+    // Pruned 2D FFT for a region of interest: transform all the columns of
+    // H[][], then only the rows holding the region.
+    DFTI_DESCRIPTOR_HANDLE forward_cols, forward_rows1, forward_rows2;
+    MKL_LONG               col_strides[2] = { 0, (MKL_LONG) pdim };
+    if(roi != NULL)
+    {
+        DftiCreateDescriptor(&forward_cols, DFTI_SINGLE, DFTI_COMPLEX, 1,
+                             length_1d);
+        DftiSetValue(forward_cols, DFTI_THREAD_LIMIT, 1);
+        DftiSetValue(forward_cols, DFTI_NUMBER_OF_TRANSFORMS,
+                     (MKL_LONG) pdim);
+        DftiSetValue(forward_cols, DFTI_INPUT_STRIDES, col_strides);
+        DftiSetValue(forward_cols, DFTI_OUTPUT_STRIDES, col_strides);
+        DftiSetValue(forward_cols, DFTI_INPUT_DISTANCE, (MKL_LONG) 1);
+        DftiSetValue(forward_cols, DFTI_OUTPUT_DISTANCE, (MKL_LONG) 1);
+        DftiCommitDescriptor(forward_cols);
+        DftiCreateDescriptor(&forward_rows1, DFTI_SINGLE, DFTI_COMPLEX, 1,
+                             length_1d);
+        DftiSetValue(forward_rows1, DFTI_THREAD_LIMIT, 1);
+        DftiSetValue(forward_rows1, DFTI_NUMBER_OF_TRANSFORMS,
+                     (MKL_LONG) nrun1);
+        DftiSetValue(forward_rows1, DFTI_INPUT_DISTANCE, (MKL_LONG) pdim);
+        DftiSetValue(forward_rows1, DFTI_OUTPUT_DISTANCE, (MKL_LONG) pdim);
+        DftiCommitDescriptor(forward_rows1);
+        if(nrun2 > 0)
+        {
+            DftiCreateDescriptor(&forward_rows2, DFTI_SINGLE, DFTI_COMPLEX, 1,
+                                 length_1d);
+            DftiSetValue(forward_rows2, DFTI_THREAD_LIMIT, 1);
+            DftiSetValue(forward_rows2, DFTI_NUMBER_OF_TRANSFORMS,
+                         (MKL_LONG) nrun2);
+            DftiSetValue(forward_rows2, DFTI_INPUT_DISTANCE, (MKL_LONG) pdim);
+            DftiSetValue(forward_rows2, DFTI_OUTPUT_DISTANCE,
+                         (MKL_LONG) pdim);
+            DftiCommitDescriptor(forward_rows2);
+        }
+    }
 #else
     int n[1] = { pdim };
     // Set up fftw plans
@@ -208,6 +258,26 @@ gridrec(const float* data, int dy, int dt, int dx, const float* center,
                                           1, pdim, FFTW_BACKWARD, FFTW_MEASURE);
     forward_2d =
         fftwf_plan_dft_2d(pdim, pdim, H[0], H[0], FFTW_FORWARD, FFTW_MEASURE);
+    // Pruned 2D FFT for a region of interest: transform all the columns of
+    // H[][], then only the rows holding the region.
+    fftwf_plan forward_cols  = NULL;
+    fftwf_plan forward_rows1 = NULL;
+    fftwf_plan forward_rows2 = NULL;
+    if(roi != NULL)
+    {
+        forward_cols = fftwf_plan_many_dft(1, n, pdim, H[0], NULL, pdim, 1,
+                                           H[0], NULL, pdim, 1, FFTW_FORWARD,
+                                           FFTW_MEASURE);
+        forward_rows1 = fftwf_plan_many_dft(1, n, nrun1, H[u0], NULL, 1, pdim,
+                                            H[u0], NULL, 1, pdim, FFTW_FORWARD,
+                                            FFTW_MEASURE);
+        if(nrun2 > 0)
+        {
+            forward_rows2 = fftwf_plan_many_dft(
+                1, n, nrun2, H[0], NULL, 1, pdim, H[0], NULL, 1, pdim,
+                FFTW_FORWARD, FFTW_MEASURE);
+        }
+    }
     pthread_mutex_unlock(&lock);  // release global lock
 #endif
 
@@ -528,9 +598,29 @@ gridrec(const float* data, int dy, int dt, int dx, const float* center,
         // right [X>0] (resp. left [X<0]) half of the image.
 
 #ifdef USE_MKL
-        DftiComputeForward(forward_2d, H[0]);
+        if(roi == NULL)
+        {
+            DftiComputeForward(forward_2d, H[0]);
+        }
+        else
+        {
+            DftiComputeForward(forward_cols, H[0]);
+            DftiComputeForward(forward_rows1, H[u0]);
+            if(nrun2 > 0)
+                DftiComputeForward(forward_rows2, H[0]);
+        }
 #else
-        fftwf_execute(forward_2d);
+        if(roi == NULL)
+        {
+            fftwf_execute(forward_2d);
+        }
+        else
+        {
+            fftwf_execute(forward_cols);
+            fftwf_execute(forward_rows1);
+            if(nrun2 > 0)
+                fftwf_execute(forward_rows2);
+        }
 #endif
 
         // Copy the real and imaginary parts of the complex data from H[][],
@@ -568,51 +658,32 @@ gridrec(const float* data, int dy, int dt, int dx, const float* center,
         // convert to inverse cm (say), one must divide the data by the detector
         // spacing in cm.
 
-        int       ustart, vstart, ufin, vfin;
-        const int padx    = (pdim - ngridx) / 2;
-        const int pady    = (pdim - ngridy) / 2;
-        const int offsetx = M02 + 1 - padx;
-        const int offsety = M02 + 1 - pady;
-        const int islc1   = s * ngridx * ngridy;        // index slice 1
-        const int islc2   = (s + 1) * ngridx * ngridy;  // index slice 2
-
-        ustart = pdim - offsety;
-        ufin   = pdim;
-        j      = 0;
-        while(j < ngridy)
+        const int padx  = (pdim - ngridx) / 2;
+        const int pady  = (pdim - ngridy) / 2;
+        const int islc1 = s * nr * nc;        // index slice 1
+        const int islc2 = (s + 1) * nr * nc;  // index slice 2
+
+        // Element (j, k) of the centered subarray is H[iu][iv] with
+        // iu = j + pady + M2 and iv = k + padx + M2 taken modulo pdim, and
+        // lands in row ngridx - 1 - k, column j of the reconstruction.
+        for(j = c0; j < c0 + nc; j++)
         {
-            for(iu = ustart; iu < ufin; j++, iu++)
+            const int   c       = j - c0;
+            const float corrn_u = winv[j + pady];
+            iu                  = (j + pady + M2) & (pdim - 1);
+            __PRAGMA_SIMD
+            for(int r = r0; r < r0 + nr; r++)
             {
-                const float corrn_u = winv[j + pady];
-                vstart              = pdim - offsetx;
-                vfin                = pdim;
-                k                   = 0;
-                while(k < ngridx)
+                k                 = ngridx - 1 - r;
+                iv                = (k + padx + M2) & (pdim - 1);
+                const float corrn = corrn_u * winv[k + padx];
+                recon[islc1 + nc * (r - r0) + c] = corrn * crealf(H[iu][iv]);
+                if(__LIKELY((s + 1) < dy))
                 {
-                    __PRAGMA_SIMD
-                    for(iv = vstart; iv < vfin; k++, iv++)
-                    {
-                        const float corrn = corrn_u * winv[k + padx];
-                        recon[islc1 + ngridy * (ngridx - 1 - k) + j] =
-                            corrn * crealf(H[iu][iv]);
-                        if(__LIKELY((s + 1) < dy))
-                        {
-                            recon[islc2 + ngridy * (ngridx - 1 - k) + j] =
-                                corrn * cimagf(H[iu][iv]);
-                        }
-                    }
-                    if(k < ngridx)
-                    {
-                        vstart = 0;
-                        vfin   = ngridx - offsetx;
-                    }
+                    recon[islc2 + nc * (r - r0) + c] =
+                        corrn * cimagf(H[iu][iv]);
                 }
             }
-            if(j < ngridy)
-            {
-                ustart = 0;
-                ufin   = ngridy - offsety;
-            }
         }
     }
 
@@ -636,10 +707,24 @@ gridrec(const float* data, int dy, int dt, int dx, const float* center,
 #ifdef USE_MKL
     DftiFreeDescriptor(&reverse_1d);
     DftiFreeDescriptor(&forward_2d);
+    if(roi != NULL)
+    {
+        DftiFreeDescriptor(&forward_cols);
+        DftiFreeDescriptor(&forward_rows1);
+        if(nrun2 > 0)
+            DftiFreeDescriptor(&forward_rows2);
+    }
 #else
     fftwf_destroy_plan(reverse_1d);
     fftwf_destroy_plan(reverse_1d_many);
     fftwf_destroy_plan(forward_2d);
+    if(roi != NULL)
+    {
+        fftwf_destroy_plan(forward_cols);
+        fftwf_destroy_plan(forward_rows1);
+        if(nrun2 > 0)
+            fftwf_destroy_plan(forward_rows2);
+    }
 #endif
     return;
 }
@@ -0,0 +1,196 @@
+// Copyright (c) 2015, UChicago Argonne, LLC. All rights reserved.
+
+// Copyright 2015. UChicago Argonne, LLC. This software was produced
+// under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+// Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+// U.S. Department of Energy. The U.S. Government has rights to use,
+// reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+// UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+// ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+// modified to produce derivative works, such modified software should
+// be clearly marked, so as not to confuse it with the version available
+// from ANL.
+
+// Additionally, redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the following
+// conditions are met:
+
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+
+//     * Neither the name of UChicago Argonne, LLC, Argonne National
+//       Laboratory, ANL, the U.S. Government, nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+// Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+
+#include "utils.h"
+
+// Norm of the pair (a, b) of vectors of sizes na and nb
+static double
+pair_norm(const float* a, int na, const float* b, int nb)
+{
+    double sum = 0.0;
+    for(int n = 0; n < na; n++)
+        sum += (double) a[n] * a[n];
+    for(int n = 0; n < nb; n++)
+        sum += (double) b[n] * b[n];
+    return sqrt(sum);
+}
+
+// LSQR bidiagonalization of the damped least squares problem
+// min |R x - data|^2 + damp^2 |x|^2, slice by slice. The damping is the
+// lower block of the operator (R, damp I), so that an initial guess x0 only
+// shifts the right hand side to (data - R x0, -damp x0). The iterations of
+// a slice stop early once the estimated residual of the normal equations
+// falls below tol times its initial value.
+void
+lsqr(const float* data, int dy, int dt, int dx, const float* center,
+     const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+     float damp, float tol, const char* projector,
+     const unsigned char* mask, const float* geom)
+{
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy,
+                dx);
+    tracer_geom(&ray, geom);
+    ray_cache rays;
+    init_ray_cache(&rays, dt, dx);
+
+    // Workspace of a slice: the left vector u = (u1, u2) in data space and
+    // in image space for the damping, the right vector v, the search
+    // direction w and the product of the transposed operator.
+    const int npix  = ngridx * ngridy;
+    const int nsino = dt * dx;
+    const int ndamp = (damp != 0.0f) ? npix : 0;
+    float*    u1    = (float*) malloc(nsino * sizeof(float));
+    float*    u2    = (float*) malloc(npix * sizeof(float));
+    float*    v     = (float*) malloc(npix * sizeof(float));
+    float*    w     = (float*) malloc(npix * sizeof(float));
+    float*    atu   = (float*) malloc(npix * sizeof(float));
+    float*    proj  = (float*) malloc(nsino * sizeof(float));
+
+    assert(u1 != NULL && u2 != NULL && v != NULL && w != NULL);
+    assert(atu != NULL && proj != NULL);
+
+    int    s, i, n;
+    float* x;
+    double alpha, beta, rho, rhobar, phi, phibar, c, sn, theta_k, norm0;
+
+    for(s = 0; s < dy; s++)
+    {
+        x = recon + s * npix;
+        cache_slice(&rays, &ray, theta, center[s]);
+
+        // beta u = (data - R x0, -damp x0)
+        project_rays(&rays, &ray, theta, x, proj);
+        for(n = 0; n < nsino; n++)
+            u1[n] = data[n + s * nsino] - proj[n];
+        for(n = 0; n < ndamp; n++)
+            u2[n] = -damp * x[n];
+        beta = pair_norm(u1, nsino, u2, ndamp);
+        if(beta == 0.0)
+            continue;
+        for(n = 0; n < nsino; n++)
+            u1[n] /= beta;
+        for(n = 0; n < ndamp; n++)
+            u2[n] /= beta;
+
+        // alpha v = R^* u1 + damp u2
+        memset(v, 0, npix * sizeof(float));
+        backproject_rays(&rays, &ray, theta, u1, v);
+        for(n = 0; n < ndamp; n++)
+            v[n] += damp * u2[n];
+        alpha = pair_norm(v, npix, NULL, 0);
+        if(alpha == 0.0)
+            continue;
+        for(n = 0; n < npix; n++)
+        {
+            v[n] /= alpha;
+            w[n] = v[n];
+        }
+
+        phibar = beta;
+        rhobar = alpha;
+        norm0  = alpha * beta;
+
+        for(i = 0; i < num_iter; i++)
+        {
+            // beta u = (R v, damp v) - alpha u
+            project_rays(&rays, &ray, theta, v, proj);
+            for(n = 0; n < nsino; n++)
+                u1[n] = proj[n] - alpha * u1[n];
+            for(n = 0; n < ndamp; n++)
+                u2[n] = damp * v[n] - alpha * u2[n];
+            beta = pair_norm(u1, nsino, u2, ndamp);
+            if(beta > 0.0)
+            {
+                for(n = 0; n < nsino; n++)
+                    u1[n] /= beta;
+                for(n = 0; n < ndamp; n++)
+                    u2[n] /= beta;
+            }
+
+            // alpha v = R^* u1 + damp u2 - beta v
+            memset(atu, 0, npix * sizeof(float));
+            backproject_rays(&rays, &ray, theta, u1, atu);
+            for(n = 0; n < ndamp; n++)
+                atu[n] += damp * u2[n];
+            for(n = 0; n < npix; n++)
+                atu[n] -= beta * v[n];
+            alpha = pair_norm(atu, npix, NULL, 0);
+            if(alpha > 0.0)
+            {
+                for(n = 0; n < npix; n++)
+                    atu[n] /= alpha;
+            }
+
+            // Plane rotation eliminating the subdiagonal beta
+            rho     = sqrt(rhobar * rhobar + beta * beta);
+            c       = rhobar / rho;
+            sn      = beta / rho;
+            theta_k = sn * alpha;
+            rhobar  = -c * alpha;
+            phi     = c * phibar;
+            phibar  = sn * phibar;
+
+            for(n = 0; n < npix; n++)
+            {
+                x[n] += (phi / rho) * w[n];
+                w[n] = atu[n] - (theta_k / rho) * w[n];
+                v[n] = atu[n];
+            }
+
+            // |R^* r| = phibar alpha |c|
+            if(alpha == 0.0 || phibar * alpha * fabs(c) <= tol * norm0)
+                break;
+        }
+    }
+
+    free_ray_cache(&rays);
+    free_tracer(&ray);
+    free(u1);
+    free(u2);
+    free(v);
+    free(w);
+    free(atu);
+    free(proj);
+}
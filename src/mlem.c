@@ -45,141 +45,94 @@
 
 void
 mlem(const float* data, int dy, int dt, int dx, const float* center,
-     const float* theta, float* recon, int ngridx, int ngridy, int num_iter)
+     const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
+     const char* projector, const unsigned char* mask, const float* geom,
+     const char* backprojector)
 {
-    float* gridx    = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy    = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx   = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy   = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi     = (int*) malloc((ngridx + ngridy) * sizeof(int));
-    float* simdata  = (float*) malloc((dy * dt * dx) * sizeof(float));
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy,
+                dx);
+    tracer_geom(&ray, geom);
+    init_backprojector(&ray, get_backprojector(backprojector), dt);
+    ray_cache rays;
+    init_ray_cache(&rays, dt, dx);
+
     float* sum_dist = (float*) malloc((ngridx * ngridy) * sizeof(float));
     float* update   = (float*) malloc((ngridx * ngridy) * sizeof(float));
 
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL && simdata != NULL &&
-           sum_dist != NULL && update != NULL);
-
-    int   s, p, d, i, m, n;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
-    float upd;
-    int   ind_data, ind_recon;
-    float sum_dist2;
-
-    for(i = 0; i < num_iter; i++)
+    assert(sum_dist != NULL && update != NULL);
+
+    int          s, p, d, i, n;
+    int          csize;
+    const int*   indi;
+    const float* dist;
+    float        sim, upd;
+    int          ind_data, ind_recon;
+
+    // Slices are independent, so each one runs all of its iterations over
+    // the same cached rays.
+    for(s = 0; s < dy; s++)
     {
-        // initialize simdata to zero
-        memset(simdata, 0, dy * dt * dx * sizeof(float));
+        ind_recon = s * ngridx * ngridy;
 
-        // For each slice
-        for(s = 0; s < dy; s++)
+        // The sensitivity image (sum_dist), the backprojection of ones,
+        // only depends on the geometry of the slice.
+        if(cache_slice(&rays, &ray, theta, center[s]))
         {
-            preprocessing(ngridx, ngridy, dx, center[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            // initialize sum_dist and update to zero
             memset(sum_dist, 0, (ngridx * ngridy) * sizeof(float));
             memset(update, 0, (ngridx * ngridy) * sizeof(float));
+            for(p = 0; p < dt; p++)
+            {
+                for(d = 0; d < dx; d++)
+                {
+                    csize = fetch_ray(&rays, &ray, theta, p, d, &indi, &dist);
+                    backproject_entries(&ray, p, d, csize, indi, dist, 0.0f,
+                                        update, sum_dist);
+                }
+            }
+            backproject_slice(&ray, theta, update, sum_dist);
+        }
+
+        for(i = 0; i < num_iter; i++)
+        {
+            memset(update, 0, (ngridx * ngridy) * sizeof(float));
 
             // For each projection angle
             for(p = 0; p < dt; p++)
             {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
                 // For each detector pixel
                 for(d = 0; d < dx; d++)
                 {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = 0.5f * (1 - dx) + d + mov;
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist);
-
-                    // Calculate simdata
-                    calc_simdata(s, p, d, ngridx, ngridy, dt, dx, csize, indi,
-                                 dist, recon,
-                                 simdata);  // Output: simdata
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0f;
+                    // Forward project the ray, take the ratio to the data
+                    // and backproject it in one pass over its entries.
+                    csize = fetch_ray(&rays, &ray, theta, p, d, &indi, &dist);
+
+                    sim = 0.0f;
                     for(n = 0; n < csize - 1; n++)
                     {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indi[n]] += dist[n];
+                        sim += recon[indi[n] + ind_recon] * dist[n];
                     }
 
-                    // Update
-                    if(sum_dist2 != 0.0f)
-                    {
-                        ind_data = d + p * dx + s * dt * dx;
-                        upd      = data[ind_data] / simdata[ind_data];
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            update[indi[n]] += upd * dist[n];
-                        }
-                    }
+                    ind_data = d + p * dx + s * dt * dx;
+                    upd      = (sim != 0.0f) ? data[ind_data] / sim : 0.0f;
+                    backproject_entries(&ray, p, d, csize, indi, dist, upd,
+                                        update, NULL);
                 }
             }
+            backproject_slice(&ray, theta, update, NULL);
 
-            m = 0;
             for(n = 0; n < ngridx * ngridy; n++)
             {
                 if(sum_dist[n] != 0.0f)
                 {
-                    ind_recon = s * ngridx * ngridy;
-                    recon[m + ind_recon] *= update[m] / sum_dist[n];
+                    recon[n + ind_recon] *= update[n] / sum_dist[n];
                 }
-                m++;
             }
         }
     }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
-    free(simdata);
+    free_ray_cache(&rays);
+    free_tracer(&ray);
     free(sum_dist);
     free(update);
 }
@@ -45,6 +45,10 @@
 #include "assert.h"
 #include <limits.h>
 
+#ifndef M_PI
+#    define M_PI 3.14159265359
+#endif
+
 DLL void
 sample(int mode, const float* data, int dx, int dy, int dz, int level, int axis,
        float* out)
@@ -206,3 +210,108 @@ upsample(const float* data, int dx, int dy, int dz, int level, int axis,
         }
     }
 }
+
+// Pair each projection with the one acquired at the opposite angle (theta + pi
+// within tol). mate[p] is the index of the projection folded into p, -1 if p
+// has no opposite and -2 if p is itself folded into another projection.
+// Returns the number of projections left after folding.
+DLL int
+pair_opposite(const float* theta, int dt, float tol, int* mate)
+{
+    int p, q, nt = 0;
+
+    for(p = 0; p < dt; p++)
+        mate[p] = -1;
+
+    for(p = 0; p < dt; p++)
+    {
+        if(mate[p] != -1)
+            continue;
+        for(q = p + 1; q < dt; q++)
+        {
+            // Angular distance from theta[p] + pi, wrapped to [-pi, pi)
+            float diff =
+                fmodf(theta[q] - theta[p] - (float) M_PI, (float) (2 * M_PI));
+            if(diff >= M_PI)
+                diff -= 2 * M_PI;
+            else if(diff < -M_PI)
+                diff += 2 * M_PI;
+            if(mate[q] == -1 && fabsf(diff) < tol)
+            {
+                mate[p] = q;
+                mate[q] = -2;
+                break;
+            }
+        }
+    }
+
+    for(p = 0; p < dt; p++)
+        nt += (mate[p] != -2);
+    return nt;
+}
+
+// Fold the opposite projection pairs found by pair_opposite into single
+// projections on a detector of dxo pixels whose rotation axis is at
+// center + shift, in the convention of the projectors where pixel d is centered
+// at d + 0.5. The projection at theta + pi is mirrored about the axis and
+// blended with the one at theta, with weights ramping down towards the edge of
+// each detector over the half-width of their overlap. This averages the pair
+// for a centered axis and stitches the two halves for an offset axis.
+DLL void
+fold_360(const float* data, int dy, int dt, int dx, const float* center,
+         const int* mate, int shift, int dxo, float* out)
+{
+    int   s, p, k, q, nt = 0;
+    float ramp, wp, wq, fi, j, w;
+    int   i, j0;
+
+    for(p = 0; p < dt; p++)
+        nt += (mate[p] != -2);
+
+    for(s = 0; s < dy; s++)
+    {
+        // Half-width of the overlap between the projection and its mirror.
+        ramp = fminf(center[s] - 0.5f, dx - 0.5f - center[s]);
+        ramp = fmaxf(ramp, 1.0f);
+
+        for(p = 0, k = 0; p < dt; p++)
+        {
+            if(mate[p] == -2)
+                continue;
+
+            const float* prj = data + (s * dt + p) * dx;
+            const float* opp = (mate[p] >= 0) ? data + (s * dt + mate[p]) * dx
+                                              : NULL;
+            float*       dst = out + (s * nt + k) * dxo;
+
+            for(q = 0; q < dxo; q++)
+            {
+                float val = 0.0f;
+
+                // Pixel of the projection and fractional pixel of its mirror
+                i  = q - shift;
+                j  = 2 * center[s] - 1 + shift - q;
+                fi = fminf(i + 1, dx - i);
+                wp = (i >= 0 && i < dx) ? fminf(fi / ramp, 1.0f) : 0.0f;
+                wq = 0.0f;
+                if(opp != NULL && j > -1 && j < dx)
+                {
+                    wq = fmaxf(fminf(fminf(j + 1, dx - j) / ramp, 1.0f), 0.0f);
+                }
+
+                if(wp > 0.0f)
+                    val += wp * prj[i];
+                if(wq > 0.0f)
+                {
+                    // Linear interpolation, clamped at the detector edges
+                    j0 = (int) floorf(j);
+                    w  = j - j0;
+                    val += wq * ((1.0f - w) * opp[(j0 < 0) ? 0 : j0] +
+                                 w * opp[(j0 + 1 >= dx) ? dx - 1 : j0 + 1]);
+                }
+                dst[q] = (wp + wq > 0.0f) ? val / (wp + wq) : 0.0f;
+            }
+            k++;
+        }
+    }
+}
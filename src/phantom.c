@@ -0,0 +1,400 @@
+// Copyright (c) 2015, UChicago Argonne, LLC. All rights reserved.
+
+// Copyright 2015. UChicago Argonne, LLC. This software was produced
+// under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+// Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+// U.S. Department of Energy. The U.S. Government has rights to use,
+// reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+// UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+// ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+// modified to produce derivative works, such modified software should
+// be clearly marked, so as not to confuse it with the version available
+// from ANL.
+
+// Additionally, redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the following
+// conditions are met:
+
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+
+//     * Neither the name of UChicago Argonne, LLC, Argonne National
+//       Laboratory, ANL, the U.S. Government, nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+// Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
+// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+// POSSIBILITY OF SUCH DAMAGE.
+
+#include "utils.h"
+
+// Rows of a tile along each of the first two axes. A tile of rows of the
+// last axis stays in cache while all ellipsoids are added to it.
+#define PHANTOM_TILE 8
+
+// Ellipsoid parameters as packed by tomopy.misc.phantom: the value added
+// inside, the rotation of the grid coordinates (row major), the center in
+// the rotated frame and the semi-axes.
+#define ELLIPSOID_SIZE 16
+
+typedef struct
+{
+    const double* ell;
+    int           nell;
+    float*        obj;
+    int           n[3];
+    double        step[3];  // grid spacing of the coordinates in [-1, 1]
+    int           ss;       // subsamples per voxel along each axis
+} phantom_args;
+
+// The grid coordinates of axis j run from -1 to 1 in n[j] samples.
+static inline double
+coord(const phantom_args* a, int j, double i)
+{
+    return i * a->step[j] + (-1.0);
+}
+
+// Index range [beg, end) of axis j holding the bounding box of an
+// ellipsoid, padded by a voxel for the subsamples.
+static void
+phantom_span(const phantom_args* a, int j, double center, double half,
+             int* beg, int* end)
+{
+    if(a->n[j] == 1)
+    {
+        *beg = (fabs(-1.0 - center) <= half + 1.0) ? 0 : 1;
+        *end = 1;
+        return;
+    }
+    double lo = floor((center - half + 1.0) / a->step[j]) - 1.0;
+    double hi = ceil((center + half + 1.0) / a->step[j]) + 2.0;
+    *beg      = (lo > 0.0) ? (int) lo : 0;
+    *end      = (hi < a->n[j]) ? (int) hi : a->n[j];
+}
+
+// Range [zlo, zhi] of the last coordinate where the row at (x, y) crosses
+// the ellipsoid, if it does. q(z) = |(R (x, y, z) - m) / s|^2 is a
+// quadratic in z and the ellipsoid is q(z) <= 1.
+static int
+phantom_row(const double* e, double x, double y, double* zlo, double* zhi)
+{
+    const double* r  = e + 1;
+    const double* m  = e + 10;
+    const double* s  = e + 13;
+    double        qa = 0.0, qb = 0.0, qc = -1.0;
+    for(int i = 0; i < 3; i++)
+    {
+        double u = (r[3 * i] * x + r[3 * i + 1] * y - m[i]) / s[i];
+        double v = r[3 * i + 2] / s[i];
+        qa += v * v;
+        qb += 2.0 * u * v;
+        qc += u * u;
+    }
+    double disc = qb * qb - 4.0 * qa * qc;
+    if(disc < 0.0)
+        return 0;
+    *zlo = (-qb - sqrt(disc)) / (2.0 * qa);
+    *zhi = (-qb + sqrt(disc)) / (2.0 * qa);
+    return 1;
+}
+
+// Range [k0, k1) within [beg, end) of the voxels of the last axis whose
+// centers lie in [zlo, zhi] widened by pad voxels on each side, which is
+// negative for the voxels certainly inside.
+static void
+phantom_zspan(const phantom_args* a, double zlo, double zhi, double pad,
+              int beg, int end, int* k0, int* k1)
+{
+    if(a->n[2] == 1)
+    {
+        *k0 = beg;
+        *k1 = (pad > 0.0) ? end : beg;
+        return;
+    }
+    double lo = ceil((zlo + 1.0) / a->step[2] - pad);
+    double hi = floor((zhi + 1.0) / a->step[2] + pad) + 1.0;
+    *k0       = (lo > beg) ? (int) lo : beg;
+    *k1       = (hi < end) ? (int) hi : end;
+    if(*k1 < *k0)
+        *k1 = *k0;
+}
+
+// True when the point lies inside the ellipsoid
+static inline int
+inside_ellipsoid(const double* e, double x, double y, double z)
+{
+    const double* r = e + 1;
+    const double* m = e + 10;
+    const double* s = e + 13;
+    double        q = 0.0;
+    for(int i = 0; i < 3; i++)
+    {
+        double u = (r[3 * i] * x + r[3 * i + 1] * y + r[3 * i + 2] * z - m[i]) /
+                   s[i];
+        q += u * u;
+    }
+    return q <= 1.0;
+}
+
+// Add the ellipsoid to the rows [i0, i1) x [j0, j1) of a tile. Each voxel
+// gets the value times the fraction of its ss^3 subsamples inside, and
+// only the voxels near the surface are tested. The spans are padded so
+// that rounding of the roots never decides a voxel.
+static void
+phantom_tile(const phantom_args* a, const double* e, int i0, int i1, int j0,
+             int j1, int k0, int k1)
+{
+    const int    ss   = a->ss;
+    const float  val  = (float) e[0];
+    const double inv  = 1.0 / (ss * ss * ss);
+    const float  full = (ss == 1) ? val : (float) (val * ss * ss * ss * inv);
+    double       sx[ss], sy[ss];
+
+    for(int i = i0; i < i1; i++)
+    {
+        for(int t = 0; t < ss; t++)
+            sx[t] = coord(a, 0, i + (t + 0.5) / ss - 0.5);
+
+        for(int j = j0; j < j1; j++)
+        {
+            float* row = a->obj + ((size_t) i * a->n[1] + j) * a->n[2];
+            double olo = HUGE_VAL, ohi = -HUGE_VAL;
+            double ilo = -HUGE_VAL, ihi = HUGE_VAL;
+            int    all = 1;
+
+            // The union and the intersection of the spans of the subsample
+            // rows, the voxel centers for ss = 1.
+            for(int t = 0; t < ss; t++)
+                sy[t] = coord(a, 1, j + (t + 0.5) / ss - 0.5);
+            for(int t = 0; t < ss * ss; t++)
+            {
+                double lo, hi;
+                if(phantom_row(e, sx[t / ss], sy[t % ss], &lo, &hi))
+                {
+                    olo = (lo < olo) ? lo : olo;
+                    ohi = (hi > ohi) ? hi : ohi;
+                    ilo = (lo > ilo) ? lo : ilo;
+                    ihi = (hi < ihi) ? hi : ihi;
+                }
+                else
+                    all = 0;
+            }
+            if(olo > ohi)
+                continue;
+
+            int beg, end, in0, in1;
+            phantom_zspan(a, olo, ohi, 2.0, k0, k1, &beg, &end);
+            in0 = in1 = beg;
+            if(all)
+                phantom_zspan(a, ilo, ihi, -1.5, beg, end, &in0, &in1);
+
+            for(int k = beg; k < end; k++)
+            {
+                if(k >= in0 && k < in1)
+                {
+                    row[k] += full;
+                    continue;
+                }
+                int hits = 0;
+                for(int t = 0; t < ss; t++)
+                {
+                    double z = coord(a, 2, k + (t + 0.5) / ss - 0.5);
+                    for(int u = 0; u < ss * ss; u++)
+                        hits += inside_ellipsoid(e, sx[u / ss], sy[u % ss], z);
+                }
+                if(hits == ss * ss * ss)
+                    row[k] += full;
+                else if(hits > 0)
+                    row[k] += (float) (val * hits * inv);
+            }
+        }
+    }
+}
+
+static void
+phantom_thread(thread_team* team, int tid, void* arg)
+{
+    const phantom_args* a   = (const phantom_args*) arg;
+    const int           ti  = (a->n[0] + PHANTOM_TILE - 1) / PHANTOM_TILE;
+    const int           tj  = (a->n[1] + PHANTOM_TILE - 1) / PHANTOM_TILE;
+    int                 t0, t1;
+
+    team_range(team, tid, ti * tj, &t0, &t1);
+    for(int t = t0; t < t1; t++)
+    {
+        int i0 = (t / tj) * PHANTOM_TILE;
+        int j0 = (t % tj) * PHANTOM_TILE;
+        int i1 = (i0 + PHANTOM_TILE < a->n[0]) ? i0 + PHANTOM_TILE : a->n[0];
+        int j1 = (j0 + PHANTOM_TILE < a->n[1]) ? j0 + PHANTOM_TILE : a->n[1];
+
+        // The ellipsoids are added in order, as each voxel sums them.
+        for(int n = 0; n < a->nell; n++)
+        {
+            const double* e = a->ell + n * ELLIPSOID_SIZE;
+            const double* r = e + 1;
+            int           beg[3], end[3];
+
+            // The ellipsoid is R^T (m + S w) for |w| <= 1
+            for(int j = 0; j < 3; j++)
+            {
+                double c = 0.0, h = 0.0;
+                for(int i = 0; i < 3; i++)
+                {
+                    double w = r[3 * i + j] * e[13 + i];
+                    c += r[3 * i + j] * e[10 + i];
+                    h += w * w;
+                }
+                phantom_span(a, j, c, sqrt(h), &beg[j], &end[j]);
+            }
+            int ib = (beg[0] > i0) ? beg[0] : i0;
+            int ie = (end[0] < i1) ? end[0] : i1;
+            int jb = (beg[1] > j0) ? beg[1] : j0;
+            int je = (end[1] < j1) ? end[1] : j1;
+            if(ib < ie && jb < je && beg[2] < end[2])
+                phantom_tile(a, e, ib, ie, jb, je, beg[2], end[2]);
+        }
+    }
+}
+
+void
+phantom(const double* ell, int nell, float* obj, int n0, int n1, int n2,
+        int supersample, int num_thread)
+{
+    phantom_args args = { .ell  = ell,
+                          .nell = nell,
+                          .obj  = obj,
+                          .n    = { n0, n1, n2 },
+                          .ss   = (supersample > 1) ? supersample : 1 };
+    for(int j = 0; j < 3; j++)
+        args.step[j] = (args.n[j] > 1) ? 2.0 / (args.n[j] - 1) : 0.0;
+
+    run_team((num_thread > 1) ? num_thread : 1, phantom_thread, &args);
+}
+
+// Exact parallel-beam line integrals of the ellipsoids, in the geometry of
+// project(): the slices are normal to the first axis and the ray of
+// detector pixel d at angle theta is -x sin + y cos = d + 0.5 - center in
+// the pixel units of the last two axes.
+typedef struct
+{
+    const double* ell;
+    int           nell;
+    int           n[3];
+    float*        data;
+    int           dt;
+    int           dx;
+    const float*  center;
+    const float*  theta;
+} phantom_project_args;
+
+// Along the ray the ellipsoid coordinates are u = b + yi w + t v, and the
+// chord |t1 - t0| = 2 sqrt(disc) / |v|^2 where disc, the quarter
+// discriminant of |u|^2 = 1, is a quadratic in yi. Only the detector
+// pixels between its roots are visited.
+static void
+phantom_project_thread(thread_team* team, int tid, void* arg)
+{
+    const phantom_project_args* a   = (const phantom_project_args*) arg;
+    const double                s1  = 0.5 * (a->n[1] - 1);
+    const double                s2  = 0.5 * (a->n[2] - 1);
+    const double                st0 = (a->n[0] > 1) ? 2.0 / (a->n[0] - 1) : 0;
+    int                         p0, p1;
+
+    team_range(team, tid, a->dt, &p0, &p1);
+    for(int p = p0; p < p1; p++)
+    {
+        const double sin_p = sin(a->theta[p]);
+        const double cos_p = cos(a->theta[p]);
+
+        for(int s = 0; s < a->n[0]; s++)
+        {
+            const double x   = s * st0 + (-1.0);
+            float*       row = a->data + ((size_t) s * a->dt + p) * a->dx;
+
+            for(int n = 0; n < a->nell; n++)
+            {
+                const double* e = a->ell + n * ELLIPSOID_SIZE;
+                const double* r = e + 1;
+                double        b[3], v[3], w[3];
+                for(int i = 0; i < 3; i++)
+                {
+                    b[i] = (r[3 * i] * x - e[10 + i]) / e[13 + i];
+                    v[i] = (r[3 * i + 1] * cos_p / s1 +
+                            r[3 * i + 2] * sin_p / s2) /
+                           e[13 + i];
+                    w[i] = (r[3 * i + 2] * cos_p / s2 -
+                            r[3 * i + 1] * sin_p / s1) /
+                           e[13 + i];
+                }
+                double vv = 0.0, bv = 0.0, wv = 0.0, bb = -1.0, bw = 0.0,
+                       ww = 0.0;
+                for(int i = 0; i < 3; i++)
+                {
+                    vv += v[i] * v[i];
+                    bv += b[i] * v[i];
+                    wv += w[i] * v[i];
+                    bb += b[i] * b[i];
+                    bw += b[i] * w[i];
+                    ww += w[i] * w[i];
+                }
+
+                // disc(yi) = qa yi^2 + qb yi + qc, with qa < 0
+                double qa = wv * wv - vv * ww;
+                double qb = 2.0 * (bv * wv - vv * bw);
+                double qc = bv * bv - vv * bb;
+                double dd = qb * qb - 4.0 * qa * qc;
+                if(qa >= 0.0 || dd <= 0.0)
+                    continue;
+
+                double yoff = 0.5 - a->center[s];
+                double ylo  = (-qb + sqrt(dd)) / (2.0 * qa);
+                double yhi  = (-qb - sqrt(dd)) / (2.0 * qa);
+                double lo   = ceil(ylo - yoff);
+                double hi   = floor(yhi - yoff) + 1.0;
+                int    d0   = (lo > 0.0) ? (int) lo : 0;
+                int    d1   = (hi < a->dx) ? (int) hi : a->dx;
+
+                for(int d = d0; d < d1; d++)
+                {
+                    double yi   = d + yoff;
+                    double disc = (qa * yi + qb) * yi + qc;
+                    if(disc > 0.0)
+                        row[d] += (float) (e[0] * 2.0 * sqrt(disc) / vv);
+                }
+            }
+        }
+    }
+}
+
+void
+phantom_project(const double* ell, int nell, int n0, int n1, int n2,
+                float* data, int dt, int dx, const float* center,
+                const float* theta, int num_thread)
+{
+    phantom_project_args args = { .ell    = ell,
+                                  .nell   = nell,
+                                  .n      = { n0, n1, n2 },
+                                  .data   = data,
+                                  .dt     = dt,
+                                  .dx     = dx,
+                                  .center = center,
+                                  .theta  = theta };
+
+    run_team((num_thread > 1) ? num_thread : 1, phantom_project_thread,
+             &args);
+}
@@ -46,38 +46,29 @@
 void
 pml_quad(const float* data, int dy, int dt, int dx, const float* center,
          const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-         const float* reg_pars)
+         const float* reg_pars, const char* projector,
+         const unsigned char* mask, const float* geom,
+         const char* backprojector, int neighbors)
 {
-    float* gridx  = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi   = (int*) malloc((ngridx + ngridy) * sizeof(int));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL);
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy,
+                dx);
+    tracer_geom(&ray, geom);
+    init_backprojector(&ray, get_backprojector(backprojector), dt);
+    prior_engine prior;
+    init_prior(&prior, mask, dy, ngridx, ngridy, neighbors);
+    int*   indi = ray.indi;
+    float* dist = ray.dist;
 
     int    s, p, d, i, m, n, q;
-    int    quadrant;
-    float  theta_p, sin_p, cos_p;
-    float  mov, xi, yi;
-    int    asize, bsize, csize;
+    int    csize;
     float* simdata;
     float  upd;
     int    ind_data, ind_recon;
     float* sum_dist;
     float  sum_dist2;
     float *E, *F, *G;
-    int    ind0, ind1, indg[8];
-    float  totalwg, wg[8], mg[8];
+    int    ind0;
 
     for(i = 0; i < num_iter; i++)
     {
@@ -86,8 +77,7 @@ pml_quad(const float* data, int dy, int dt, int dx, const float* center,
         // For each slice
         for(s = 0; s < dy; s++)
         {
-            preprocessing(ngridx, ngridy, dx, center[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
+            tracer_slice(&ray, center[s]);
 
             sum_dist = (float*) calloc((ngridx * ngridy), sizeof(float));
             E        = (float*) calloc((ngridx * ngridy), sizeof(float));
@@ -100,35 +90,15 @@ pml_quad(const float* data, int dy, int dt, int dx, const float* center,
                 // Calculate the sin and cos values
                 // of the projection angle and find
                 // at which quadrant on the cartesian grid.
-                theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
+                tracer_angle(&ray, theta[p]);
 
                 // For each detector pixel
                 for(d = 0; d < dx; d++)
                 {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = 0.5f * (1 - dx) + d + mov;
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist);
+                    // Find the indices (indi) of the pixels on the
+                    // reconstruction grid crossed by the ray and their
+                    // weights (dist) for the selected projection model.
+                    csize = trace_ray(&ray, d);
 
                     // Calculate simdata
                     calc_simdata(s, p, d, ngridx, ngridy, dt, dx, csize, indi,
@@ -140,214 +110,27 @@ pml_quad(const float* data, int dy, int dt, int dx, const float* center,
                     for(n = 0; n < csize - 1; n++)
                     {
                         sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indi[n]] += dist[n];
                     }
 
                     // Update
+                    upd = 0.0f;
                     if(sum_dist2 != 0.0f)
                     {
-                        ind_data  = d + p * dx + s * dt * dx;
-                        ind_recon = s * ngridx * ngridy;
-                        upd       = data[ind_data] / simdata[ind_data];
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            E[indi[n]] -=
-                                recon[indi[n] + ind_recon] * upd * dist[n];
-                        }
-                    }
-                }
-            }
-
-            // Weights for inner neighborhoods.
-            totalwg = 4 + 4 / sqrt(2);
-            wg[0]   = 1 / totalwg;
-            wg[1]   = 1 / totalwg;
-            wg[2]   = 1 / totalwg;
-            wg[3]   = 1 / totalwg;
-            wg[4]   = 1 / sqrt(2) / totalwg;
-            wg[5]   = 1 / sqrt(2) / totalwg;
-            wg[6]   = 1 / sqrt(2) / totalwg;
-            wg[7]   = 1 / sqrt(2) / totalwg;
-
-            // (inner region)
-            for(n = 1; n < ngridx - 1; n++)
-            {
-                for(m = 1; m < ngridy - 1; m++)
-                {
-                    ind0 = m + n * ngridy;
-                    ind1 = ind0 + s * ngridx * ngridy;
-
-                    indg[0] = ind1 + 1;
-                    indg[1] = ind1 - 1;
-                    indg[2] = ind1 + ngridy;
-                    indg[3] = ind1 - ngridy;
-                    indg[4] = ind1 + ngridy + 1;
-                    indg[5] = ind1 + ngridy - 1;
-                    indg[6] = ind1 - ngridy + 1;
-                    indg[7] = ind1 - ngridy - 1;
-
-                    for(q = 0; q < 8; q++)
-                    {
-                        mg[q] = recon[ind1] + recon[indg[q]];
-                        F[ind0] += 2 * reg_pars[0] * wg[q];
-                        G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
+                        ind_data = d + p * dx + s * dt * dx;
+                        upd      = data[ind_data] / simdata[ind_data];
                     }
+                    backproject_ray(&ray, p, d, csize, upd, E, sum_dist);
                 }
             }
+            backproject_slice(&ray, theta, E, sum_dist);
 
-            // Weights for edges.
-            totalwg = 3 + 2 / sqrt(2);
-            wg[0]   = 1 / totalwg;
-            wg[1]   = 1 / totalwg;
-            wg[2]   = 1 / totalwg;
-            wg[3]   = 1 / sqrt(2) / totalwg;
-            wg[4]   = 1 / sqrt(2) / totalwg;
-
-            // (top)
-            for(m = 1; m < ngridy - 1; m++)
-            {
-                ind0 = m;
-                ind1 = ind0 + s * ngridx * ngridy;
-
-                indg[0] = ind1 + 1;
-                indg[1] = ind1 - 1;
-                indg[2] = ind1 + ngridy;
-                indg[3] = ind1 + ngridy + 1;
-                indg[4] = ind1 + ngridy - 1;
-
-                for(q = 0; q < 5; q++)
-                {
-                    mg[q] = recon[ind1] + recon[indg[q]];
-                    F[ind0] += 2 * reg_pars[0] * wg[q];
-                    G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
-                }
-            }
-
-            // (bottom)
-            for(m = 1; m < ngridy - 1; m++)
-            {
-                ind0 = m + (ngridx - 1) * ngridy;
-                ind1 = ind0 + s * ngridx * ngridy;
-
-                indg[0] = ind1 + 1;
-                indg[1] = ind1 - 1;
-                indg[2] = ind1 - ngridy;
-                indg[3] = ind1 - ngridy + 1;
-                indg[4] = ind1 - ngridy - 1;
-
-                for(q = 0; q < 5; q++)
-                {
-                    mg[q] = recon[ind1] + recon[indg[q]];
-                    F[ind0] += 2 * reg_pars[0] * wg[q];
-                    G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
-                }
-            }
-
-            // (left)
-            for(n = 1; n < ngridx - 1; n++)
-            {
-                ind0 = n * ngridy;
-                ind1 = ind0 + s * ngridx * ngridy;
-
-                indg[0] = ind1 + 1;
-                indg[1] = ind1 + ngridy;
-                indg[2] = ind1 - ngridy;
-                indg[3] = ind1 + ngridy + 1;
-                indg[4] = ind1 - ngridy + 1;
-
-                for(q = 0; q < 5; q++)
-                {
-                    mg[q] = recon[ind1] + recon[indg[q]];
-                    F[ind0] += 2 * reg_pars[0] * wg[q];
-                    G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
-                }
-            }
-
-            // (right)
-            for(n = 1; n < ngridx - 1; n++)
-            {
-                ind0 = (ngridy - 1) + n * ngridy;
-                ind1 = ind0 + s * ngridx * ngridy;
-
-                indg[0] = ind1 - 1;
-                indg[1] = ind1 + ngridy;
-                indg[2] = ind1 - ngridy;
-                indg[3] = ind1 + ngridy - 1;
-                indg[4] = ind1 - ngridy - 1;
-
-                for(q = 0; q < 5; q++)
-                {
-                    mg[q] = recon[ind1] + recon[indg[q]];
-                    F[ind0] += 2 * reg_pars[0] * wg[q];
-                    G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
-                }
-            }
-
-            // Weights for corners.
-            totalwg = 2 + 1 / sqrt(2);
-            wg[0]   = 1 / totalwg;
-            wg[1]   = 1 / totalwg;
-            wg[2]   = 1 / sqrt(2) / totalwg;
-
-            // (top-left)
-            ind0 = 0;
-            ind1 = ind0 + s * ngridx * ngridy;
-
-            indg[0] = ind1 + 1;
-            indg[1] = ind1 + ngridy;
-            indg[2] = ind1 + ngridy + 1;
-
-            for(q = 0; q < 3; q++)
-            {
-                mg[q] = recon[ind1] + recon[indg[q]];
-                F[ind0] += 2 * reg_pars[0] * wg[q];
-                G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
-            }
-
-            // (top-right)
-            ind0 = (ngridy - 1);
-            ind1 = ind0 + s * ngridx * ngridy;
-
-            indg[0] = ind1 - 1;
-            indg[1] = ind1 + ngridy;
-            indg[2] = ind1 + ngridy - 1;
-
-            for(q = 0; q < 3; q++)
-            {
-                mg[q] = recon[ind1] + recon[indg[q]];
-                F[ind0] += 2 * reg_pars[0] * wg[q];
-                G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
-            }
-
-            // (bottom-left)
-            ind0 = (ngridx - 1) * ngridy;
-            ind1 = ind0 + s * ngridx * ngridy;
-
-            indg[0] = ind1 + 1;
-            indg[1] = ind1 - ngridy;
-            indg[2] = ind1 - ngridy + 1;
-
-            for(q = 0; q < 3; q++)
+            ind_recon = s * ngridx * ngridy;
+            for(n = 0; n < ngridx * ngridy; n++)
             {
-                mg[q] = recon[ind1] + recon[indg[q]];
-                F[ind0] += 2 * reg_pars[0] * wg[q];
-                G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
+                E[n] *= -recon[n + ind_recon];
             }
 
-            // (bottom-right)
-            ind0 = (ngridy - 1) + (ngridx - 1) * ngridy;
-            ind1 = ind0 + s * ngridx * ngridy;
-
-            indg[0] = ind1 - 1;
-            indg[1] = ind1 - ngridy;
-            indg[2] = ind1 - ngridy - 1;
-
-            for(q = 0; q < 3; q++)
-            {
-                mg[q] = recon[ind1] + recon[indg[q]];
-                F[ind0] += 2 * reg_pars[0] * wg[q];
-                G[ind0] -= 2 * reg_pars[0] * wg[q] * mg[q];
-            }
+            prior_slice(&prior, recon, s, PRIOR_QUAD, reg_pars, F, G);
 
             q = 0;
             for(n = 0; n < ngridx * ngridy; n++)
@@ -380,16 +163,6 @@ pml_quad(const float* data, int dy, int dt, int dx, const float* center,
         free(simdata);
     }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+    free_prior(&prior);
+    free_tracer(&ray);
 }
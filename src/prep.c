@@ -42,6 +42,7 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "prep.h"
+#include "utils.h"
 
 DLL void
 normalize_bg(float* data, int dx, int dy, int dz, int nair)
@@ -85,3 +86,626 @@ normalize_bg(float* data, int dx, int dy, int dz, int nair)
         }
     }
 }
+
+typedef struct
+{
+    const void*  data;
+    int          u16;
+    int          dt, dy, dx;
+    const float* dark;
+    const float* denom;
+    int          use_cutoff;
+    float        cutoff;
+    int          minus_log;
+    int          use_nonfinite;
+    float        nonfinite;
+    int          sino;
+    float*       out;
+} normalize_args;
+
+// (x - dark) / denom, then the cutoff, -log and cleanup of one row. Every
+// step is a branch-free select so the loop vectorizes.
+static void
+normalize_row(const normalize_args* a, const float* x, const float* dark,
+              const float* denom, float* out)
+{
+    int   k, n = a->dx;
+    float v;
+
+    for(k = 0; k < n; k++)
+        out[k] = (x[k] - dark[k]) / denom[k];
+    if(a->use_cutoff)
+    {
+        for(k = 0; k < n; k++)
+        {
+            v      = out[k];
+            out[k] = (v > a->cutoff) ? a->cutoff : v;
+        }
+    }
+    if(a->minus_log)
+    {
+        for(k = 0; k < n; k++)
+            out[k] = -logf(out[k]);
+    }
+    if(a->use_nonfinite)
+    {
+        for(k = 0; k < n; k++)
+        {
+            v      = out[k];
+            out[k] = isfinite(v) ? v : a->nonfinite;
+        }
+    }
+}
+
+static void
+normalize_thread(thread_team* team, int tid, void* arg)
+{
+    const normalize_args* a   = (const normalize_args*) arg;
+    int                   dt  = a->dt;
+    int                   dy  = a->dy;
+    int                   dx  = a->dx;
+    float*                buf = NULL;
+    const float*          x;
+    int                   r, r0, r1, t, y;
+    size_t                src;
+
+    if(a->u16)
+    {
+        buf = (float*) malloc(sizeof(float) * dx);
+        assert(buf != NULL);
+    }
+
+    // Rows are taken in output order, so each thread writes one contiguous
+    // block; the input rows are contiguous in either order.
+    team_range(team, tid, dt * dy, &r0, &r1);
+    for(r = r0; r < r1; r++)
+    {
+        t   = (a->sino) ? r % dt : r / dy;
+        y   = (a->sino) ? r / dt : r % dy;
+        src = ((size_t) t * dy + y) * dx;
+        if(a->u16)
+        {
+            const unsigned short* in = (const unsigned short*) a->data + src;
+            int                   k;
+            for(k = 0; k < dx; k++)
+                buf[k] = (float) in[k];
+            x = buf;
+        }
+        else
+        {
+            x = (const float*) a->data + src;
+        }
+        normalize_row(a, x, a->dark + (size_t) y * dx,
+                      a->denom + (size_t) y * dx, a->out + (size_t) r * dx);
+    }
+    free(buf);
+}
+
+DLL void
+normalize_log(const void* data, int u16, int dt, int dy, int dx,
+              const float* flat, const float* dark, int use_cutoff,
+              float cutoff, int minus_log, int use_nonfinite, float nonfinite,
+              int sino, float* out, int num_thread)
+{
+    const float eps = 1e-6f;
+    size_t      i, n = (size_t) dy * dx;
+    float*      denom;
+    float       d;
+
+    denom = (float*) malloc(sizeof(float) * n);
+    assert(denom != NULL);
+    for(i = 0; i < n; i++)
+    {
+        d        = flat[i] - dark[i];
+        denom[i] = (d < eps) ? eps : d;
+    }
+
+    normalize_args args = { .data          = data,
+                            .u16           = u16,
+                            .dt            = dt,
+                            .dy            = dy,
+                            .dx            = dx,
+                            .dark          = dark,
+                            .denom         = denom,
+                            .use_cutoff    = use_cutoff,
+                            .cutoff        = cutoff,
+                            .minus_log     = minus_log,
+                            .use_nonfinite = use_nonfinite,
+                            .nonfinite     = nonfinite,
+                            .sino          = sino,
+                            .out           = out };
+    run_team((num_thread > 1) ? num_thread : 1, normalize_thread, &args);
+    free(denom);
+}
+
+#define DFF_BLOCK 1024  // pixels per block of the flat covariance
+#define DFF_SMOOTH 2    // radius of the transmission smoothing, coarse pixels
+#define DFF_EPS 1e-6f
+
+typedef struct
+{
+    const float*  flats;
+    int           nf;
+    size_t        npix;
+    const float*  mean;
+    double*       gram;
+    const double* vec;
+    int           ncomp;
+    float*        eig;
+} dff_basis_args;
+
+typedef struct
+{
+    const float* data;
+    int          dt, dy, dx;
+    const float* dark;
+    const float* base;
+    const float* eig;
+    int          ncomp;
+    int          ds, hy, hx;
+    const float* cbase;
+    const float* ceig;
+    int          niter;
+    int          use_cutoff;
+    float        cutoff;
+    float*       out;
+} dff_args;
+
+// Partial Gram matrix of the centered flats over the pixel blocks of one
+// thread, in double precision; the lower triangle is filled.
+static void
+dff_gram_thread(thread_team* team, int tid, void* arg)
+{
+    const dff_basis_args* a  = (const dff_basis_args*) arg;
+    int                   nf = a->nf;
+    double*               g  = a->gram + (size_t) tid * nf * nf;
+    int                   nb = (int) ((a->npix + DFF_BLOCK - 1) / DFF_BLOCK);
+    int                   b, b0, b1, i, j, k, n;
+    size_t                p0;
+    float*                buf;
+    double                sum;
+
+    buf = (float*) malloc(sizeof(float) * nf * DFF_BLOCK);
+    assert(buf != NULL);
+
+    team_range(team, tid, nb, &b0, &b1);
+    for(b = b0; b < b1; b++)
+    {
+        p0 = (size_t) b * DFF_BLOCK;
+        n  = (int) ((a->npix - p0 < DFF_BLOCK) ? a->npix - p0 : DFF_BLOCK);
+        for(j = 0; j < nf; j++)
+        {
+            const float* f = a->flats + j * a->npix + p0;
+            for(k = 0; k < n; k++)
+                buf[j * DFF_BLOCK + k] = f[k] - a->mean[p0 + k];
+        }
+        for(i = 0; i < nf; i++)
+        {
+            for(j = 0; j <= i; j++)
+            {
+                const float* bi = buf + i * DFF_BLOCK;
+                const float* bj = buf + j * DFF_BLOCK;
+                for(k = 0, sum = 0.0; k < n; k++)
+                    sum += (double) (bi[k] * bj[k]);
+                g[i * nf + j] += sum;
+            }
+        }
+    }
+    free(buf);
+}
+
+// Eigenflat k is sum_j vec[j][k] (flat_j - mean), so flat_j - mean is
+// sum_k vec[j][k] eigenflat_k.
+static void
+dff_eig_thread(thread_team* team, int tid, void* arg)
+{
+    const dff_basis_args* a    = (const dff_basis_args*) arg;
+    size_t                npix = a->npix;
+    int                   p0, p1, p, j, k;
+    float                 c;
+
+    team_range(team, tid, (int) npix, &p0, &p1);
+    for(k = 0; k < a->ncomp; k++)
+    {
+        float* e = a->eig + k * npix;
+        for(p = p0; p < p1; p++)
+            e[p] = 0.0f;
+        for(j = 0; j < a->nf; j++)
+        {
+            const float* f = a->flats + j * npix;
+            c              = (float) a->vec[j * a->ncomp + k];
+            for(p = p0; p < p1; p++)
+                e[p] += c * (f[p] - a->mean[p]);
+        }
+    }
+}
+
+// Cyclic Jacobi eigendecomposition of the symmetric n x n matrix a. The
+// eigenvalues end on the diagonal of a, the eigenvectors in the columns
+// of v.
+static void
+jacobi_eigen(double* a, double* v, int n)
+{
+    int    i, j, k, sweep;
+    double norm = 0.0, off, theta, t, c, s, x, y;
+
+    for(i = 0; i < n * n; i++)
+    {
+        norm += a[i] * a[i];
+        v[i] = (i % (n + 1) == 0) ? 1.0 : 0.0;
+    }
+    for(sweep = 0; sweep < 64; sweep++)
+    {
+        for(i = 0, off = 0.0; i < n; i++)
+            for(j = i + 1; j < n; j++)
+                off += a[i * n + j] * a[i * n + j];
+        if(off <= 1e-24 * norm)
+            break;
+        for(i = 0; i < n; i++)
+        {
+            for(j = i + 1; j < n; j++)
+            {
+                if(a[i * n + j] == 0.0)
+                    continue;
+                theta = (a[j * n + j] - a[i * n + i]) / (2.0 * a[i * n + j]);
+                t     = ((theta >= 0.0) ? 1.0 : -1.0) /
+                    (fabs(theta) + sqrt(theta * theta + 1.0));
+                c = 1.0 / sqrt(t * t + 1.0);
+                s = t * c;
+                for(k = 0; k < n; k++)
+                {
+                    x            = a[k * n + i];
+                    y            = a[k * n + j];
+                    a[k * n + i] = c * x - s * y;
+                    a[k * n + j] = s * x + c * y;
+                }
+                for(k = 0; k < n; k++)
+                {
+                    x            = a[i * n + k];
+                    y            = a[j * n + k];
+                    a[i * n + k] = c * x - s * y;
+                    a[j * n + k] = s * x + c * y;
+                }
+                for(k = 0; k < n; k++)
+                {
+                    x            = v[k * n + i];
+                    y            = v[k * n + j];
+                    v[k * n + i] = c * x - s * y;
+                    v[k * n + j] = s * x + c * y;
+                }
+            }
+        }
+    }
+}
+
+// Solves m x = b for the symmetric positive definite n x n m by Cholesky
+// factorization; m is overwritten and x returned in b.
+static void
+cholesky_solve(double* m, double* b, int n)
+{
+    int    i, j, k;
+    double d;
+
+    for(j = 0; j < n; j++)
+    {
+        for(k = 0, d = m[j * n + j]; k < j; k++)
+            d -= m[j * n + k] * m[j * n + k];
+        m[j * n + j] = sqrt((d > 0.0) ? d : 1e-300);
+        for(i = j + 1; i < n; i++)
+        {
+            for(k = 0, d = m[i * n + j]; k < j; k++)
+                d -= m[i * n + k] * m[j * n + k];
+            m[i * n + j] = d / m[j * n + j];
+        }
+    }
+    for(i = 0; i < n; i++)
+    {
+        for(k = 0, d = b[i]; k < i; k++)
+            d -= m[i * n + k] * b[k];
+        b[i] = d / m[i * n + i];
+    }
+    for(i = n - 1; i >= 0; i--)
+    {
+        for(k = i + 1, d = b[i]; k < n; k++)
+            d -= m[k * n + i] * b[k];
+        b[i] = d / m[i * n + i];
+    }
+}
+
+// Mean of the ds x ds blocks of img - sub (sub may be NULL) on the
+// hy x hx coarse grid.
+static void
+dff_coarse(const float* img, const float* sub, int dx, int ds, int hy,
+           int hx, float* c)
+{
+    int   cy, cx, y, x;
+    float sum, w = 1.0f / (float) (ds * ds);
+
+    for(cy = 0; cy < hy; cy++)
+    {
+        for(cx = 0; cx < hx; cx++)
+        {
+            for(y = cy * ds, sum = 0.0f; y < (cy + 1) * ds; y++)
+            {
+                for(x = cx * ds; x < (cx + 1) * ds; x++)
+                    sum += img[y * dx + x] - ((sub) ? sub[y * dx + x] : 0.0f);
+            }
+            c[cy * hx + cx] = sum * w;
+        }
+    }
+}
+
+// Separable box filter of radius r over an h x w image, averaging over the
+// part of the box inside the image.
+static void
+box_smooth(const float* in, float* tmp, float* out, int h, int w, int r)
+{
+    int   y, x, k, lo, hi;
+    float sum;
+
+    for(y = 0; y < h; y++)
+    {
+        for(x = 0; x < w; x++)
+        {
+            lo = (x - r < 0) ? 0 : x - r;
+            hi = (x + r >= w) ? w - 1 : x + r;
+            for(k = lo, sum = 0.0f; k <= hi; k++)
+                sum += in[y * w + k];
+            tmp[y * w + x] = sum / (float) (hi - lo + 1);
+        }
+    }
+    for(y = 0; y < h; y++)
+    {
+        lo = (y - r < 0) ? 0 : y - r;
+        hi = (y + r >= h) ? h - 1 : y + r;
+        for(x = 0; x < w; x++)
+        {
+            for(k = lo, sum = 0.0f; k <= hi; k++)
+                sum += tmp[k * w + x];
+            out[y * w + x] = sum / (float) (hi - lo + 1);
+        }
+    }
+}
+
+// Weights of the eigenflats for one projection. The transmission through
+// the current flat is smoothed, the object being assumed smoother than the
+// flat-field structure, and the weights refit to the projection under it.
+static void
+dff_fit(const dff_args* a, const float* proj, float* buf, double* work,
+        double* w)
+{
+    int     nk  = a->ncomp;
+    int     hn  = a->hy * a->hx;
+    float*  p   = buf;
+    float*  t   = p + hn;
+    float*  ts  = t + hn;
+    float*  tmp = ts + hn;
+    double* m   = work;
+    double* b   = m + nk * nk;
+    double* c   = b + nk;
+    double  r, trace;
+    float   f;
+    int     it, i, k, l;
+
+    dff_coarse(proj, a->dark, a->dx, a->ds, a->hy, a->hx, p);
+    for(k = 0; k < nk; k++)
+        w[k] = 0.0;
+    for(it = 0; it < a->niter; it++)
+    {
+        for(i = 0; i < hn; i++)
+        {
+            for(k = 0, f = a->cbase[i]; k < nk; k++)
+                f += (float) w[k] * a->ceig[k * hn + i];
+            t[i] = p[i] / ((f > DFF_EPS) ? f : DFF_EPS);
+        }
+        box_smooth(t, tmp, ts, a->hy, a->hx, DFF_SMOOTH);
+
+        for(k = 0; k < nk * nk; k++)
+            m[k] = 0.0;
+        for(k = 0; k < nk; k++)
+            b[k] = 0.0;
+        for(i = 0; i < hn; i++)
+        {
+            r = p[i] - (double) ts[i] * a->cbase[i];
+            for(k = 0; k < nk; k++)
+            {
+                c[k] = (double) ts[i] * a->ceig[k * hn + i];
+                b[k] += c[k] * r;
+                for(l = 0; l <= k; l++)
+                    m[k * nk + l] += c[k] * c[l];
+            }
+        }
+        for(k = 0, trace = 0.0; k < nk; k++)
+            trace += m[k * nk + k];
+        if(trace <= 0.0)
+            break;
+        for(k = 0; k < nk; k++)
+        {
+            m[k * nk + k] += 1e-9 * trace;
+            for(l = 0; l < k; l++)
+                m[l * nk + k] = m[k * nk + l];
+        }
+        cholesky_solve(m, b, nk);
+        for(k = 0; k < nk; k++)
+            w[k] = b[k];
+    }
+}
+
+static void
+dff_thread(thread_team* team, int tid, void* arg)
+{
+    const dff_args* a    = (const dff_args*) arg;
+    int             dx   = a->dx;
+    size_t          npix = (size_t) a->dy * dx;
+    int             nk   = a->ncomp;
+    int             t, t0, t1, y, x, k;
+    float*          buf;
+    float*          flat;
+    double*         work;
+    double*         w;
+    float           f, v;
+
+    buf  = (float*) malloc(sizeof(float) * (4 * a->hy * a->hx + dx));
+    work = (double*) malloc(sizeof(double) * (nk * nk + 3 * nk + 1));
+    assert(buf != NULL && work != NULL);
+    flat = buf + 4 * a->hy * a->hx;
+    w    = work + nk * nk + 2 * nk;
+
+    team_range(team, tid, a->dt, &t0, &t1);
+    for(t = t0; t < t1; t++)
+    {
+        const float* proj = a->data + t * npix;
+        float*       out  = a->out + t * npix;
+
+        dff_fit(a, proj, buf, work, w);
+        for(y = 0; y < a->dy; y++)
+        {
+            const float* base = a->base + (size_t) y * dx;
+            const float* dark = a->dark + (size_t) y * dx;
+            for(x = 0; x < dx; x++)
+                flat[x] = base[x];
+            for(k = 0; k < nk; k++)
+            {
+                const float* e = a->eig + k * npix + (size_t) y * dx;
+                float        c = (float) w[k];
+                for(x = 0; x < dx; x++)
+                    flat[x] += c * e[x];
+            }
+            for(x = 0; x < dx; x++)
+            {
+                f = (flat[x] < DFF_EPS) ? DFF_EPS : flat[x];
+                v = (proj[y * dx + x] - dark[x]) / f;
+                if(a->use_cutoff && v > a->cutoff)
+                    v = a->cutoff;
+                out[y * dx + x] = v;
+            }
+        }
+    }
+    free(buf);
+    free(work);
+}
+
+DLL void
+normalize_dynamic(const float* data, int dt, int dy, int dx,
+                  const float* flats, int nf, const float* dark, int ncomp,
+                  int ds, int niter, int use_cutoff, float cutoff, float* out,
+                  int num_thread)
+{
+    size_t  p, npix = (size_t) dy * dx;
+    int     nt      = (num_thread > 1) ? num_thread : 1;
+    int     i, j, k, nmax, hy, hx;
+    float*  mean;
+    float*  base;
+    float*  eig;
+    float*  cbase;
+    float*  ceig;
+    double* gram;
+    double* vec;
+    double* sel;
+    double  lam, avg;
+
+    mean = (float*) calloc(npix, sizeof(float));
+    base = (float*) malloc(sizeof(float) * npix);
+    gram = (double*) calloc((size_t) nt * nf * nf, sizeof(double));
+    vec  = (double*) malloc(sizeof(double) * nf * nf);
+    sel  = (double*) malloc(sizeof(double) * nf * nf);
+    assert(mean != NULL && base != NULL && gram != NULL && vec != NULL &&
+           sel != NULL);
+
+    for(j = 0; j < nf; j++)
+        for(p = 0; p < npix; p++)
+            mean[p] += flats[j * npix + p];
+    for(p = 0; p < npix; p++)
+    {
+        mean[p] /= (float) nf;
+        base[p] = mean[p] - dark[p];
+    }
+
+    // Principal components of the flats from the nf x nf Gram matrix
+    dff_basis_args basis = { .flats = flats,
+                             .nf    = nf,
+                             .npix  = npix,
+                             .mean  = mean,
+                             .gram  = gram,
+                             .vec   = sel,
+                             .ncomp = 0,
+                             .eig   = NULL };
+    run_team(nt, dff_gram_thread, &basis);
+    for(k = 1; k < nt; k++)
+        for(i = 0; i < nf * nf; i++)
+            gram[i] += gram[k * nf * nf + i];
+    for(i = 0; i < nf; i++)
+        for(j = 0; j < i; j++)
+            gram[j * nf + i] = gram[i * nf + j];
+    jacobi_eigen(gram, vec, nf);
+
+    // Take the components by decreasing variance, at most nf - 1 as the
+    // flats were centered, and by default those above the average.
+    for(i = 0, avg = 0.0; i < nf; i++)
+        avg += gram[i * nf + i] / nf;
+    nmax = (ncomp <= 0 || ncomp > nf - 1) ? nf - 1 : ncomp;
+    for(k = 0; k < nmax; k++)
+    {
+        for(i = 1, j = 0; i < nf; i++)
+            if(gram[i * nf + i] > gram[j * nf + j])
+                j = i;
+        lam = gram[j * nf + j];
+        if(lam <= 0.0 || (ncomp <= 0 && lam <= avg))
+            break;
+        gram[j * nf + j] = -1.0;
+        for(i = 0; i < nf; i++)
+            sel[i * nf + k] = vec[i * nf + j];
+    }
+    ncomp = k;
+    for(i = 0; i < nf; i++)
+        for(k = 0; k < ncomp; k++)
+            vec[i * ncomp + k] = sel[i * nf + k];
+
+    eig = (float*) malloc(sizeof(float) * (ncomp * npix + 1));
+    assert(eig != NULL);
+    basis.vec   = vec;
+    basis.ncomp = ncomp;
+    basis.eig   = eig;
+    run_team(nt, dff_eig_thread, &basis);
+
+    // Coarse grid of the weight fits
+    ds = (ds < 1) ? 1 : ds;
+    ds = (ds > dy) ? dy : ds;
+    ds = (ds > dx) ? dx : ds;
+    hy = dy / ds;
+    hx = dx / ds;
+    cbase = (float*) malloc(sizeof(float) * hy * hx);
+    ceig  = (float*) malloc(sizeof(float) * (ncomp * hy * hx + 1));
+    assert(cbase != NULL && ceig != NULL);
+    dff_coarse(base, NULL, dx, ds, hy, hx, cbase);
+    for(k = 0; k < ncomp; k++)
+        dff_coarse(eig + k * npix, NULL, dx, ds, hy, hx, ceig + k * hy * hx);
+
+    dff_args args = { .data       = data,
+                      .dt         = dt,
+                      .dy         = dy,
+                      .dx         = dx,
+                      .dark       = dark,
+                      .base       = base,
+                      .eig        = eig,
+                      .ncomp      = ncomp,
+                      .ds         = ds,
+                      .hy         = hy,
+                      .hx         = hx,
+                      .cbase      = cbase,
+                      .ceig       = ceig,
+                      .niter      = niter,
+                      .use_cutoff = use_cutoff,
+                      .cutoff     = cutoff,
+                      .out        = out };
+    run_team(nt, dff_thread, &args);
+
+    free(mean);
+    free(base);
+    free(gram);
+    free(vec);
+    free(sel);
+    free(eig);
+    free(cbase);
+    free(ceig);
+}
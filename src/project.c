@@ -42,300 +42,408 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "utils.h"
+#include <stdint.h>
 
-void
-project(const float* obj, int oy, int ox, int oz, float* data, int dy, int dt,
-        int dx, const float* center, const float* theta)
+// Number of slices projected together along each traced ray
+#define PROJECT_BLOCK 16
+
+// Projection of a scalar object, or of the two components of a vector
+// field across the slices normal to an axis, with the rays of all slices
+// traced once per block of slices with the same rotation center.
+typedef struct
+{
+    const float* obj[2];  // object, or the components of the field
+    int          ncomp;   // 1 for a scalar object, 2 for a vector field
+    int          axis;    // axis normal to the slices of a vector field
+    int          dy;      // slices projected, the first dy of the object
+    int          ox;
+    int          oz;
+    float*       data;
+    int          dt;
+    int          dx;
+    const float* center;
+    const float* theta;
+    int          model;
+    float        geom[4];  // source and detector distances of a fan beam
+    float*       block;  // block of slices, ox * oz x ncomp x PROJECT_BLOCK
+    // Detector model applied to the projections as they are written
+    int          detector;  // 0 to add the line integrals to data
+    const float* ku;        // blur kernel along the detector rows
+    int          nu;
+    const float* kv;        // blur kernel across the slices
+    int          nv;
+    float        flux;      // photons per pixel of the open beam, 0 for none
+    float        noise;     // standard deviation of the read noise
+    unsigned     seed;
+    int          emission;  // 1 for line integrals, 0 for transmission
+} project_args;
+
+//============================================================================//
+
+// Counter-based random numbers: the stream of each detector pixel is
+// seeded by its index, so the noise does not depend on the threads.
+typedef struct
+{
+    uint64_t state;
+} project_rng;
+
+static inline uint64_t
+splitmix64(uint64_t x)
+{
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline double
+rng_uniform(project_rng* rng)
+{
+    rng->state += 0x9e3779b97f4a7c15ULL;
+    return (splitmix64(rng->state) >> 11) * 0x1.0p-53;
+}
+
+// Box-Muller in single precision, which is plenty for detector noise
+static inline float
+rng_normal(project_rng* rng)
+{
+    float u = (float) (1.0 - rng_uniform(rng));
+    float v = (float) rng_uniform(rng);
+    return sqrtf(-2.0f * logf(u)) * cosf(2.0f * (float) M_PI * v);
+}
+
+// Poisson deviate by inversion for small means and by the transformed
+// rejection of Hormann (PTRS) otherwise.
+static double
+rng_poisson(project_rng* rng, double lam)
 {
-    float* gridx  = (float*) malloc((ox + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((oz + 1) * sizeof(float));
-    float* coordx = (float*) malloc((oz + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ox + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* ay     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* bx     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* by     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* coorx  = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* coory  = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* dist   = (float*) malloc((ox + oz + 1) * sizeof(float));
-    int*   indi   = (int*) malloc((ox + oz + 1) * sizeof(int));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL);
-
-    int   s, p, d;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
-
-    preprocessing(ox, oz, dx, center[0], &mov, gridx,
-                  gridy);  // Outputs: mov, gridx, gridy
-
-    // For each projection angle
-    for(p = 0; p < dt; p++)
+    if(lam <= 0.0)
+        return 0.0;
+    if(lam < 10.0)
     {
-        // Calculate the sin and cos values
-        // of the projection angle and find
-        // at which quadrant on the cartesian grid.
-        theta_p  = fmod(theta[p], 2 * M_PI);
-        quadrant = calc_quadrant(theta_p);
-        sin_p    = sinf(theta_p);
-        cos_p    = cosf(theta_p);
-
-        for(d = 0; d < dx; d++)
+        double u = rng_uniform(rng);
+        double p = exp(-lam), f = p;
+        int    k = 0;
+        while(u > f && k < 1000)
         {
-            // Calculate coordinates
-            xi = -ox - oz;
-            yi = (1 - dx) / 2.0 + d + mov;
-            calc_coords(ox, oz, xi, yi, sin_p, cos_p, gridx, gridy, coordx,
-                        coordy);
-
-            // Merge the (coordx, gridy) and (gridx, coordy)
-            trim_coords(ox, oz, coordx, coordy, gridx, gridy, &asize, ax, ay,
-                        &bsize, bx, by);
-
-            // Sort the array of intersection points (ax, ay) and
-            // (bx, by). The new sorted intersection points are
-            // stored in (coorx, coory). Total number of points
-            // are csize.
-            sort_intersections(quadrant, asize, ax, ay, bsize, bx, by, &csize,
-                               coorx, coory);
-
-            // Calculate the distances (dist) between the
-            // intersection points (coorx, coory). Find the
-            // indices of the pixels on the object grid.
-            calc_dist(ox, oz, csize, coorx, coory, indi, dist);
-
-            // For each slice
-            for(s = 0; s < dy; s++)
-            {
-                // Calculate simdata
-                calc_simdata(s, p, d, ox, oz, dt, dx, csize, indi, dist, obj,
-                             data);  // Output: simulated data
-            }
+            k++;
+            p *= lam / k;
+            f += p;
         }
+        return k;
     }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+    const double slam     = sqrt(lam);
+    const double b        = 0.931 + 2.53 * slam;
+    const double a        = -0.059 + 0.02483 * b;
+    const double invalpha = 1.1239 + 1.1328 / (b - 3.4);
+    const double vr       = 0.9277 - 3.6224 / (b - 2);
+    for(;;)
+    {
+        double u  = rng_uniform(rng) - 0.5;
+        double v  = rng_uniform(rng);
+        double us = 0.5 - fabs(u);
+        double k  = floor((2 * a / us + b) * u + lam + 0.43);
+        if(us >= 0.07 && v <= vr)
+            return k;
+        if(k < 0 || (us < 0.013 && v > us))
+            continue;
+        if(log(v) + log(invalpha) - log(a / (us * us) + b) <=
+           -lam + k * log(lam) - lgamma(k + 1))
+            return k;
+    }
 }
 
-void
-project2(const float* objx, const float* objy, int oy, int ox, int oz,
-         float* data, int dy, int dt, int dx, const float* center,
-         const float* theta)
+// Blur, count and read out rows [r, r + ns) of the block of projections
+// rad of angle p, which has r rows of neighbouring slices on each side,
+// and add them to the data of slices s0 + k. line and tmp hold dx values.
+static void
+detector_rows(const project_args* a, float* rad, int ns, int r, int s0,
+              int p, float* line, float* tmp)
 {
-    float* gridx  = (float*) malloc((ox + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((oz + 1) * sizeof(float));
-    float* coordx = (float*) malloc((oz + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ox + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* ay     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* bx     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* by     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* coorx  = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* coory  = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* dist   = (float*) malloc((ox + oz + 1) * sizeof(float));
-    int*   indx   = (int*) malloc((ox + oz + 1) * sizeof(int));
-    int*   indy   = (int*) malloc((ox + oz + 1) * sizeof(int));
-    int*   indi   = (int*) malloc((ox + oz + 1) * sizeof(int));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL);
-
-    int   s, p, d;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float srcx, srcy, detx, dety, dv, vx, vy;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
-
-    preprocessing(ox, oz, dx, center[0], &mov, gridx,
-                  gridy);  // Outputs: mov, gridx, gridy
-
-    // For each projection angle
-    for(p = 0; p < dt; p++)
+    const int dx = a->dx;
+    const int ru = a->nu / 2;
+
+    // Blur and counting act on the intensity
+    if(a->flux > 0.0f || !a->emission)
+    {
+        for(int i = 0; i < (ns + 2 * r) * dx; i++)
+            rad[i] = expf(-rad[i]);
+    }
+
+    for(int k = 0; k < ns; k++)
     {
-        // Calculate the sin and cos values
-        // of the projection angle and find
-        // at which quadrant on the cartesian grid.
-        theta_p  = fmod(theta[p], 2 * M_PI);
-        quadrant = calc_quadrant(theta_p);
-        sin_p    = sinf(theta_p);
-        cos_p    = cosf(theta_p);
-
-        for(d = 0; d < dx; d++)
+        const float* in = rad + (k + r) * dx;
+        if(a->nv > 1)
         {
-            // Calculate coordinates
-            xi = -ox - oz;
-            yi = (1 - dx) / 2.0 + d + mov;
-
-            srcx = xi * cos_p - yi * sin_p;
-            srcy = xi * sin_p + yi * cos_p;
-            detx = -xi * cos_p - yi * sin_p;
-            dety = -xi * sin_p + yi * cos_p;
-
-            dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-            vx = (srcx - detx) / dv;
-            vy = (srcy - dety) / dv;
-
-            calc_coords(ox, oz, xi, yi, sin_p, cos_p, gridx, gridy, coordx,
-                        coordy);
-
-            // Merge the (coordx, gridy) and (gridx, coordy)
-            trim_coords(ox, oz, coordx, coordy, gridx, gridy, &asize, ax, ay,
-                        &bsize, bx, by);
-
-            // Sort the array of intersection points (ax, ay) and
-            // (bx, by). The new sorted intersection points are
-            // stored in (coorx, coory). Total number of points
-            // are csize.
-            sort_intersections(quadrant, asize, ax, ay, bsize, bx, by, &csize,
-                               coorx, coory);
-
-            // Calculate the distances (dist) between the
-            // intersection points (coorx, coory). Find the
-            // indices of the pixels on the object grid.
-            calc_dist2(ox, oz, csize, coorx, coory, indx, indy, dist);
-
-            // For each slice
-            for(s = 0; s < dy; s++)
+            for(int d = 0; d < dx; d++)
+                tmp[d] = 0.0f;
+            for(int j = 0; j < a->nv; j++)
             {
-                // Calculate simdata
-                calc_simdata2(s, p, d, ox, oz, dt, dx, csize, indx, indy, dist,
-                              vx, vy, objx, objy,
-                              data);  // Output: simulated data
+                const float* src = rad + (k + j) * dx;
+                for(int d = 0; d < dx; d++)
+                    tmp[d] += a->kv[j] * src[d];
             }
+            in = tmp;
+        }
+        if(a->nu > 1)
+        {
+            for(int d = 0; d < dx; d++)
+            {
+                float sum = 0.0f;
+                for(int i = 0; i < a->nu; i++)
+                {
+                    int e = d + i - ru;
+                    e     = (e < 0) ? 0 : (e >= dx) ? dx - 1 : e;
+                    sum += a->ku[i] * in[e];
+                }
+                line[d] = sum;
+            }
+        }
+        else
+        {
+            memcpy(line, in, dx * sizeof(float));
         }
-    }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+        size_t off = ((size_t)(s0 + k) * a->dt + p) * dx;
+        float* out = a->data + off;
+        for(int d = 0; d < dx; d++)
+        {
+            project_rng rng = { splitmix64(a->seed ^ splitmix64(off + d)) };
+            double      val = line[d];
+            if(a->flux > 0.0f)
+            {
+                double counts = rng_poisson(&rng, a->flux * val);
+                if(a->noise > 0.0f)
+                    counts += a->noise * rng_normal(&rng);
+                val = counts / a->flux;
+                if(a->emission)
+                    val = -log((val > 1.0 / a->flux) ? val : 1.0 / a->flux);
+            }
+            else if(a->noise > 0.0f)
+            {
+                val += a->noise * rng_normal(&rng);
+            }
+            out[d] += (float) val;
+        }
+    }
 }
 
-void
-project3(const float* objx, const float* objy, const float* objz, int oy,
-         int ox, int oz, float* data, int dy, int dt, int dx,
-         const float* center, const float* theta, int axis)
+//============================================================================//
+
+// The threads first copy their share of the rows of a block of slices
+// into a layout where the slices of a pixel are contiguous, so that each
+// segment of a ray updates all slices of the block at once, and then
+// project their share of the angles, whose data do not overlap. The
+// projections of an angle are gathered per block and written out through
+// the detector model, if any, while in cache. A blur across the slices
+// also projects r slices on each side of the block, repeating the edge
+// slices of the object.
+static void
+project_thread(thread_team* team, int tid, void* arg)
 {
-    float* gridx  = (float*) malloc((ox + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((oz + 1) * sizeof(float));
-    float* coordx = (float*) malloc((oz + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ox + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* ay     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* bx     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* by     = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* coorx  = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* coory  = (float*) malloc((ox + oz + 2) * sizeof(float));
-    float* dist   = (float*) malloc((ox + oz + 1) * sizeof(float));
-    int*   indx   = (int*) malloc((ox + oz + 1) * sizeof(int));
-    int*   indy   = (int*) malloc((ox + oz + 1) * sizeof(int));
-    int*   indi   = (int*) malloc((ox + oz + 1) * sizeof(int));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL);
-
-    int   s, p, d;
-    int   quadrant;
-    float theta_p, sin_p, cos_p;
-    float srcx, srcy, detx, dety, dv, vx, vy;
-    float mov, xi, yi;
-    int   asize, bsize, csize;
-
-    preprocessing(ox, oz, dx, center[0], &mov, gridx,
-                  gridy);  // Outputs: mov, gridx, gridy
-
-    // For each projection angle
-    for(p = 0; p < dt; p++)
+    const project_args* a     = (const project_args*) arg;
+    const int           ncomp = a->ncomp;
+    const int           nb    = ncomp * PROJECT_BLOCK;
+    const int           r     = (a->nv > 1) ? a->nv / 2 : 0;
+    float               acc[2 * PROJECT_BLOCK];
+
+    ray_tracer ray;
+    init_tracer(&ray, a->model, NULL, a->ox, a->oz, a->dx);
+    tracer_geom(&ray, a->geom);
+
+    float* rad  = (float*) malloc((size_t) PROJECT_BLOCK * a->dx *
+                                 sizeof(float));
+    float* line = (float*) malloc(2 * (size_t) a->dx * sizeof(float));
+    assert(rad != NULL && line != NULL);
+
+    int st[3];
+    field_strides(a->axis, a->ox, a->oz, st);
+    const int bst[3] = { 1, a->oz * nb, nb };
+
+    int m0, m1, p0, p1;
+    team_range(team, tid, a->ox, &m0, &m1);
+    team_range(team, tid, a->dt, &p0, &p1);
+
+    for(int s0 = 0; s0 < a->dy;)
     {
-        // Calculate the sin and cos values
-        // of the projection angle and find
-        // at which quadrant on the cartesian grid.
-        theta_p  = fmod(theta[p], 2 * M_PI);
-        quadrant = calc_quadrant(theta_p);
-        sin_p    = sinf(theta_p);
-        cos_p    = cosf(theta_p);
-
-        for(d = 0; d < dx; d++)
+        // Slices of the block share the rotation center
+        int ns = 1;
+        while(ns < PROJECT_BLOCK - 2 * r && s0 + ns < a->dy &&
+              a->center[s0 + ns] == a->center[s0])
+            ns++;
+
+        // Slots [lo, hi) of the block hold slices s0 - r + slot
+        const int nk = ns + 2 * r;
+        const int lo = (s0 - r < 0) ? r - s0 : 0;
+        const int hi = (s0 + ns + r > a->dy) ? a->dy - s0 + r : nk;
+        for(int c = 0; c < ncomp; c++)
         {
-            // Calculate coordinates
-            xi = -ox - oz;
-            yi = (1 - dx) / 2.0 + d + mov;
-
-            srcx = xi * cos_p - yi * sin_p;
-            srcy = xi * sin_p + yi * cos_p;
-            detx = -xi * cos_p - yi * sin_p;
-            dety = -xi * sin_p + yi * cos_p;
-
-            dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-            vx = (srcx - detx) / dv;
-            vy = (srcy - dety) / dv;
-
-            calc_coords(ox, oz, xi, yi, sin_p, cos_p, gridx, gridy, coordx,
-                        coordy);
-
-            // Merge the (coordx, gridy) and (gridx, coordy)
-            trim_coords(ox, oz, coordx, coordy, gridx, gridy, &asize, ax, ay,
-                        &bsize, bx, by);
-
-            // Sort the array of intersection points (ax, ay) and
-            // (bx, by). The new sorted intersection points are
-            // stored in (coorx, coory). Total number of points
-            // are csize.
-            sort_intersections(quadrant, asize, ax, ay, bsize, bx, by, &csize,
-                               coorx, coory);
-
-            // Calculate the distances (dist) between the
-            // intersection points (coorx, coory). Find the
-            // indices of the pixels on the object grid.
-            calc_dist2(ox, oz, csize, coorx, coory, indx, indy, dist);
-
-            // For each slice
-            for(s = 0; s < dy; s++)
+            float* blk = a->block + c * PROJECT_BLOCK;
+            copy_box(a->obj[c] + (size_t)(s0 - r + lo) * st[0] +
+                         (size_t) m0 * st[1],
+                     st, blk + (size_t) m0 * bst[1] + lo, bst, hi - lo,
+                     m1 - m0, a->oz);
+            for(int i = m0 * a->oz; i < m1 * a->oz; i++)
             {
-                // Calculate simdata
-                calc_simdata3(s, p, d, ox, oz, dt, dx, csize, indx, indy, dist,
-                              vx, vy, objx, objy, objz, axis,
-                              data);  // Output: simulated data
+                float* b = blk + (size_t) i * nb;
+                for(int k = 0; k < lo; k++)
+                    b[k] = b[lo];
+                for(int k = hi; k < nk; k++)
+                    b[k] = b[hi - 1];
+                for(int k = nk; k < PROJECT_BLOCK; k++)
+                    b[k] = 0.0f;
             }
         }
+        team_barrier(team);
+
+        tracer_slice(&ray, a->center[s0]);
+        for(int p = p0; p < p1; p++)
+        {
+            tracer_angle(&ray, a->theta[p]);
+
+            // The rays run against the direction of the projection
+            float vx = -ray.cos_p;
+            float vy = -ray.sin_p;
+
+            for(int d = 0; d < a->dx; d++)
+            {
+                int csize = trace_ray(&ray, d);
+
+                memset(acc, 0, nb * sizeof(float));
+                for(int n = 0; n < csize - 1; n++)
+                {
+                    const float* b = a->block + ray.indi[n] * nb;
+                    const float  w = ray.dist[n];
+                    for(int k = 0; k < nb; k++)
+                        acc[k] += b[k] * w;
+                }
+
+                for(int k = 0; k < nk; k++)
+                {
+                    rad[k * a->dx + d] =
+                        (ncomp == 1)
+                            ? acc[k]
+                            : vx * acc[k] + vy * acc[PROJECT_BLOCK + k];
+                }
+            }
+
+            if(a->detector)
+            {
+                detector_rows(a, rad, ns, r, s0, p, line, line + a->dx);
+                continue;
+            }
+            for(int k = 0; k < ns; k++)
+            {
+                float* out = a->data + ((size_t)(s0 + k) * a->dt + p) * a->dx;
+                for(int d = 0; d < a->dx; d++)
+                    out[d] += rad[k * a->dx + d];
+            }
+        }
+        team_barrier(team);
+        s0 += ns;
     }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+    free(rad);
+    free(line);
+    free_tracer(&ray);
+}
+
+static void
+project_run(project_args* args, int num_thread)
+{
+    args->block = (float*) malloc((size_t) args->ox * args->oz * args->ncomp *
+                                  PROJECT_BLOCK * sizeof(float));
+    assert(args->block != NULL);
+
+    run_team((num_thread > 1) ? num_thread : 1, project_thread, args);
+
+    free(args->block);
+}
+
+void
+project(const float* obj, int oy, int ox, int oz, float* data, int dy, int dt,
+        int dx, const float* center, const float* theta, const char* projector,
+        float sod, float sdd, const float* blur_u, int nu, const float* blur_v,
+        int nv, float flux, float noise, int seed, int emission, int num_thread)
+{
+    // A blur across the slices needs a slice of the block to write out
+    assert(nv < PROJECT_BLOCK);
+    assert(dy <= oy);
+
+    project_args args = { .obj      = { obj, NULL },
+                          .ncomp    = 1,
+                          .axis     = 0,
+                          .dy       = dy,
+                          .ox       = ox,
+                          .oz       = oz,
+                          .data     = data,
+                          .dt       = dt,
+                          .dx       = dx,
+                          .center   = center,
+                          .theta    = theta,
+                          .model    = get_projector(projector),
+                          .geom     = { 0.0f, 0.0f, sod, sdd },
+                          .detector = (nu > 1 || nv > 1 || flux > 0.0f ||
+                                       noise > 0.0f),
+                          .ku       = blur_u,
+                          .nu       = nu,
+                          .kv       = blur_v,
+                          .nv       = nv,
+                          .flux     = flux,
+                          .noise    = noise,
+                          .seed     = (unsigned) seed,
+                          .emission = emission };
+
+    project_run(&args, num_thread);
+}
+
+void
+project2(const float* objx, const float* objy, int oy, int ox, int oz,
+         float* data, int dy, int dt, int dx, const float* center,
+         const float* theta, int num_thread)
+{
+    assert(dy <= oy);
+
+    project_args args = { .obj    = { objx, objy },
+                          .ncomp  = 2,
+                          .axis   = 0,
+                          .dy     = dy,
+                          .ox     = ox,
+                          .oz     = oz,
+                          .data   = data,
+                          .dt     = dt,
+                          .dx     = dx,
+                          .center = center,
+                          .theta  = theta,
+                          .model  = PROJ_SIDDON };
+
+    project_run(&args, num_thread);
+}
+
+void
+project3(const float* objx, const float* objy, const float* objz, int oy,
+         int ox, int oz, float* data, int dy, int dt, int dx,
+         const float* center, const float* theta, int axis, int num_thread)
+{
+    const float* obj[3] = { objx, objy, objz };
+    int          c0, c1;
+    field_comps(axis, &c0, &c1);
+    if(axis != 0)
+        assert(oy == ox && oy == oz);
+    assert(dy <= oy);
+
+    project_args args = { .obj    = { obj[c0], obj[c1] },
+                          .ncomp  = 2,
+                          .axis   = axis,
+                          .dy     = dy,
+                          .ox     = ox,
+                          .oz     = oz,
+                          .data   = data,
+                          .dt     = dt,
+                          .dx     = dx,
+                          .center = center,
+                          .theta  = theta,
+                          .model  = PROJ_SIDDON };
+
+    project_run(&args, num_thread);
 }
@@ -42,60 +42,597 @@
 // POSSIBILITY OF SUCH DAMAGE.
 
 #include "stripe.h"
+#include "utils.h"
 
-void
-remove_stripe_sf(float* data, int dx, int dy, int dz, int size, int istart,
-                 int iend)
+typedef struct
+{
+    float* data;
+    int    dx, dy, dz;
+    int    size;
+} stripe_sf_args;
+
+// Smooths the average row with a box of the given size, replicating the
+// edge values, by a running sum.
+static void
+smooth_row_sf(const float* row, float* out, int n, int size)
+{
+    int    i, h = size / 2;
+    double sum = 0.0;
+
+    for(i = -h; i < size - h; i++)
+        sum += row[(i < 0) ? 0 : ((i > n - 1) ? n - 1 : i)];
+    for(i = 0; i < n; i++)
+    {
+        out[i] = (float) (sum / size);
+        sum -= row[(i - h < 0) ? 0 : ((i - h > n - 1) ? n - 1 : i - h)];
+        sum += row[(i - h + size > n - 1) ? n - 1 : i - h + size];
+    }
+}
+
+static void
+remove_stripe_sf_thread(thread_team* team, int tid, void* arg)
 {
-    int    i, j, k, p, s;
-    float* avrage_row;
-    float* smooth_row;
+    const stripe_sf_args* a  = (const stripe_sf_args*) arg;
+    int                   dz = a->dz;
+    int                   s, s0, s1, p, j, ns;
+    float*                avrage;
+    float*                smooth;
+    float*                row;
+    float                 w = 1.0f / (float) a->dx;
+
+    team_range(team, tid, a->dy, &s0, &s1);
+    ns = s1 - s0;
+    if(ns <= 0)
+        return;
+    avrage = (float*) calloc((size_t) ns * dz, sizeof(float));
+    smooth = (float*) malloc(sizeof(float) * dz);
+    assert(avrage != NULL && smooth != NULL);
 
-    // For each slice.
-    for(s = istart; s < iend; s++)
+    // Average rows of all the slices of the block in one sweep over the
+    // projections, reading whole rows.
+    for(p = 0; p < a->dx; p++)
     {
-        avrage_row = (float*) calloc(dz, sizeof(float));
-        smooth_row = (float*) calloc(dz, sizeof(float));
+        for(s = s0; s < s1; s++)
+        {
+            float* acc = avrage + (size_t) (s - s0) * dz;
+            row        = a->data + ((size_t) p * a->dy + s) * dz;
+            for(j = 0; j < dz; j++)
+                acc[j] += row[j];
+        }
+    }
 
-        // For each pixel.
+    // Keep the difference between the average row and its smoothed version
+    for(s = 0; s < ns; s++)
+    {
+        float* acc = avrage + (size_t) s * dz;
         for(j = 0; j < dz; j++)
+            acc[j] *= w;
+        smooth_row_sf(acc, smooth, dz, a->size);
+        for(j = 0; j < dz; j++)
+            acc[j] -= smooth[j];
+    }
+
+    // Subtract this difference from each row in sinogram.
+    for(p = 0; p < a->dx; p++)
+    {
+        for(s = s0; s < s1; s++)
         {
-            // For each projection.
-            for(p = 0; p < dx; p++)
-            {
-                avrage_row[j] += data[j + s * dz + p * dy * dz] / dx;
-            }
+            const float* dif = avrage + (size_t) (s - s0) * dz;
+            row              = a->data + ((size_t) p * a->dy + s) * dz;
+            for(j = 0; j < dz; j++)
+                row[j] -= dif[j];
         }
+    }
+
+    free(avrage);
+    free(smooth);
+}
+
+void
+remove_stripe_sf(float* data, int dx, int dy, int dz, int size,
+                 int num_thread)
+{
+    stripe_sf_args args = {
+        .data = data, .dx = dx, .dy = dy, .dz = dz, .size = size
+    };
+
+    if(size < 1)
+        return;
+    run_team((num_thread > 1) ? num_thread : 1, remove_stripe_sf_thread,
+             &args);
+}
 
-        // We have now computed the average row of the sinogram.
-        // Smooth it
-        for(i = 0; i < dz; i++)
+//============================================================================//
+//  Sorting-based stripe removal (Vo et al., Optics Express 2018)
+//============================================================================//
+
+#define STRIPE_SORT 0
+#define STRIPE_LARGE 1
+#define STRIPE_DEAD 2
+#define STRIPE_ALL 3
+
+typedef struct
+{
+    float* data;
+    int    dx, dy, dz;
+    int    method;
+    float  snr;
+    int    size, sm_size;
+} stripe_args;
+
+// Buffers of one thread, reused for all of its sinograms
+typedef struct
+{
+    int            nrow, ncol;
+    float*         sino;  // nrow x ncol sinogram
+    int*           idx;   // ncol x nrow, row of each rank of each column
+    float*         sort;  // nrow x ncol, the columns sorted, rank by rank
+    float*         med;   // nrow x ncol, sort median filtered along rows
+    unsigned int*  key;   // 2 x nrow radix sort keys
+    int*           tmp;   // nrow radix sort indices
+    float*         win;   // sliding median window
+    double*        dbuf;  // 3 x ncol
+    float*         fbuf;  // 3 x ncol
+    unsigned char* mask;  // 2 x ncol
+} stripe_work;
+
+static int
+get_stripe_method(const char* name)
+{
+    struct
+    {
+        const char* name;
+        const int   method;
+    } mtbl[] = { { "sort", STRIPE_SORT },  // Default
+                 { "large", STRIPE_LARGE },
+                 { "dead", STRIPE_DEAD },
+                 { "all", STRIPE_ALL } };
+
+    for(int i = 0; i < 4; i++)
+    {
+        if(!strncmp(name, mtbl[i].name, 16))
         {
-            smooth_row[i] = 0;
-            for(j = 0; j < size; j++)
-            {
-                k = i + j - size / 2;
-                if(k < 0)
-                    k = 0;
-                if(k > dz - 1)
-                    k = dz - 1;
-                smooth_row[i] += avrage_row[k];
-            }
-            smooth_row[i] /= size;
+            return mtbl[i].method;
         }
+    }
+    return mtbl[0].method;
+}
+
+// Index of i in a signal of length n extended by mirroring about the
+// edges, (d c b a | a b c d | d c b a) as scipy.ndimage's reflect mode.
+static inline int
+reflect(int i, int n)
+{
+    int p = 2 * n;
+
+    i %= p;
+    if(i < 0)
+        i += p;
+    return (i >= n) ? p - 1 - i : i;
+}
+
+// Unsigned integer key with the order of the float value
+static inline unsigned int
+float_key(float v)
+{
+    unsigned int u;
+
+    memcpy(&u, &v, sizeof(u));
+    return (u & 0x80000000u) ? ~u : (u | 0x80000000u);
+}
+
+// First position of the sorted window win[0:n] not below v
+static inline int
+lower_bound(const float* win, int n, float v)
+{
+    int lo = 0, hi = n, mid;
+
+    while(lo < hi)
+    {
+        mid = (lo + hi) / 2;
+        if(win[mid] < v)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+// Median filter of size k over the n values of in, with scipy.ndimage's
+// window placement, rank and reflect mode. The window is kept sorted, so
+// each step is a binary search and a move of at most k values.
+static void
+median_row(const float* in, float* out, int n, int k, float* win)
+{
+    int   lo = k / 2, c, i, j;
+    float v, old;
 
-        // For each projection.
-        for(p = 0; p < dx; p++)
+    for(i = 0; i < k; i++)
+    {
+        v = in[reflect(i - lo, n)];
+        j = lower_bound(win, i, v);
+        memmove(win + j + 1, win + j, sizeof(float) * (i - j));
+        win[j] = v;
+    }
+    out[0] = win[lo];
+    for(c = 1; c < n; c++)
+    {
+        old = in[reflect(c - 1 - lo, n)];
+        v   = in[reflect(c - 1 - lo + k, n)];
+        if(old != v)
         {
-            // Subtract this difference from each row in sinogram.
-            for(j = 0; j < dz; j++)
+            j = lower_bound(win, k, old);
+            j = (j < k) ? j : k - 1;
+            memmove(win + j, win + j + 1, sizeof(float) * (k - 1 - j));
+            j = lower_bound(win, k - 1, v);
+            memmove(win + j + 1, win + j, sizeof(float) * (k - 1 - j));
+            win[j] = v;
+        }
+        out[c] = win[lo];
+    }
+}
+
+// Gathers the columns of the sinogram in the order of idx
+static void
+gather_sorted(stripe_work* w)
+{
+    int n = w->nrow, m = w->ncol, r, c;
+
+    for(c = 0; c < m; c++)
+    {
+        const int* idx = w->idx + (size_t) c * n;
+        for(r = 0; r < n; r++)
+            w->sort[(size_t) r * m + c] = w->sino[(size_t) idx[r] * m + c];
+    }
+}
+
+// Sorts every column of the sinogram along the angles by a stable LSD
+// radix sort of the float keys, keeping the index for the way back.
+static void
+sort_columns(stripe_work* w)
+{
+    int           n = w->nrow, m = w->ncol, r, c, b, shift, sum, cnt;
+    int           count[256];
+    unsigned int* k0;
+    unsigned int* k1;
+    unsigned int* kt;
+    int*          i0;
+    int*          i1;
+    int*          it;
+
+    for(c = 0; c < m; c++)
+    {
+        k0 = w->key;
+        k1 = w->key + n;
+        i0 = w->idx + (size_t) c * n;
+        i1 = w->tmp;
+        for(r = 0; r < n; r++)
+        {
+            k0[r] = float_key(w->sino[(size_t) r * m + c]);
+            i0[r] = r;
+        }
+        // Four passes, so the result ends back in the index of the column
+        for(shift = 0; shift < 32; shift += 8)
+        {
+            memset(count, 0, sizeof(count));
+            for(r = 0; r < n; r++)
+                count[(k0[r] >> shift) & 255]++;
+            for(b = 0, sum = 0; b < 256; b++)
+            {
+                cnt      = count[b];
+                count[b] = sum;
+                sum += cnt;
+            }
+            for(r = 0; r < n; r++)
             {
-                data[j + s * dz + p * dy * dz] -=
-                    (avrage_row[j] - smooth_row[j]);
+                b     = count[(k0[r] >> shift) & 255]++;
+                k1[b] = k0[r];
+                i1[b] = i0[r];
             }
+            kt = k0;
+            k0 = k1;
+            k1 = kt;
+            it = i0;
+            i0 = i1;
+            i1 = it;
+        }
+    }
+    gather_sorted(w);
+}
+
+// Median filters the sorted sinogram across the columns, rank by rank
+static void
+median_sorted(stripe_work* w, int size)
+{
+    int n = w->nrow, m = w->ncol, r;
+
+    for(r = 0; r < n; r++)
+        median_row(w->sort + (size_t) r * m, w->med + (size_t) r * m, m, size,
+                   w->win);
+}
+
+// Puts the filtered sorted values back to their rows in the columns of the
+// mask, or all of them when mask is NULL.
+static void
+scatter_sorted(stripe_work* w, const unsigned char* mask)
+{
+    int n = w->nrow, m = w->ncol, r, c;
+
+    for(c = 0; c < m; c++)
+    {
+        const int* idx = w->idx + (size_t) c * n;
+        if(mask && !mask[c])
+            continue;
+        for(r = 0; r < n; r++)
+            w->sino[(size_t) idx[r] * m + c] = w->med[(size_t) r * m + c];
+    }
+}
+
+static int
+compare_decreasing(const void* a, const void* b)
+{
+    double x = *(const double*) a, y = *(const double*) b;
+
+    return (x < y) - (x > y);
+}
+
+// Algorithm 4: marks the outliers of the n values of list, dilated by one.
+// sorted holds n doubles and mask 2n bytes.
+static void
+detect_stripe(const float* list, int n, float snr, double* sorted,
+              unsigned char* mask)
+{
+    int            ndrop = (int) (0.25 * n), i, cnt;
+    unsigned char* raw   = mask + n;
+    double         xm, ym, sxy, sxx, slope, icept, numt1, noise, val1, val2;
+    double         upper = HUGE_VAL, lower = -HUGE_VAL;
+
+    memset(mask, 0, n);
+    cnt = n - 2 * ndrop - 1;
+    if(cnt < 2)
+        return;
+
+    // Decreasing order
+    for(i = 0; i < n; i++)
+        sorted[i] = list[i];
+    qsort(sorted, n, sizeof(double), compare_decreasing);
+
+    // Straight line through the middle of the sorted values
+    xm = ndrop + 0.5 * (cnt - 1);
+    for(i = ndrop, ym = 0.0; i < ndrop + cnt; i++)
+        ym += sorted[i];
+    ym /= cnt;
+    for(i = ndrop, sxy = 0.0, sxx = 0.0; i < ndrop + cnt; i++)
+    {
+        sxy += (i - xm) * (sorted[i] - ym);
+        sxx += (i - xm) * (i - xm);
+    }
+    slope = sxy / sxx;
+    icept = ym - slope * xm;
+    numt1 = icept + slope * (n - 1);
+    noise = fabs(numt1 - icept);
+    val1  = fabs(sorted[0] - icept) / noise;
+    val2  = fabs(sorted[n - 1] - numt1) / noise;
+    if(val1 >= snr)
+        upper = icept + noise * snr * 0.5;
+    if(val2 >= snr)
+        lower = numt1 - noise * snr * 0.5;
+
+    for(i = 0; i < n; i++)
+        raw[i] = (list[i] > upper) || (val2 >= snr && list[i] <= lower);
+    for(i = 0; i < n; i++)
+        mask[i] = raw[i] || (i > 0 && raw[i - 1]) || (i < n - 1 && raw[i + 1]);
+}
+
+// Algorithm 3: smooths the sorted sinogram across the columns and sorts
+// it back. The columns are sorted already when sorted is set.
+static void
+rs_sort(stripe_work* w, int size, int sorted)
+{
+    if(sorted)
+        gather_sorted(w);
+    else
+        sort_columns(w);
+    median_sorted(w, size);
+    scatter_sorted(w, NULL);
+}
+
+// Algorithm 5: normalizes the columns by the ratio of their trimmed mean to
+// that of the smoothed sorted sinogram and replaces the detected stripes by
+// the smoothed sorted values. The index stays valid for the result.
+static void
+rs_large(stripe_work* w, float snr, int size)
+{
+    int            n = w->nrow, m = w->ncol, r, c, t;
+    int            ndrop = (int) (0.05 * n);
+    double*        l1    = w->dbuf;
+    double*        l2    = w->dbuf + m;
+    float*         fact  = w->fbuf;
+    unsigned char* mask  = w->mask;
+
+    sort_columns(w);
+    median_sorted(w, size);
+    for(c = 0; c < m; c++)
+        l1[c] = l2[c] = 0.0;
+    for(r = ndrop; r < n - ndrop; r++)
+    {
+        for(c = 0; c < m; c++)
+        {
+            l1[c] += w->sort[(size_t) r * m + c];
+            l2[c] += w->med[(size_t) r * m + c];
+        }
+    }
+    for(c = 0; c < m; c++)
+        fact[c] = (float) (l1[c] / (n - 2 * ndrop)) /
+                  (float) (l2[c] / (n - 2 * ndrop));
+
+    detect_stripe(fact, m, snr, w->dbuf + 2 * m, mask);
+    for(r = 0; r < n; r++)
+        for(c = 0; c < m; c++)
+            w->sino[(size_t) r * m + c] /= fact[c];
+    scatter_sorted(w, mask);
+
+    // A negative factor reverses the order of a kept column
+    for(c = 0; c < m; c++)
+    {
+        int* idx = w->idx + (size_t) c * n;
+        if(mask[c] || !(fact[c] < 0.0f))
+            continue;
+        for(r = 0; r < n / 2; r++)
+        {
+            t              = idx[r];
+            idx[r]         = idx[n - 1 - r];
+            idx[n - 1 - r] = t;
+        }
+    }
+}
+
+// Algorithm 6: finds the columns whose fluctuation stands out from that of
+// their neighbours, interpolates them from the nearest good columns and
+// then removes the remaining large stripes.
+static void
+rs_dead(stripe_work* w, float snr, int size)
+{
+    int            n = w->nrow, m = w->ncol, r, c, cl, cr;
+    double*        acc  = w->dbuf;
+    float*         diff = w->fbuf;
+    float*         bck  = w->fbuf + m;
+    float*         fact = w->fbuf + 2 * m;
+    unsigned char* mask = w->mask;
+    double         nmean, sum;
+    float          s, t;
+
+    // Sum of the deviations from a 10 angle running mean
+    for(c = 0; c < m; c++)
+    {
+        acc[c]  = 0.0;
+        diff[c] = 0.0f;
+    }
+    for(r = -5; r < 5; r++)
+        for(c = 0; c < m; c++)
+            acc[c] += w->sino[(size_t) reflect(r, n) * m + c];
+    for(r = 0; r < n; r++)
+    {
+        const float* row = w->sino + (size_t) r * m;
+        const float* add = w->sino + (size_t) reflect(r + 5, n) * m;
+        const float* sub = w->sino + (size_t) reflect(r - 5, n) * m;
+        for(c = 0; c < m; c++)
+        {
+            s = (float) (acc[c] / 10.0);
+            diff[c] += fabsf(row[c] - s);
+            acc[c] += add[c] - sub[c];
         }
+    }
 
-        free(avrage_row);
-        free(smooth_row);
+    for(c = 0, sum = 0.0; c < m; c++)
+        sum += diff[c];
+    nmean = sum / m;
+    median_row(diff, bck, m, size, w->win);
+    for(c = 0; c < m; c++)
+        fact[c] = diff[c] / ((bck[c] == 0.0f) ? (float) nmean : bck[c]);
+    detect_stripe(fact, m, snr, w->dbuf + m, mask);
+    for(c = 0; c < 2 && c < m; c++)
+    {
+        mask[c]         = 0;
+        mask[m - 1 - c] = 0;
     }
+
+    for(c = 0; c < m; c++)
+    {
+        if(!mask[c])
+            continue;
+        for(cl = c - 1; mask[cl]; cl--)
+            ;
+        for(cr = c + 1; mask[cr]; cr++)
+            ;
+        t = (float) (c - cl) / (float) (cr - cl);
+        for(r = 0; r < n; r++)
+        {
+            float* row = w->sino + (size_t) r * m;
+            row[c]     = row[cl] + t * (row[cr] - row[cl]);
+        }
+    }
+
+    rs_large(w, snr, size);
+}
+
+static void
+stripe_thread(thread_team* team, int tid, void* arg)
+{
+    const stripe_args* a = (const stripe_args*) arg;
+    int                n = a->dx, m = a->dz, s, s0, s1, t;
+    int                k = (a->size > a->sm_size) ? a->size : a->sm_size;
+    size_t             nm = (size_t) n * m;
+    stripe_work        w;
+
+    w.nrow = n;
+    w.ncol = m;
+    w.sino = (float*) malloc(sizeof(float) * nm);
+    w.idx  = (int*) malloc(sizeof(int) * nm);
+    w.sort = (float*) malloc(sizeof(float) * nm);
+    w.med  = (float*) malloc(sizeof(float) * nm);
+    w.key  = (unsigned int*) malloc(sizeof(unsigned int) * 2 * n);
+    w.tmp  = (int*) malloc(sizeof(int) * n);
+    w.win  = (float*) malloc(sizeof(float) * k);
+    w.dbuf = (double*) malloc(sizeof(double) * 3 * m);
+    w.fbuf = (float*) malloc(sizeof(float) * 3 * m);
+    w.mask = (unsigned char*) malloc(2 * m);
+    assert(w.sino != NULL && w.idx != NULL && w.sort != NULL &&
+           w.med != NULL && w.key != NULL && w.tmp != NULL &&
+           w.win != NULL && w.dbuf != NULL && w.fbuf != NULL &&
+           w.mask != NULL);
+
+    team_range(team, tid, a->dy, &s0, &s1);
+    for(s = s0; s < s1; s++)
+    {
+        for(t = 0; t < n; t++)
+            memcpy(w.sino + (size_t) t * m,
+                   a->data + ((size_t) t * a->dy + s) * m,
+                   sizeof(float) * m);
+
+        switch(a->method)
+        {
+            case STRIPE_SORT: rs_sort(&w, a->size, 0); break;
+            case STRIPE_LARGE: rs_large(&w, a->snr, a->size); break;
+            case STRIPE_DEAD: rs_dead(&w, a->snr, a->size); break;
+            case STRIPE_ALL:
+                rs_dead(&w, a->snr, a->size);
+                rs_sort(&w, a->sm_size, 1);
+                break;
+        }
+
+        for(t = 0; t < n; t++)
+            memcpy(a->data + ((size_t) t * a->dy + s) * m,
+                   w.sino + (size_t) t * m, sizeof(float) * m);
+    }
+
+    free(w.sino);
+    free(w.idx);
+    free(w.sort);
+    free(w.med);
+    free(w.key);
+    free(w.tmp);
+    free(w.win);
+    free(w.dbuf);
+    free(w.fbuf);
+    free(w.mask);
+}
+
+void
+remove_stripe_sorting(float* data, int dx, int dy, int dz,
+                      const char* method, float snr, int size, int sm_size,
+                      int num_thread)
+{
+    stripe_args args = { .data    = data,
+                         .dx      = dx,
+                         .dy      = dy,
+                         .dz      = dz,
+                         .method  = get_stripe_method(method),
+                         .snr     = snr,
+                         .size    = size,
+                         .sm_size = sm_size };
+
+    if(size < 1 || sm_size < 1 || dx < 1 || dz < 1)
+        return;
+    run_team((num_thread > 1) ? num_thread : 1, stripe_thread, &args);
 }
@@ -43,47 +43,172 @@
 
 #include "utils.h"
 
+// Power iterations estimating the norm of the projector
+#define TV_POWER_ITER 16
+
+// Project slice x into sino (dt x dx)
+static void
+tv_project(ray_tracer* ray, const float* theta, int dt, int dx,
+           const float* x, float* sino)
+{
+    memset(sino, 0, dt * dx * sizeof(float));
+    for(int p = 0; p < dt; p++)
+    {
+        tracer_angle(ray, theta[p]);
+        for(int d = 0; d < dx; d++)
+        {
+            int csize = trace_ray(ray, d);
+            calc_simdata(0, p, d, ray->ngridx, ray->ngridy, dt, dx, csize,
+                         ray->indi, ray->dist, x, sino);
+        }
+    }
+}
+
+// Backproject scale * sino into the slice out, skipping the rays that miss
+// the grid
+static void
+tv_backproject(ray_tracer* ray, const float* theta, int dt, int dx,
+               float scale, const float* sino, float* out)
+{
+    for(int p = 0; p < dt; p++)
+    {
+        tracer_angle(ray, theta[p]);
+        for(int d = 0; d < dx; d++)
+        {
+            int csize = trace_ray(ray, d);
+            if(csize > 1)
+                backproject_ray(ray, p, d, csize, scale * sino[p * dx + d],
+                                out, NULL);
+        }
+    }
+    backproject_slice(ray, theta, out, NULL);
+}
+
+// Estimate the largest eigenvalue of R^* R for the slice geometry set on
+// the tracer by power iteration. x, y and z are scratch slices and a
+// scratch sinogram.
+static float
+tv_norm2(ray_tracer* ray, const float* theta, int dt, int dx, float* x,
+         float* sino, float* z)
+{
+    const int npix  = ray->ngridx * ray->ngridy;
+    float     norm2 = 0.0f;
+
+    for(int n = 0; n < npix; n++)
+        x[n] = outside(ray->mask, n) ? 0.0f : 1.0f;
+
+    for(int k = 0; k < TV_POWER_ITER; k++)
+    {
+        double xx = 0.0, zz = 0.0;
+
+        tv_project(ray, theta, dt, dx, x, sino);
+        memset(z, 0, npix * sizeof(float));
+        tv_backproject(ray, theta, dt, dx, 1.0f, sino, z);
+
+        for(int n = 0; n < npix; n++)
+        {
+            xx += (double) x[n] * x[n];
+            zz += (double) z[n] * z[n];
+        }
+        if(xx == 0.0 || zz == 0.0)
+            break;
+        norm2 = (float) sqrt(zz / xx);
+        for(int n = 0; n < npix; n++)
+            x[n] = (float) (z[n] / sqrt(zz));
+    }
+    return norm2;
+}
+
+// The state of a slice kept between calls: a header, the planes of the
+// primal variable (update), of its extrapolation (recon scaled by 1/r) and
+// of the dual variables of the gradient, then the dual variable of the
+// projections (prox1).
+enum
+{
+    TV_STARTED,  // nonzero once the slice was initialized
+    TV_NORM2,    // estimate of ||R||^2 for the geometry of the slice
+    TV_HEADER
+};
+
+enum
+{
+    TV_UPDATE,
+    TV_RECON,
+    TV_PROX0X,
+    TV_PROX0Y,
+    TV_PROX0Z,
+    TV_PLANES
+};
+
+typedef struct
+{
+    float* head;
+    float* update;
+    float* xbar;
+    float* prox0x;
+    float* prox0y;
+    float* prox0z;
+    float* prox1;
+} tv_slice;
+
+static tv_slice
+get_tv_slice(float* state, int size, int npix, int s)
+{
+    tv_slice sl;
+    sl.head   = state + (size_t) s * size;
+    sl.update = sl.head + TV_HEADER + TV_UPDATE * npix;
+    sl.xbar   = sl.head + TV_HEADER + TV_RECON * npix;
+    sl.prox0x = sl.head + TV_HEADER + TV_PROX0X * npix;
+    sl.prox0y = sl.head + TV_HEADER + TV_PROX0Y * npix;
+    sl.prox0z = sl.head + TV_HEADER + TV_PROX0Z * npix;
+    sl.prox1  = sl.head + TV_HEADER + TV_PLANES * npix;
+    return sl;
+}
+
+int
+tv_state_size(int dt, int dx, int ngridx, int ngridy)
+{
+    return TV_HEADER + TV_PLANES * ngridx * ngridy + dt * dx;
+}
+
 void
 tv(const float* data, int dy, int dt, int dx, const float* center,
    const float* theta, float* recon, int ngridx, int ngridy, int num_iter,
-   const float* reg_pars)
+   const float* reg_pars, const char* projector,
+   const unsigned char* mask, const float* geom, const char* backprojector,
+   int tv_3d, float* state)
 {
-    float* gridx    = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy    = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx   = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy   = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by       = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory    = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indi     = (int*) malloc((ngridx + ngridy) * sizeof(int));
-    float* simdata  = (float*) malloc((dy * dt * dx) * sizeof(float));
-    float* sum_dist = (float*) malloc((ngridx * ngridy) * sizeof(float));
-
-    float* update = (float*) malloc((dy * ngridx * ngridy) * sizeof(float));
-    float* prox0x = (float*) malloc((dy * ngridx * ngridy) * sizeof(float));
-    float* prox0y = (float*) malloc((dy * ngridx * ngridy) * sizeof(float));
-
-    float* prox1   = (float*) malloc((dy * dt * dx) * sizeof(float));
-    float* adjdata = (float*) malloc((dy * ngridx * ngridy) * sizeof(float));
-
-    assert(coordx != NULL && coordy != NULL && ax != NULL && ay != NULL &&
-           by != NULL && bx != NULL && coorx != NULL && coory != NULL &&
-           dist != NULL && indi != NULL && simdata != NULL &&
-           sum_dist != NULL && update != NULL);
-
-    int    s, p, d, i, n;
-    int    quadrant;
-    float  theta_p, sin_p, cos_p;
-    float  mov, xi, yi;
-    int    asize, bsize, csize;
-    double upd;
-    int    ind_data, ind_recon;
-    float  sum_dist2;
-    int    ix, iy;
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy,
+                dx);
+    tracer_geom(&ray, geom);
+    init_backprojector(&ray, get_backprojector(backprojector), dt);
+
+    const int npix = ngridx * ngridy;
+    const int size = tv_state_size(dt, dx, ngridx, ngridy);
+
+    // Without a state from the caller, the state lives for this call only.
+    float* owned = NULL;
+    if(state == NULL)
+    {
+        owned = (float*) calloc((size_t) dy * size, sizeof(float));
+        state = owned;
+    }
+
+    float* simdata = (float*) malloc((dt * dx) * sizeof(float));
+    float* adjdata = (float*) malloc(npix * sizeof(float));
+    float* prior   = (float*) malloc(npix * sizeof(float));
+
+    assert(state != NULL && simdata != NULL && adjdata != NULL &&
+           prior != NULL);
+
+    int      s, i, n;
+    double   upd;
+    int      ind_data;
+    int      ix, iy;
+    float    gx, gy, gz, div;
+    tv_slice sl;
+    float *  next, *below;
 
     // regularization parameters
     float c;
@@ -92,196 +217,167 @@ tv(const float* data, int dy, int dt, int dx, const float* center,
     // scaling constant r such that r*R(r*R^*(data)) ~ data
     float r;
 
+    // squared norm of the operator K = (r*R, grad), bounded by the power
+    // iteration estimate of ||R||^2, the largest over the slice geometries,
+    // and ||grad||^2 <= 4 * dimensions
+    float norm2 = 0.0f;
+
     lambda = reg_pars[0];
-    c      = 0.35;
     r      = 1 / sqrt(dx * dt / 2.0);
 
-    // scale initial guess
+    // Start the slices without a state from the initial guess; the others
+    // resume where the previous call stopped.
     for(s = 0; s < dy; s++)
     {
-        ind_recon = s * ngridx * ngridy;
-        for(iy = 0; iy < ngridy; iy++)
-            for(ix = 0; ix < ngridx; ix++)
-                recon[ind_recon + iy * ngridx + ix] /= r;
+        sl = get_tv_slice(state, size, npix, s);
+        if(sl.head[TV_STARTED])
+            continue;
+        if(s > 0 && center[s] == center[s - 1])
+        {
+            // same geometry as the previous slice
+            sl.head[TV_NORM2] = sl.head[TV_NORM2 - size];
+        }
+        else
+        {
+            tracer_slice(&ray, center[s]);
+            sl.head[TV_NORM2] =
+                tv_norm2(&ray, theta, dt, dx, sl.update, simdata, adjdata);
+        }
+
+        // scale initial guess
+        for(n = 0; n < npix; n++)
+        {
+            sl.xbar[n]   = recon[s * npix + n] / r;
+            sl.update[n] = sl.xbar[n];
+        }
+        memset(sl.prox0x, 0, 3 * npix * sizeof(float));
+        memset(sl.prox1, 0, dt * dx * sizeof(float));
+        sl.head[TV_STARTED] = 1.0f;
+    }
+    for(s = 0; s < dy; s++)
+    {
+        sl = get_tv_slice(state, size, npix, s);
+        norm2 = (sl.head[TV_NORM2] > norm2) ? sl.head[TV_NORM2] : norm2;
     }
 
-    memcpy(update, recon, dy * ngridx * ngridy * sizeof(float));
-    memset(prox0x, 0, dy * ngridx * ngridy * sizeof(float));
-    memset(prox0y, 0, dy * ngridx * ngridy * sizeof(float));
-    memset(prox1, 0, dy * dt * dx * sizeof(float));
+    // primal and dual steps c with c * c * ||K||^2 < 1
+    c = 0.99f / sqrtf(r * r * norm2 + ((tv_3d && dy > 1) ? 12.0f : 8.0f));
 
     // Iterations
     for(i = 0; i < num_iter; i++)
     {
-        // initialize simdata to 0
-        memset(simdata, 0, dy * dt * dx * sizeof(float));
-        memset(adjdata, 0, dy * ngridx * ngridy * sizeof(float));
-
-        // For each slice
+        // compute proximal of the gradient in x, y and z directions
+        // prox0 = prox0+c*grad(recon);
+        // prox0 = prox0/max(1,abs(prox0)/lambda);
+        // Differences across the support boundary are skipped. Each row
+        // is read with the next row and the same row of the next slice, so
+        // the stencil streams through the volume once.
         for(s = 0; s < dy; s++)
         {
-            ind_recon = s * ngridx * ngridy;
-            // compute proximal of the gradient in x and y directions
-            // prox0 = prox0+c*grad(recon);
-            // prox0 = prox0/max(1,abs(prox0)/lambda);
-            for(iy = 0; iy < ngridy - 1; iy++)
-                for(ix = 0; ix < ngridx - 1; ix++)
-                {
-                    prox0x[ind_recon + iy * ngridx + ix] +=
-                        c * (recon[ind_recon + iy * ngridx + ix + 1] -
-                             recon[ind_recon + iy * ngridx + ix]);
-                    prox0y[ind_recon + iy * ngridx + ix] +=
-                        c * (recon[ind_recon + (iy + 1) * ngridx + ix] -
-                             recon[ind_recon + iy * ngridx + ix]);
-                }
-            for(iy = 0; iy < ngridy - 1; iy++)
-                for(ix = 0; ix < ngridx - 1; ix++)
+            next = NULL;
+            if(tv_3d && s < dy - 1)
+                next = get_tv_slice(state, size, npix, s + 1).xbar;
+            sl = get_tv_slice(state, size, npix, s);
+            for(iy = 0; iy < ngridy; iy++)
+            {
+                for(ix = 0; ix < ngridx; ix++)
                 {
-                    upd = sqrt(prox0x[ind_recon + iy * ngridx + ix] *
-                                   prox0x[ind_recon + iy * ngridx + ix] +
-                               prox0y[ind_recon + iy * ngridx + ix] *
-                                   prox0y[ind_recon + iy * ngridx + ix]) /
-                          lambda;
-                    upd = upd < 1 ? 1 : upd;
-                    prox0x[ind_recon + iy * ngridx + ix] /= upd;
-                    prox0y[ind_recon + iy * ngridx + ix] /= upd;
+                    n = iy * ngridx + ix;
+                    if(outside(mask, n))
+                        continue;
+                    gx = 0.0f;
+                    gy = 0.0f;
+                    gz = 0.0f;
+                    if(ix < ngridx - 1 && !outside(mask, n + 1))
+                        gx = sl.xbar[n + 1] - sl.xbar[n];
+                    if(iy < ngridy - 1 && !outside(mask, n + ngridx))
+                        gy = sl.xbar[n + ngridx] - sl.xbar[n];
+                    if(next != NULL)
+                        gz = next[n] - sl.xbar[n];
+                    sl.prox0x[n] += c * gx;
+                    sl.prox0y[n] += c * gy;
+                    upd = sl.prox0x[n] * sl.prox0x[n] +
+                          sl.prox0y[n] * sl.prox0y[n];
+                    if(tv_3d)
+                    {
+                        sl.prox0z[n] += c * gz;
+                        upd += sl.prox0z[n] * sl.prox0z[n];
+                    }
+                    upd = sqrt(upd) / lambda;
+                    if(upd > 1)
+                    {
+                        sl.prox0x[n] /= upd;
+                        sl.prox0y[n] /= upd;
+                        if(tv_3d)
+                            sl.prox0z[n] /= upd;
+                    }
                 }
+            }
+        }
+
+        // For each slice
+        for(s = 0; s < dy; s++)
+        {
+            below = NULL;
+            if(tv_3d && s > 0)
+                below = get_tv_slice(state, size, npix, s - 1).prox0z;
+            sl = get_tv_slice(state, size, npix, s);
 
             // compute proximal of the projections
             // prox1 = 1*(prox1+c*R(recon)-c*data)/(1+c);
-            preprocessing(ngridx, ngridy, dx, center[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            // initialize sum_dist and update to zero
-            memset(sum_dist, 0, (ngridx * ngridy) * sizeof(float));
-
-            // For each projection angle
-            for(p = 0; p < dt; p++)
+            tracer_slice(&ray, center[s]);
+            tv_project(&ray, theta, dt, dx, sl.xbar, simdata);
+            for(n = 0; n < dt * dx; n++)
             {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmodf(theta[p], 2.0f * (float) M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
-                // For each detector pixel
-                for(d = 0; d < dx; d++)
-                {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = 0.5f * (1 - dx) + d + mov;
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist(ngridx, ngridy, csize, coorx, coory, indi, dist);
-
-                    // Calculate simdata
-                    calc_simdata(s, p, d, ngridx, ngridy, dt, dx, csize, indi,
-                                 dist, recon,
-                                 simdata);  // Output: simdata
-
-                    ind_data = d + p * dx + s * dt * dx;
-                    prox1[ind_data] =
-                        (prox1[ind_data] + c * simdata[ind_data] * r -
-                         c * data[ind_data]) /
-                        (1 + c);
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0f;
-                    for(n = 0; n < csize - 1; n++)
-                    {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indi[n]] += dist[n];
-                    }
-
-                    // adjoint Radon of the prox1 for further computations
-                    // adjdata = R^*(prox1)
-                    if(sum_dist2 != 0.0f)
-                        for(n = 0; n < csize - 1; n++)
-                            adjdata[ind_recon + indi[n]] +=
-                                r * prox1[ind_data] * dist[n];
-                }
+                ind_data = n + s * dt * dx;
+                sl.prox1[n] =
+                    (sl.prox1[n] + c * simdata[n] * r - c * data[ind_data]) /
+                    (1 + c);
             }
 
-            // copy recon = update
-            memcpy(&recon[ind_recon], &update[ind_recon],
-                   ngridx * ngridy * sizeof(float));
+            // adjoint Radon of the prox1 for further computations
+            // adjdata = R^*(prox1)
+            memset(adjdata, 0, npix * sizeof(float));
+            tv_backproject(&ray, theta, dt, dx, r, sl.prox1, adjdata);
 
             // backward step. update with the divergence of prox0 and the
             // adjoint of prox1 update = update-c*R^*(prox1)-c*div(prox0);
+            // then recon = 2*update - recon
+            memcpy(prior, sl.update, npix * sizeof(float));
             for(iy = 0; iy < ngridy; iy++)
+            {
                 for(ix = 0; ix < ngridx; ix++)
                 {
-                    update[ind_recon + iy * ngridx + ix] -=
-                        c * adjdata[ind_recon + iy * ngridx + ix];
-                    if(ix == 0)
-                        update[ind_recon + iy * ngridx + ix] +=
-                            c * prox0x[ind_recon + iy * ngridx + ix];
-                    else
-                        update[ind_recon + iy * ngridx + ix] +=
-                            c * (prox0x[ind_recon + iy * ngridx + ix] -
-                                 prox0x[ind_recon + iy * ngridx + ix - 1]);
-                    if(iy == 0)
-                        update[ind_recon + iy * ngridx + ix] +=
-                            c * prox0y[ind_recon + iy * ngridx + ix];
-                    else
-                        update[ind_recon + iy * ngridx + ix] +=
-                            c * (prox0y[ind_recon + iy * ngridx + ix] -
-                                 prox0y[ind_recon + (iy - 1) * ngridx + ix]);
+                    n   = iy * ngridx + ix;
+                    div = sl.prox0x[n] + sl.prox0y[n];
+                    if(ix > 0)
+                        div -= sl.prox0x[n - 1];
+                    if(iy > 0)
+                        div -= sl.prox0y[n - ngridx];
+                    if(tv_3d)
+                    {
+                        div += sl.prox0z[n];
+                        if(below != NULL)
+                            div -= below[n];
+                    }
+                    sl.update[n] -= c * (adjdata[n] - div);
+                    sl.xbar[n] = 2 * sl.update[n] - prior[n];
                 }
-
-            // update of recon
-            // recon = 2*update - recon
-            for(iy = 0; iy < ngridy; iy++)
-                for(ix = 0; ix < ngridx; ix++)
-                    recon[ind_recon + iy * ngridx + ix] =
-                        2 * update[ind_recon + iy * ngridx + ix] -
-                        recon[ind_recon + iy * ngridx + ix];
+            }
         }
     }
 
     // scale result
     for(s = 0; s < dy; s++)
     {
-        ind_recon = s * ngridx * ngridy;
-        for(iy = 0; iy < ngridy; iy++)
-            for(ix = 0; ix < ngridx; ix++)
-                recon[ind_recon + iy * ngridx + ix] *= r;
+        sl = get_tv_slice(state, size, npix, s);
+        for(n = 0; n < npix; n++)
+            recon[s * npix + n] = r * sl.xbar[n];
     }
 
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indi);
+    free_tracer(&ray);
+    free(owned);
     free(simdata);
-    free(sum_dist);
-    free(update);
-    free(prox0x);
-    free(prox0y);
-    free(prox1);
     free(adjdata);
+    free(prior);
 }
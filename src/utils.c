@@ -43,6 +43,12 @@
 
 #include "utils.h"
 #include <stdint.h>
+#ifndef WIN32
+#    include <pthread.h>
+#endif
+#ifdef _MSC_VER
+#    include <intrin.h>
+#endif
 
 // for windows build
 #ifdef WIN32
@@ -457,3 +463,1242 @@ calc_simdata3(int s, int p, int d, int ry, int rz, int dt, int dx, int csize,
 }
 
 //============================================================================//
+
+int
+get_projector(const char* name)
+{
+    struct
+    {
+        const char* name;
+        const int   model;
+    } prjtbl[] = { { "siddon", PROJ_SIDDON },  // Default
+                   { "joseph", PROJ_JOSEPH },
+                   { "distance", PROJ_DISTANCE } };
+
+    for(int i = 0; i < 3; i++)
+    {
+        if(!strncmp(name, prjtbl[i].name, 16))
+        {
+            return prjtbl[i].model;
+        }
+    }
+    return prjtbl[0].model;
+}
+
+//============================================================================//
+
+void
+init_tracer(ray_tracer* ray, int model, const unsigned char* mask, int ry,
+            int rz, int num_pixels)
+{
+    // Siddon rays cross at most ry + rz pixels, Joseph rays two pixels and
+    // distance-driven footprints three pixels per step of the dominant axis.
+    const int nmax = 3 * (ry + rz) + 2;
+
+    ray->model  = model;
+    ray->mask   = mask;
+    ray->roix   = 0.0f;
+    ray->roiy   = 0.0f;
+    ray->sod    = 0.0f;
+    ray->sdd    = 0.0f;
+    ray->shift  = 0.0f;
+    ray->gather = BACKPROJ_RAY;
+    ray->dt     = 0;
+    ray->resid  = NULL;
+    ray->hits   = NULL;
+    ray->used     = NULL;
+    ray->nthreads = 1;
+    ray->ngridx   = ry;
+    ray->ngridy = rz;
+    ray->dx     = num_pixels;
+    ray->gridx  = (float*) malloc((ry + 1) * sizeof(float));
+    ray->gridy  = (float*) malloc((rz + 1) * sizeof(float));
+    ray->coordx = (float*) malloc((rz + 1) * sizeof(float));
+    ray->coordy = (float*) malloc((ry + 1) * sizeof(float));
+    ray->ax     = (float*) malloc((ry + rz + 2) * sizeof(float));
+    ray->ay     = (float*) malloc((ry + rz + 2) * sizeof(float));
+    ray->bx     = (float*) malloc((ry + rz + 2) * sizeof(float));
+    ray->by     = (float*) malloc((ry + rz + 2) * sizeof(float));
+    ray->coorx  = (float*) malloc((ry + rz + 2) * sizeof(float));
+    ray->coory  = (float*) malloc((ry + rz + 2) * sizeof(float));
+    ray->dist   = (float*) malloc(nmax * sizeof(float));
+    ray->indi   = (int*) malloc(nmax * sizeof(int));
+
+    assert(ray->gridx != NULL && ray->gridy != NULL && ray->coordx != NULL &&
+           ray->coordy != NULL && ray->ax != NULL && ray->ay != NULL &&
+           ray->bx != NULL && ray->by != NULL && ray->coorx != NULL &&
+           ray->coory != NULL && ray->dist != NULL && ray->indi != NULL);
+
+    // Radius of the smallest centered disk holding the support, padded by
+    // half a pixel diagonal.
+    ray->radius = 0.5f * sqrtf((float) (ry * ry + rz * rz)) + 1.0f;
+    if(mask != NULL)
+    {
+        float r2 = -1.0f;
+        for(int ix = 0; ix < ry; ++ix)
+        {
+            for(int iy = 0; iy < rz; ++iy)
+            {
+                float x = ix + 0.5f - 0.5f * ry;
+                float y = iy + 0.5f - 0.5f * rz;
+                if(mask[iy + ix * rz] && x * x + y * y > r2)
+                {
+                    r2 = x * x + y * y;
+                }
+            }
+        }
+        ray->radius = (r2 < 0.0f) ? -1.0f : sqrtf(r2) + 0.7072f;
+    }
+}
+
+//============================================================================//
+
+void
+free_tracer(ray_tracer* ray)
+{
+    free(ray->gridx);
+    free(ray->gridy);
+    free(ray->coordx);
+    free(ray->coordy);
+    free(ray->ax);
+    free(ray->ay);
+    free(ray->bx);
+    free(ray->by);
+    free(ray->coorx);
+    free(ray->coory);
+    free(ray->dist);
+    free(ray->indi);
+    free(ray->resid);
+    free(ray->hits);
+    free(ray->used);
+}
+
+//============================================================================//
+
+void
+tracer_geom(ray_tracer* ray, const float* geom)
+{
+    // The grid is a region of interest whose center is offset by
+    // (geom[0], geom[1]) pixels from the rotation axis. The rays fan out
+    // from a point source geom[2] pixels from the rotation axis to a flat
+    // detector geom[3] pixels from the source, or are parallel when these
+    // are zero.
+    if(geom != NULL)
+    {
+        ray->roix = geom[0];
+        ray->roiy = geom[1];
+        ray->sod  = geom[2];
+        ray->sdd  = geom[3];
+    }
+}
+
+//============================================================================//
+
+void
+tracer_slice(ray_tracer* ray, float center)
+{
+    preprocessing(ray->ngridx, ray->ngridy, ray->dx, center, &ray->mov,
+                  ray->gridx, ray->gridy);
+}
+
+//============================================================================//
+
+void
+tracer_angle(ray_tracer* ray, float theta)
+{
+    float theta_p = fmodf(theta, 2.0f * (float) M_PI);
+    ray->quadrant = calc_quadrant(theta_p);
+    ray->sin_p    = sinf(theta_p);
+    ray->cos_p    = cosf(theta_p);
+    ray->shift    = ray->roix * ray->sin_p - ray->roiy * ray->cos_p;
+}
+
+//============================================================================//
+
+int
+trace_ray(ray_tracer* ray, int d)
+{
+    const int ry       = ray->ngridx;
+    const int rz       = ray->ngridy;
+    float     yi       = 0.5f * (1 - ray->dx) + d + ray->mov + ray->shift;
+    float     sin_p    = ray->sin_p;
+    float     cos_p    = ray->cos_p;
+    float     pitch    = 1.0f;
+    int       quadrant = ray->quadrant;
+    int       csize    = 0;
+
+    if(ray->sdd > 0.0f)
+    {
+        // The ray from the source, sod pixels from the rotation axis along
+        // the projection direction, to the detector pixel crosses the
+        // rotation axis at ui and is turned by the fan angle from the
+        // projection direction, after which it is traced like a parallel
+        // ray. Its detector pixel is pitch wide at the rotation axis.
+        float ui = (yi - ray->shift) * ray->sod / ray->sdd;
+        float h  = sqrtf(ray->sod * ray->sod + ui * ui);
+        float cg = ray->sod / h;
+        float sg = ui / h;
+        sin_p    = ray->sin_p * cg - ray->cos_p * sg;
+        cos_p    = ray->cos_p * cg + ray->sin_p * sg;
+        yi       = ray->roix * sin_p - ray->roiy * cos_p + ui * cg;
+        pitch    = ray->sod / ray->sdd * cg;
+        quadrant = (sin_p * cos_p >= 0.0f);
+    }
+
+    if(fabsf(yi) > ray->radius)
+    {
+        return 0;
+    }
+
+    switch(ray->model)
+    {
+        case PROJ_JOSEPH:
+            calc_joseph(ry, rz, yi, sin_p, cos_p, ray->radius, &csize,
+                        ray->indi, ray->dist);
+            break;
+        case PROJ_DISTANCE:
+            calc_distance(ry, rz, yi, sin_p, cos_p, pitch, ray->radius,
+                          &csize, ray->indi, ray->dist);
+            break;
+        default:
+        {
+            int   asize, bsize;
+            float xi = -ry - rz;
+
+            // Calculate coordinates
+            calc_coords(ry, rz, xi, yi, sin_p, cos_p, ray->gridx, ray->gridy,
+                        ray->coordx, ray->coordy);
+
+            // Merge the (coordx, gridy) and (gridx, coordy)
+            trim_coords(ry, rz, ray->coordx, ray->coordy, ray->gridx,
+                        ray->gridy, &asize, ray->ax, ray->ay, &bsize, ray->bx,
+                        ray->by);
+
+            // Sort the array of intersection points (ax, ay) and
+            // (bx, by). The new sorted intersection points are
+            // stored in (coorx, coory). Total number of points
+            // are csize.
+            sort_intersections(quadrant, asize, ray->ax, ray->ay, bsize,
+                               ray->bx, ray->by, &csize, ray->coorx,
+                               ray->coory);
+
+            // Calculate the distances (dist) between the
+            // intersection points (coorx, coory). Find the
+            // indices of the pixels on the reconstruction grid.
+            if(csize > 1)
+            {
+                calc_dist(ry, rz, csize, ray->coorx, ray->coory, ray->indi,
+                          ray->dist);
+            }
+            break;
+        }
+    }
+
+    // Clip the ray to the support so that pixels outside of it are neither
+    // projected nor updated.
+    if(ray->mask != NULL && csize > 1)
+    {
+        int n, k = 0;
+        for(n = 0; n < csize - 1; n++)
+        {
+            ray->indi[k] = ray->indi[n];
+            ray->dist[k] = ray->dist[n];
+            k += (ray->mask[ray->indi[n]] != 0);
+        }
+        csize = k + 1;
+    }
+    return csize;
+}
+
+//============================================================================//
+
+// Range [beg, end) of the columns (rows) of a grid line of length size
+// whose centers lie on the chord of the ray within radius of the grid
+// center. mid is the coordinate of the point of the ray closest to the
+// center and dir the direction cosine of the ray along the line.
+static inline void
+calc_span(float mid, float radius, float yi, float dir, int size, int* beg,
+          int* end)
+{
+    float h2   = radius * radius - yi * yi;
+    float half = (h2 > 0.0f) ? sqrtf(h2) * fabsf(dir) + 1.0f : 0.0f;
+    float lo   = ceilf(mid - half + 0.5f * size - 0.5f);
+    float hi   = floorf(mid + half + 0.5f * size - 0.5f) + 1.0f;
+
+    *beg = (lo > 0.0f) ? (int) lo : 0;
+    *end = (hi < size) ? (int) hi : size;
+}
+
+//============================================================================//
+
+void
+calc_joseph(int ry, int rz, float yi, float sin_p, float cos_p, float radius,
+            int* csize, int* indi, float* dist)
+{
+    // The ray is the line x * sin_p - y * cos_p = -yi. It is sampled at the
+    // center of every column (row) of the dominant axis and its value is
+    // linearly interpolated between the two neighbouring pixels. Each sample
+    // carries the path length of one step, 1 / |cos_p| (1 / |sin_p|).
+    // Only the chord of the ray within radius of the grid center is traced.
+    int n = 0, beg, end;
+
+    if(fabsf(cos_p) >= fabsf(sin_p))
+    {
+        const float len   = 1.0f / fabsf(cos_p);
+        const float slope = sin_p / cos_p;
+        const float y0 =
+            (yi + (0.5f - 0.5f * ry) * sin_p) / cos_p + 0.5f * rz - 0.5f;
+
+        calc_span(-yi * sin_p, radius, yi, cos_p, ry, &beg, &end);
+        for(int ix = beg; ix < end; ++ix)
+        {
+            float fy = y0 + ix * slope;
+            float fl = floorf(fy);
+            float w  = fy - fl;
+            int   iy = (int) fl;
+
+            if(iy >= 0 && iy < rz)
+            {
+                indi[n]   = iy + ix * rz;
+                dist[n++] = (1.0f - w) * len;
+            }
+            if(iy + 1 >= 0 && iy + 1 < rz)
+            {
+                indi[n]   = iy + 1 + ix * rz;
+                dist[n++] = w * len;
+            }
+        }
+    }
+    else
+    {
+        const float len   = 1.0f / fabsf(sin_p);
+        const float slope = cos_p / sin_p;
+        const float x0 =
+            ((0.5f - 0.5f * rz) * cos_p - yi) / sin_p + 0.5f * ry - 0.5f;
+
+        calc_span(yi * cos_p, radius, yi, sin_p, rz, &beg, &end);
+        for(int iy = beg; iy < end; ++iy)
+        {
+            float fx = x0 + iy * slope;
+            float fl = floorf(fx);
+            float w  = fx - fl;
+            int   ix = (int) fl;
+
+            if(ix >= 0 && ix < ry)
+            {
+                indi[n]   = iy + ix * rz;
+                dist[n++] = (1.0f - w) * len;
+            }
+            if(ix + 1 >= 0 && ix + 1 < ry)
+            {
+                indi[n]   = iy + (ix + 1) * rz;
+                dist[n++] = w * len;
+            }
+        }
+    }
+    *csize = n + 1;
+}
+
+//============================================================================//
+
+// Append the overlaps of [lo, hi] with the unit pixels of one line of
+// the grid of length size, whose pixel k has the index offset + k * stride.
+static inline void
+calc_overlap(float lo, float hi, int size, int offset, int stride, int* n,
+             int* indi, float* dist)
+{
+    float fl = floorf(lo);
+    float fh = floorf(hi);
+    int   k0 = (int) fl;
+    int   k1 = (int) fh;
+
+    if(k1 < 0 || k0 >= size)
+    {
+        return;
+    }
+    if(k0 == k1)
+    {
+        indi[*n]     = offset + k0 * stride;
+        dist[(*n)++] = hi - lo;
+        return;
+    }
+    if(k0 >= 0)
+    {
+        indi[*n]     = offset + k0 * stride;
+        dist[(*n)++] = fl + 1.0f - lo;
+    }
+    for(int k = (k0 + 1 > 0) ? k0 + 1 : 0; k < k1 && k < size; ++k)
+    {
+        indi[*n]     = offset + k * stride;
+        dist[(*n)++] = 1.0f;
+    }
+    if(k1 < size && hi > fh)
+    {
+        indi[*n]     = offset + k1 * stride;
+        dist[(*n)++] = hi - fh;
+    }
+}
+
+void
+calc_distance(int ry, int rz, float yi, float sin_p, float cos_p, float pitch,
+              float radius, int* csize, int* indi, float* dist)
+{
+    // The boundaries of the detector pixel, yi -/+ pitch / 2, are mapped
+    // onto the center line of every column (row) of the dominant axis and
+    // the overlap of the resulting footprint with each pixel is its weight.
+    // The footprint is pitch / |cos_p| (pitch / |sin_p|) wide, and the path
+    // length of one step is 1 / |cos_p| (1 / |sin_p|), so the normalized
+    // overlap is the overlap divided by pitch, which is 1 for parallel rays.
+    // Only the chord of the ray within radius of the grid center is traced.
+    int n = 0, beg, end;
+
+    if(fabsf(cos_p) >= fabsf(sin_p))
+    {
+        const float width = pitch / fabsf(cos_p);
+        const float slope = sin_p / cos_p;
+        const float u0    = (yi + (0.5f - 0.5f * ry) * sin_p) / cos_p +
+                         0.5f * rz - 0.5f * width;
+
+        calc_span(-yi * sin_p, radius, yi, cos_p, ry, &beg, &end);
+        for(int ix = beg; ix < end; ++ix)
+        {
+            float lo = u0 + ix * slope;
+            calc_overlap(lo, lo + width, rz, ix * rz, 1, &n, indi, dist);
+        }
+    }
+    else
+    {
+        const float width = pitch / fabsf(sin_p);
+        const float slope = cos_p / sin_p;
+        const float u0    = ((0.5f - 0.5f * rz) * cos_p - yi) / sin_p +
+                         0.5f * ry - 0.5f * width;
+
+        calc_span(yi * cos_p, radius, yi, sin_p, rz, &beg, &end);
+        for(int iy = beg; iy < end; ++iy)
+        {
+            float lo = u0 + iy * slope;
+            calc_overlap(lo, lo + width, ry, iy, rz, &n, indi, dist);
+        }
+    }
+    if(pitch != 1.0f)
+    {
+        for(int i = 0; i < n; i++)
+            dist[i] /= pitch;
+    }
+    *csize = n + 1;
+}
+
+//============================================================================//
+
+int
+get_backprojector(const char* name)
+{
+    struct
+    {
+        const char* name;
+        const int   mode;
+    } bptbl[] = { { "ray", BACKPROJ_RAY },  // Default
+                  { "pixel", BACKPROJ_PIXEL } };
+
+    for(int i = 0; i < 2; i++)
+    {
+        if(!strncmp(name, bptbl[i].name, 16))
+        {
+            return bptbl[i].mode;
+        }
+    }
+    return bptbl[0].mode;
+}
+
+//============================================================================//
+
+void
+init_backprojector(ray_tracer* ray, int mode, int dt)
+{
+    ray->gather = mode;
+    ray->dt     = dt;
+    if(mode == BACKPROJ_PIXEL)
+    {
+        // Rows are padded with a zero bin on each side of the detector.
+        ray->resid = (float*) calloc(dt * (ray->dx + 2), sizeof(float));
+        ray->hits  = (float*) calloc(dt * (ray->dx + 2), sizeof(float));
+        ray->used  = (unsigned char*) calloc(dt, sizeof(unsigned char));
+        assert(ray->resid != NULL && ray->hits != NULL && ray->used != NULL);
+    }
+}
+
+//============================================================================//
+
+// Add to rows [ix0, ix1) of out (and weight) the linear interpolation of the
+// recorded residuals (and hits) at the detector position of each pixel
+// center, summed over the recorded projections. The rows of a tile only read
+// the sinograms, so tiles are independent and the inner loop over a row is a
+// strided sweep of the detector.
+static void
+gather_rows(const ray_tracer* ray, const float* sin_p, const float* cos_p,
+            float* out, float* weight, int ix0, int ix1)
+{
+    const int ry  = ray->ngridx;
+    const int rz  = ray->ngridy;
+    const int dx  = ray->dx;
+    const int pdx = dx + 2;
+
+    for(int p = 0; p < ray->dt; p++)
+    {
+        if(!ray->used[p])
+            continue;
+
+        // The ray through detector pixel d satisfies
+        // y cos - x sin = 0.5 (1 - dx) + d + mov + shift, see trace_ray.
+        // u is that position plus one, the index into the padded rows.
+        const float* res   = ray->resid + p * pdx;
+        const float* hit   = ray->hits + p * pdx;
+        const float  shift = ray->roix * sin_p[p] - ray->roiy * cos_p[p];
+        const float  u0    = (0.5f - 0.5f * rz) * cos_p[p] -
+                         0.5f * (1 - dx) - ray->mov - shift + 1.0f;
+
+        for(int ix = ix0; ix < ix1; ix++)
+        {
+            const float u   = u0 - (ix + 0.5f - 0.5f * ry) * sin_p[p];
+            float*      dst = out + ix * rz;
+
+            for(int iy = 0; iy < rz; iy++)
+            {
+                float ud = u + iy * cos_p[p];
+                if(ud <= 0.0f || ud >= dx + 1)
+                    continue;
+                int   j = (int) ud;
+                float w = ud - j;
+                dst[iy] += res[j] + w * (res[j + 1] - res[j]);
+                if(weight != NULL)
+                    weight[ix * rz + iy] += hit[j] + w * (hit[j + 1] - hit[j]);
+            }
+        }
+    }
+}
+
+//============================================================================//
+
+// The same for fan-beam rays. The pixel center is projected from the
+// source onto the detector, and the ray density there, the magnification
+// divided by the cosine of the fan angle, weights the gather so that it
+// approximates the ray-driven backprojector.
+static void
+gather_rows_fan(const ray_tracer* ray, const float* sin_p, const float* cos_p,
+                float* out, float* weight, int ix0, int ix1)
+{
+    const int   ry  = ray->ngridx;
+    const int   rz  = ray->ngridy;
+    const int   dx  = ray->dx;
+    const int   pdx = dx + 2;
+    const float u0  = -0.5f * (1 - dx) - ray->mov + 1.0f;
+
+    for(int p = 0; p < ray->dt; p++)
+    {
+        if(!ray->used[p])
+            continue;
+
+        const float* res = ray->resid + p * pdx;
+        const float* hit = ray->hits + p * pdx;
+
+        for(int ix = ix0; ix < ix1; ix++)
+        {
+            const float x   = ix + 0.5f - 0.5f * ry + ray->roix;
+            float*      dst = out + ix * rz;
+
+            for(int iy = 0; iy < rz; iy++)
+            {
+                // Distance along the projection direction from the source
+                // (l) and across it from the rotation axis (s).
+                float y = iy + 0.5f - 0.5f * rz + ray->roiy;
+                float l = ray->sod - x * cos_p[p] - y * sin_p[p];
+                float s = y * cos_p[p] - x * sin_p[p];
+                if(l <= 0.0f)
+                    continue;
+                float ud = u0 + s * ray->sdd / l;
+                if(ud <= 0.0f || ud >= dx + 1)
+                    continue;
+                int   j  = (int) ud;
+                float w  = ud - j;
+                float wt = ray->sdd * sqrtf(l * l + s * s) / (l * l);
+                dst[iy] += wt * (res[j] + w * (res[j + 1] - res[j]));
+                if(weight != NULL)
+                    weight[ix * rz + iy] +=
+                        wt * (hit[j] + w * (hit[j + 1] - hit[j]));
+            }
+        }
+    }
+}
+
+//============================================================================//
+
+// Rows per tile, so that a tile of the slice stays in cache while the
+// projections are swept.
+#define GATHER_TILE 16
+
+typedef struct
+{
+    const ray_tracer* ray;
+    const float*      sin_p;
+    const float*      cos_p;
+    float*            out;
+    float*            weight;
+} gather_args;
+
+// Each tile only writes its own rows, so the threads split the tiles
+// without synchronization and every pixel sums the projections in the same
+// order for any number of threads.
+static void
+gather_thread(thread_team* team, int tid, void* arg)
+{
+    const gather_args* a  = (const gather_args*) arg;
+    const int          ry = a->ray->ngridx;
+    int                t, t0, t1;
+
+    team_range(team, tid, (ry + GATHER_TILE - 1) / GATHER_TILE, &t0, &t1);
+    for(t = t0; t < t1; t++)
+    {
+        int ix0 = t * GATHER_TILE;
+        int ix1 = (ix0 + GATHER_TILE < ry) ? ix0 + GATHER_TILE : ry;
+        if(a->ray->sdd > 0.0f)
+            gather_rows_fan(a->ray, a->sin_p, a->cos_p, a->out, a->weight,
+                            ix0, ix1);
+        else
+            gather_rows(a->ray, a->sin_p, a->cos_p, a->out, a->weight, ix0,
+                        ix1);
+    }
+}
+
+void
+backproject_slice(ray_tracer* ray, const float* theta, float* out,
+                  float* weight)
+{
+    const int ry = ray->ngridx;
+    const int rz = ray->ngridy;
+    const int dx = ray->dx;
+
+    if(ray->gather != BACKPROJ_PIXEL)
+        return;
+
+    float* sin_p = (float*) malloc(ray->dt * sizeof(float));
+    float* cos_p = (float*) malloc(ray->dt * sizeof(float));
+    assert(sin_p != NULL && cos_p != NULL);
+
+    for(int p = 0; p < ray->dt; p++)
+    {
+        float theta_p = fmodf(theta[p], 2.0f * (float) M_PI);
+        sin_p[p]      = sinf(theta_p);
+        cos_p[p]      = cosf(theta_p);
+    }
+
+    gather_args args = {
+        .ray = ray, .sin_p = sin_p, .cos_p = cos_p, .out = out, .weight = weight
+    };
+    run_team(ray->nthreads, gather_thread, &args);
+
+    // Pixels outside of the support stay zero, as with the ray-driven
+    // backprojector.
+    if(ray->mask != NULL)
+    {
+        for(int i = 0; i < ry * rz; i++)
+        {
+            if(!ray->mask[i])
+            {
+                out[i] = 0.0f;
+                if(weight != NULL)
+                    weight[i] = 0.0f;
+            }
+        }
+    }
+
+    for(int p = 0; p < ray->dt; p++)
+    {
+        if(ray->used[p])
+        {
+            memset(ray->resid + p * (dx + 2), 0, (dx + 2) * sizeof(float));
+            memset(ray->hits + p * (dx + 2), 0, (dx + 2) * sizeof(float));
+            ray->used[p] = 0;
+        }
+    }
+
+    free(sin_p);
+    free(cos_p);
+}
+
+//============================================================================//
+
+void
+init_ray_cache(ray_cache* rc, int dt, int dx)
+{
+    rc->dt    = dt;
+    rc->dx    = dx;
+    rc->ready = 0;
+    rc->full  = 0;
+    rc->angle = -1;
+    rc->mov   = 0.0f;
+    rc->size  = 0;
+    rc->cap   = 0;
+    rc->indi  = NULL;
+    rc->dist  = NULL;
+    rc->start = (size_t*) calloc(dt * dx + 1, sizeof(size_t));
+    assert(rc->start != NULL);
+}
+
+//============================================================================//
+
+// Entries held by all the ray caches of the process. The solver calls of a
+// reconstruction run concurrently, and vector keeps several caches per
+// thread, so they share a single RAY_CACHE_BYTES budget.
+static long long ray_cache_entries = 0;
+
+static long long
+ray_cache_add(long long n)
+{
+#if defined(_MSC_VER)
+    return _InterlockedExchangeAdd64(&ray_cache_entries, n);
+#else
+    return __atomic_fetch_add(&ray_cache_entries, n, __ATOMIC_RELAXED);
+#endif
+}
+
+// Take n more entries from the budget, or none and return 0 when it is
+// exhausted.
+static int
+ray_cache_reserve(size_t n)
+{
+    const long long limit = RAY_CACHE_BYTES / (sizeof(int) + sizeof(float));
+
+    if(ray_cache_add((long long) n) + (long long) n <= limit)
+        return 1;
+    ray_cache_add(-(long long) n);
+    return 0;
+}
+
+// Drop the cached rays and give their entries back to the budget
+static void
+ray_cache_release(ray_cache* rc)
+{
+    ray_cache_add(-(long long) rc->cap);
+    free(rc->indi);
+    free(rc->dist);
+    rc->indi = NULL;
+    rc->dist = NULL;
+    rc->size = 0;
+    rc->cap  = 0;
+}
+
+void
+free_ray_cache(ray_cache* rc)
+{
+    ray_cache_release(rc);
+    free(rc->start);
+}
+
+//============================================================================//
+
+// Set up the tracer for the slice with the given rotation axis and cache its
+// rays. Return 1 for a new geometry and 0 when the rays of the previous
+// slice apply, so that images derived from the geometry alone can be kept.
+int
+cache_slice(ray_cache* rc, ray_tracer* ray, const float* theta, float center)
+{
+    tracer_slice(ray, center);
+    if(rc->ready && ray->mov == rc->mov)
+        return 0;
+
+    rc->ready = 1;
+    rc->full  = 0;
+    rc->mov   = ray->mov;
+    rc->size  = 0;
+    for(int p = 0; p < rc->dt; p++)
+    {
+        tracer_angle(ray, theta[p]);
+        rc->angle = p;
+        for(int d = 0; d < rc->dx; d++)
+        {
+            int    csize = trace_ray(ray, d);
+            size_t n     = (csize > 1) ? csize - 1 : 0;
+
+            if(rc->size + n > rc->cap)
+            {
+                // Grow by doubling while the budget allows, else by what
+                // this ray needs. Past the budget, the rays are traced on
+                // every fetch.
+                size_t cap = 2 * (rc->size + n);
+                if(!ray_cache_reserve(cap - rc->cap))
+                {
+                    cap = rc->size + n;
+                    if(!ray_cache_reserve(cap - rc->cap))
+                    {
+                        ray_cache_release(rc);
+                        return 1;
+                    }
+                }
+                rc->cap  = cap;
+                rc->indi = (int*) realloc(rc->indi, rc->cap * sizeof(int));
+                rc->dist = (float*) realloc(rc->dist, rc->cap * sizeof(float));
+                assert(rc->indi != NULL && rc->dist != NULL);
+            }
+            memcpy(rc->indi + rc->size, ray->indi, n * sizeof(int));
+            memcpy(rc->dist + rc->size, ray->dist, n * sizeof(float));
+            rc->size += n;
+            rc->start[p * rc->dx + d + 1] = rc->size;
+        }
+    }
+    rc->full = 1;
+    return 1;
+}
+
+//============================================================================//
+
+// Point indi and dist at the entries of the ray through detector pixel d of
+// projection p, from the cache or freshly traced, and return its csize.
+int
+fetch_ray(ray_cache* rc, ray_tracer* ray, const float* theta, int p, int d,
+          const int** indi, const float** dist)
+{
+    if(rc->full)
+    {
+        size_t i = p * rc->dx + d;
+        *indi    = rc->indi + rc->start[i];
+        *dist    = rc->dist + rc->start[i];
+        return (int) (rc->start[i + 1] - rc->start[i]) + 1;
+    }
+    if(rc->angle != p)
+    {
+        tracer_angle(ray, theta[p]);
+        rc->angle = p;
+    }
+    *indi = ray->indi;
+    *dist = ray->dist;
+    return trace_ray(ray, d);
+}
+
+//============================================================================//
+
+void
+project_rays(ray_cache* rc, ray_tracer* ray, const float* theta,
+             const float* x, float* sino)
+{
+    const int*   indi;
+    const float* dist;
+
+    for(int p = 0; p < rc->dt; p++)
+    {
+        for(int d = 0; d < rc->dx; d++)
+        {
+            int   csize = fetch_ray(rc, ray, theta, p, d, &indi, &dist);
+            float sum   = 0.0f;
+            for(int n = 0; n < csize - 1; n++)
+                sum += x[indi[n]] * dist[n];
+            sino[d + p * rc->dx] = sum;
+        }
+    }
+}
+
+//============================================================================//
+
+void
+backproject_rays(ray_cache* rc, ray_tracer* ray, const float* theta,
+                 const float* sino, float* out)
+{
+    const int*   indi;
+    const float* dist;
+
+    for(int p = 0; p < rc->dt; p++)
+    {
+        for(int d = 0; d < rc->dx; d++)
+        {
+            int   csize = fetch_ray(rc, ray, theta, p, d, &indi, &dist);
+            float upd   = sino[d + p * rc->dx];
+            for(int n = 0; n < csize - 1; n++)
+                out[indi[n]] += upd * dist[n];
+        }
+    }
+}
+
+//============================================================================//
+
+void
+scale_init(const float* data, int dy, int dt, int dx, const float* center,
+           const float* theta, float* recon, int ngridx, int ngridy,
+           const char* projector, const unsigned char* mask, const float* geom,
+           int positive)
+{
+    const int npix = ngridx * ngridy;
+
+    ray_tracer ray;
+    init_tracer(&ray, get_projector(projector), mask, ngridx, ngridy, dx);
+    tracer_geom(&ray, geom);
+
+    ray_cache rc;
+    init_ray_cache(&rc, dt, dx);
+
+    float* sino = (float*) malloc((dt * dx) * sizeof(float));
+    assert(sino != NULL);
+
+    for(int s = 0; s < dy; s++)
+    {
+        const float* b = data + s * dt * dx;
+        float*       x = recon + s * npix;
+
+        for(int n = 0; n < npix; n++)
+            if(outside(mask, n))
+                x[n] = 0.0f;
+
+        // Least-squares scale of the projections of the model to the data
+        cache_slice(&rc, &ray, theta, center[s]);
+        project_rays(&rc, &ray, theta, x, sino);
+        double num = 0.0, den = 0.0;
+        for(int i = 0; i < dt * dx; i++)
+        {
+            num += (double) sino[i] * b[i];
+            den += (double) sino[i] * sino[i];
+        }
+        float c = (den > 0.0) ? (float) (num / den) : 0.0f;
+
+        for(int n = 0; n < npix; n++)
+        {
+            x[n] *= c;
+            if(positive && x[n] < 1e-6f && !outside(mask, n))
+                x[n] = 1e-6f;
+        }
+    }
+
+    free_tracer(&ray);
+    free_ray_cache(&rc);
+    free(sino);
+}
+
+//============================================================================//
+
+// Edge of the cubes copied at once by copy_box
+#define COPY_TILE 8
+
+void
+copy_box(const float* src, const int* sst, float* dst, const int* dst_st,
+         int n0, int n1, int n2)
+{
+    for(int i0 = 0; i0 < n0; i0 += COPY_TILE)
+        for(int i1 = 0; i1 < n1; i1 += COPY_TILE)
+            for(int i2 = 0; i2 < n2; i2 += COPY_TILE)
+            {
+                int e0 = (i0 + COPY_TILE < n0) ? i0 + COPY_TILE : n0;
+                int e1 = (i1 + COPY_TILE < n1) ? i1 + COPY_TILE : n1;
+                int e2 = (i2 + COPY_TILE < n2) ? i2 + COPY_TILE : n2;
+                for(int j0 = i0; j0 < e0; j0++)
+                    for(int j1 = i1; j1 < e1; j1++)
+                    {
+                        const float* in =
+                            src + (size_t) j0 * sst[0] + (size_t) j1 * sst[1];
+                        float* out = dst + (size_t) j0 * dst_st[0] +
+                                     (size_t) j1 * dst_st[1];
+                        for(int j2 = i2; j2 < e2; j2++)
+                            out[(size_t) j2 * dst_st[2]] =
+                                in[(size_t) j2 * sst[2]];
+                    }
+            }
+}
+
+//============================================================================//
+
+void
+subset_range(int dt, int num_block, int os, int* beg, int* end)
+{
+    int len = dt / num_block;
+    int rem = dt % num_block;
+    *beg    = os * len + (os < rem ? os : rem);
+    *end    = *beg + len + (os < rem ? 1 : 0);
+}
+
+//============================================================================//
+
+void
+init_prior(prior_engine* pr, const unsigned char* mask, int dy, int ngridx,
+           int ngridy, int nbr)
+{
+    const int pz = ngridy + 2;
+    const int np = (ngridx + 2) * pz;
+
+    pr->dy     = dy;
+    pr->ngridx = ngridx;
+    pr->ngridy = ngridy;
+    pr->nbr    = (nbr == 26) ? 26 : 8;
+
+    // Neighbors are weighted by their inverse distance; the 8 in-slice ones
+    // give the 1 and 1/sqrt(2) weights of the original stencil.
+    pr->nq = 0;
+    for(int a = -1; a <= 1; a++)
+    {
+        for(int b = -1; b <= 1; b++)
+        {
+            for(int c = -1; c <= 1; c++)
+            {
+                int k = abs(a) + abs(b) + abs(c);
+                if(k == 0 || (a != 0 && pr->nbr == 8))
+                    continue;
+                pr->plane[pr->nq] = 1 + a;
+                pr->off[pr->nq]   = b * pz + c;
+                pr->wq[pr->nq]    = 1.0f / sqrtf((float) k);
+                pr->nq++;
+            }
+        }
+    }
+
+    pr->pad     = (float*) calloc(3 * np, sizeof(float));
+    pr->present = (float*) calloc(np, sizeof(float));
+    pr->valid   = (float*) calloc(np, sizeof(float));
+    pr->zero    = (float*) calloc(np, sizeof(float));
+    pr->sumf    = (float*) malloc(ngridy * sizeof(float));
+    pr->sumg    = (float*) malloc(ngridy * sizeof(float));
+    pr->sumw    = (float*) malloc(ngridy * sizeof(float));
+    assert(pr->pad != NULL && pr->present != NULL && pr->valid != NULL &&
+           pr->zero != NULL && pr->sumf != NULL && pr->sumg != NULL &&
+           pr->sumw != NULL);
+
+    for(int ix = 0; ix < ngridx; ix++)
+    {
+        for(int iy = 0; iy < ngridy; iy++)
+        {
+            int i          = (ix + 1) * pz + iy + 1;
+            pr->present[i] = 1.0f;
+            pr->valid[i]   = outside(mask, iy + ix * ngridy) ? 0.0f : 1.0f;
+        }
+    }
+}
+
+//============================================================================//
+
+void
+free_prior(prior_engine* pr)
+{
+    free(pr->pad);
+    free(pr->present);
+    free(pr->valid);
+    free(pr->zero);
+    free(pr->sumf);
+    free(pr->sumg);
+    free(pr->sumw);
+}
+
+//============================================================================//
+
+// Add the derivative terms of the neighborhood prior of slice s to F and G,
+// which have the size of a slice. Each neighbor q of pixel j adds
+// 2 beta w_q / W_j to F_j and -2 beta w_q / W_j (x_j + x_q) to G_j, where
+// W_j sums the weights of the neighbors on the grid and the hybrid prior
+// damps w_q by 1 / (1 + |x_j - x_q| / delta). Neighbors off the grid or
+// outside the support, and pixels outside the support, add nothing.
+void
+prior_slice(prior_engine* pr, const float* recon, int s, int type,
+            const float* reg_pars, float* F, float* G)
+{
+    const int    ry    = pr->ngridx;
+    const int    rz    = pr->ngridy;
+    const int    pz    = rz + 2;
+    const int    np    = (ry + 2) * pz;
+    const float  beta  = reg_pars[0];
+    const float  delta = (type == PRIOR_HYBRID) ? reg_pars[1] : 1.0f;
+    float*       sf    = pr->sumf;
+    float*       sg    = pr->sumg;
+    float*       sw    = pr->sumw;
+    const float* pres[3];
+    const float* val[3];
+
+    // Copy the slices of the stencil into the interior of their planes. The
+    // ghosts are never written and stay zero.
+    for(int k = 0; k < 3; k++)
+    {
+        int t = s + k - 1;
+        if(t < 0 || t >= pr->dy || (pr->nbr == 8 && k != 1))
+        {
+            pres[k] = pr->zero;
+            val[k]  = pr->zero;
+            continue;
+        }
+        pres[k] = pr->present;
+        val[k]  = pr->valid;
+        for(int ix = 0; ix < ry; ix++)
+        {
+            memcpy(pr->pad + k * np + (ix + 1) * pz + 1,
+                   recon + (t * ry + ix) * rz, rz * sizeof(float));
+        }
+    }
+
+    for(int ix = 0; ix < ry; ix++)
+    {
+        const int    row = (ix + 1) * pz + 1;
+        const float* uc  = pr->pad + np + row;
+        const float* vc  = pr->valid + row;
+
+        memset(sf, 0, rz * sizeof(float));
+        memset(sg, 0, rz * sizeof(float));
+        memset(sw, 0, rz * sizeof(float));
+
+        // One sweep along the row per neighbor keeps the inner loops free
+        // of branches and indirect indexing.
+        for(int q = 0; q < pr->nq; q++)
+        {
+            const int    k  = pr->plane[q];
+            const int    o  = row + pr->off[q];
+            const float* un = pr->pad + k * np + o;
+            const float* pn = pres[k] + o;
+            const float* vn = val[k] + o;
+            const float  w  = pr->wq[q];
+
+            if(type == PRIOR_HYBRID)
+            {
+#pragma omp simd
+                for(int iy = 0; iy < rz; iy++)
+                {
+                    float g = w * vn[iy] /
+                              (1.0f + fabsf((uc[iy] - un[iy]) / delta));
+                    sf[iy] += g;
+                    sg[iy] += g * (uc[iy] + un[iy]);
+                    sw[iy] += w * pn[iy];
+                }
+            }
+            else
+            {
+#pragma omp simd
+                for(int iy = 0; iy < rz; iy++)
+                {
+                    float g = w * vn[iy];
+                    sf[iy] += g;
+                    sg[iy] += g * (uc[iy] + un[iy]);
+                    sw[iy] += w * pn[iy];
+                }
+            }
+        }
+
+#pragma omp simd
+        for(int iy = 0; iy < rz; iy++)
+        {
+            float c = (sw[iy] > 0.0f) ? 2.0f * beta * vc[iy] / sw[iy] : 0.0f;
+            F[ix * rz + iy] += c * sf[iy];
+            G[ix * rz + iy] -= c * sg[iy];
+        }
+    }
+}
+
+//============================================================================//
+
+struct thread_team
+{
+    int nthreads;
+#ifndef WIN32
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             waiting;     // threads waiting at the barrier
+    int             generation;  // barriers passed so far
+    int             started;     // the size of the team is final
+#endif
+};
+
+typedef struct
+{
+    thread_team* team;
+    int          tid;
+    void (*work)(thread_team*, int, void*);
+    void* arg;
+} team_member;
+
+#ifndef WIN32
+static void*
+team_main(void* member)
+{
+    team_member* m    = (team_member*) member;
+    thread_team* team = m->team;
+
+    // Wait until every thread was created and the team size is known
+    pthread_mutex_lock(&team->lock);
+    while(!team->started)
+        pthread_cond_wait(&team->cond, &team->lock);
+    pthread_mutex_unlock(&team->lock);
+
+    m->work(team, m->tid, m->arg);
+    return NULL;
+}
+#endif
+
+void
+run_team(int nthreads, void (*work)(thread_team*, int, void*), void* arg)
+{
+    thread_team team;
+    team.nthreads = (nthreads > 1) ? nthreads : 1;
+#ifdef WIN32
+    team.nthreads = 1;
+#else
+    pthread_mutex_init(&team.lock, NULL);
+    pthread_cond_init(&team.cond, NULL);
+    team.waiting    = 0;
+    team.generation = 0;
+    team.started    = 0;
+
+    pthread_t*   threads =
+        (pthread_t*) malloc(team.nthreads * sizeof(pthread_t));
+    team_member* members =
+        (team_member*) malloc(team.nthreads * sizeof(team_member));
+    if(threads == NULL || members == NULL)
+        team.nthreads = 1;
+
+    // A thread that can not be created ends the team there, before any
+    // member starts working on the final size.
+    int created = 1;
+    for(int t = 1; t < team.nthreads; t++)
+    {
+        members[t].team = &team;
+        members[t].tid  = t;
+        members[t].work = work;
+        members[t].arg  = arg;
+        if(pthread_create(&threads[t], NULL, team_main, &members[t]) != 0)
+            break;
+        created++;
+    }
+    pthread_mutex_lock(&team.lock);
+    team.nthreads = created;
+    team.started  = 1;
+    pthread_cond_broadcast(&team.cond);
+    pthread_mutex_unlock(&team.lock);
+#endif
+
+    work(&team, 0, arg);
+
+#ifndef WIN32
+    for(int t = 1; t < team.nthreads; t++)
+        pthread_join(threads[t], NULL);
+    free(threads);
+    free(members);
+    pthread_cond_destroy(&team.cond);
+    pthread_mutex_destroy(&team.lock);
+#endif
+}
+
+void
+team_barrier(thread_team* team)
+{
+#ifndef WIN32
+    if(team->nthreads == 1)
+        return;
+    pthread_mutex_lock(&team->lock);
+    int generation = team->generation;
+    if(++team->waiting == team->nthreads)
+    {
+        team->waiting = 0;
+        team->generation++;
+        pthread_cond_broadcast(&team->cond);
+    }
+    else
+    {
+        while(generation == team->generation)
+            pthread_cond_wait(&team->cond, &team->lock);
+    }
+    pthread_mutex_unlock(&team->lock);
+#endif
+}
+
+int
+team_size(const thread_team* team)
+{
+    return team->nthreads;
+}
@@ -1,872 +1,310 @@
-// Copyright (c) 2015, UChicago Argonne, LLC. All rights reserved.
-
-// Copyright 2015. UChicago Argonne, LLC. This software was produced
-// under U.S. Government contract DE-AC02-06CH11357 for Argonne National
-// Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
-// U.S. Department of Energy. The U.S. Government has rights to use,
-// reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
-// UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
-// ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
-// modified to produce derivative works, such modified software should
-// be clearly marked, so as not to confuse it with the version available
-// from ANL.
-
-// Additionally, redistribution and use in source and binary forms, with
-// or without modification, are permitted provided that the following
-// conditions are met:
-
-//     * Redistributions of source code must retain the above copyright
-//       notice, this list of conditions and the following disclaimer.
-
-//     * Redistributions in binary form must reproduce the above copyright
-//       notice, this list of conditions and the following disclaimer in
-//       the documentation and/or other materials provided with the
-//       distribution.
-
-//     * Neither the name of UChicago Argonne, LLC, Argonne National
-//       Laboratory, ANL, the U.S. Government, nor the names of its
-//       contributors may be used to endorse or promote products derived
-//       from this software without specific prior written permission.
-
-// THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
-// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
-// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
-// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
-// Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
-// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
-// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
-// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
-// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
-// LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN
-// ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
-// POSSIBILITY OF SUCH DAMAGE.
-
-#include "utils.h"
-
-void
-vector(const float* data, int dy, int dt, int dx, const float* center,
-       const float* theta, float* recon1, float* recon2, int ngridx, int ngridy,
-       int num_iter)
-{
-    float* gridx  = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indx   = (int*) malloc((ngridx + ngridy + 1) * sizeof(int));
-    int*   indy   = (int*) malloc((ngridx + ngridy + 1) * sizeof(int));
-
-    assert(gridx != NULL && gridy != NULL && coordx != NULL && coordy != NULL &&
-           ax != NULL && ay != NULL && by != NULL && bx != NULL &&
-           coorx != NULL && coory != NULL && dist != NULL && indx != NULL &&
-           indy != NULL);
-
-    int    s, p, d, i, n, m;
-    int    quadrant;
-    float  theta_p, sin_p, cos_p;
-    float  mov, xi, yi;
-    int    asize, bsize, csize;
-    float* simdata;
-    float  upd;
-    int    ind_data;
-    float  srcx, srcy, detx, dety, dv, vx, vy;
-    float* sum_dist;
-    float  sum_dist2;
-    float *update1, *update2;
-
-    for(i = 0; i < num_iter; i++)
-    {
-        simdata = (float*) calloc((dt * dy * dx), sizeof(float));
-
-        // For each slice
-        for(s = 0; s < dy; s++)
-        {
-            preprocessing(ngridx, ngridy, dx, center[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            sum_dist = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update1  = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update2  = (float*) calloc((ngridx * ngridy), sizeof(float));
-
-            // For each projection angle
-            for(p = 0; p < dt; p++)
-            {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmod(theta[p], 2 * M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
-                // For each detector pixel
-                for(d = 0; d < dx; d++)
-                {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = (1 - dx) / 2.0 + d + mov;
-
-                    srcx = xi * cos_p - yi * sin_p;
-                    srcy = xi * sin_p + yi * cos_p;
-                    detx = -xi * cos_p - yi * sin_p;
-                    dety = -xi * sin_p + yi * cos_p;
-
-                    dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-                    vx = (srcx - detx) / dv;
-                    vy = (srcy - dety) / dv;
-
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist2(ngridx, ngridy, csize, coorx, coory, indx, indy,
-                               dist);
-
-                    // Calculate simdata
-                    calc_simdata2(s, p, d, ngridx, ngridy, dt, dx, csize, indx,
-                                  indy, dist, vx, vy, recon1, recon2,
-                                  simdata);  // Output: simdata
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0;
-                    for(n = 0; n < csize - 1; n++)
-                    {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indy[n] + indx[n] * ngridy] += dist[n];
-                    }
-
-                    // Update
-                    if(sum_dist2 != 0.0)
-                    {
-                        ind_data = d + p * dx + s * dt * dx;
-                        upd = (data[ind_data] - simdata[ind_data]) / sum_dist2;
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            update1[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vx;
-                            update2[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vy;
-                        }
-                    }
-                }
-            }
-
-            for(m = 0; m < ngridx; m++)
-            {
-                for(n = 0; n < ngridy; n++)
-                {
-                    recon1[n + m * ngridy + s * ngridx * ngridy] +=
-                        update1[n + m * ngridy] / sum_dist[n + m * ngridy];
-                    recon2[n + m * ngridy + s * ngridx * ngridy] +=
-                        update1[n + m * ngridy] / sum_dist[n + m * ngridy];
-                }
-            }
-
-            free(sum_dist);
-            free(update1);
-            free(update2);
-        }
-
-        free(simdata);
-    }
-
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indx);
-    free(indy);
-}
-
-void
-vector2(const float* data1, const float* data2, int dy, int dt, int dx,
-        const float* center1, const float* center2, const float* theta1,
-        const float* theta2, float* recon1, float* recon2, float* recon3,
-        int ngridx, int ngridy, int num_iter, int axis1, int axis2)
-{
-    float* gridx  = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indx   = (int*) malloc((ngridx + ngridy + 1) * sizeof(int));
-    int*   indy   = (int*) malloc((ngridx + ngridy + 1) * sizeof(int));
-
-    assert(gridx != NULL && gridy != NULL && coordx != NULL && coordy != NULL &&
-           ax != NULL && ay != NULL && by != NULL && bx != NULL &&
-           coorx != NULL && coory != NULL && dist != NULL && indx != NULL &&
-           indy != NULL);
-
-    int    s, p, d, i, n, m;
-    int    quadrant;
-    float  theta_p, sin_p, cos_p;
-    float  mov, xi, yi;
-    int    asize, bsize, csize;
-    float* simdata;
-    float  upd;
-    int    ind_data;
-    float  srcx, srcy, detx, dety, dv, vx, vy;
-    float* sum_dist;
-    float  sum_dist2;
-    float *update1, *update2;
-
-    for(i = 0; i < num_iter; i++)
-    {
-        printf("iter=%d\n", i);
-
-        simdata = (float*) calloc((dt * dy * dx), sizeof(float));
-
-        // For each slice
-        for(s = 0; s < dy; s++)
-        {
-            preprocessing(ngridx, ngridy, dx, center1[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            sum_dist = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update1  = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update2  = (float*) calloc((ngridx * ngridy), sizeof(float));
-
-            // For each projection angle
-            for(p = 0; p < dt; p++)
-            {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmod(theta1[p], 2 * M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
-                // For each detector pixel
-                for(d = 0; d < dx; d++)
-                {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = (1 - dx) / 2.0 + d + mov;
-
-                    srcx = xi * cos_p - yi * sin_p;
-                    srcy = xi * sin_p + yi * cos_p;
-                    detx = -xi * cos_p - yi * sin_p;
-                    dety = -xi * sin_p + yi * cos_p;
-
-                    dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-                    vx = (srcx - detx) / dv;
-                    vy = (srcy - dety) / dv;
-
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist2(ngridx, ngridy, csize, coorx, coory, indx, indy,
-                               dist);
-
-                    // Calculate simdata
-                    calc_simdata3(s, p, d, ngridx, ngridy, dt, dx, csize, indx,
-                                  indy, dist, vx, vy, recon1, recon2, recon3,
-                                  axis1,
-                                  simdata);  // Output: simdata
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0;
-                    for(n = 0; n < csize - 1; n++)
-                    {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indy[n] + indx[n] * ngridy] += dist[n];
-                    }
-
-                    // Update
-                    if(sum_dist2 != 0.0)
-                    {
-                        ind_data = d + p * dx + s * dt * dx;
-                        upd = (data1[ind_data] - simdata[ind_data]) / sum_dist2;
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            update1[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vx;
-                            update2[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vy;
-                        }
-                    }
-                }
-            }
-
-            for(m = 0; m < ngridx; m++)
-            {
-                for(n = 0; n < ngridy; n++)
-                {
-                    if(sum_dist[n + m * ngridy] != 0.0)
-                    {
-                        recon2[s + m * ngridy + n * ngridx * ngridy] +=
-                            update1[n + m * ngridy] / sum_dist[n + m * ngridy];
-                        recon3[s + m * ngridy + n * ngridx * ngridy] +=
-                            update2[n + m * ngridy] / sum_dist[n + m * ngridy];
-                    }
-                }
-            }
-
-            free(sum_dist);
-            free(update1);
-            free(update2);
-        }
-
-        free(simdata);
-
-        simdata = (float*) calloc((dt * dy * dx), sizeof(float));
-
-        // For each slice
-        for(s = 0; s < dy; s++)
-        {
-            preprocessing(ngridx, ngridy, dx, center1[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            sum_dist = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update1  = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update2  = (float*) calloc((ngridx * ngridy), sizeof(float));
-
-            // For each projection angle
-            for(p = 0; p < dt; p++)
-            {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmod(theta1[p], 2 * M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
-                // For each detector pixel
-                for(d = 0; d < dx; d++)
-                {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = (1 - dx) / 2.0 + d + mov;
-
-                    srcx = xi * cos_p - yi * sin_p;
-                    srcy = xi * sin_p + yi * cos_p;
-                    detx = -xi * cos_p - yi * sin_p;
-                    dety = -xi * sin_p + yi * cos_p;
-
-                    dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-                    vx = (srcx - detx) / dv;
-                    vy = (srcy - dety) / dv;
-
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist2(ngridx, ngridy, csize, coorx, coory, indx, indy,
-                               dist);
-
-                    // Calculate simdata
-                    calc_simdata3(s, p, d, ngridx, ngridy, dt, dx, csize, indx,
-                                  indy, dist, vx, vy, recon1, recon2, recon3,
-                                  axis2,
-                                  simdata);  // Output: simdata
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0;
-                    for(n = 0; n < csize - 1; n++)
-                    {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indy[n] + indx[n] * ngridy] += dist[n];
-                    }
-
-                    // Update
-                    if(sum_dist2 != 0.0)
-                    {
-                        ind_data = d + p * dx + s * dt * dx;
-                        upd = (data2[ind_data] - simdata[ind_data]) / sum_dist2;
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            update1[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vx;
-                            update2[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vy;
-                        }
-                    }
-                }
-            }
-
-            for(m = 0; m < ngridx; m++)
-            {
-                for(n = 0; n < ngridy; n++)
-                {
-                    if(sum_dist[n + m * ngridy] != 0.0)
-                    {
-                        recon1[m + s * ngridy + n * ngridx * ngridy] +=
-                            update1[n + m * ngridy] / sum_dist[n + m * ngridy];
-                        recon3[m + s * ngridy + n * ngridx * ngridy] +=
-                            update2[n + m * ngridy] / sum_dist[n + m * ngridy];
-                    }
-                }
-            }
-
-            free(sum_dist);
-            free(update1);
-            free(update2);
-        }
-
-        free(simdata);
-    }
-
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indx);
-    free(indy);
-}
-
-void
-vector3(const float* data1, const float* data2, const float* data3, int dy,
-        int dt, int dx, const float* center1, const float* center2,
-        const float* center3, const float* theta1, const float* theta2,
-        const float* theta3, float* recon1, float* recon2, float* recon3,
-        int ngridx, int ngridy, int num_iter, int axis1, int axis2, int axis3)
-{
-    float* gridx  = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* gridy  = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordx = (float*) malloc((ngridy + 1) * sizeof(float));
-    float* coordy = (float*) malloc((ngridx + 1) * sizeof(float));
-    float* ax     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* ay     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* bx     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* by     = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coorx  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* coory  = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    float* dist   = (float*) malloc((ngridx + ngridy) * sizeof(float));
-    int*   indx   = (int*) malloc((ngridx + ngridy + 1) * sizeof(int));
-    int*   indy   = (int*) malloc((ngridx + ngridy + 1) * sizeof(int));
-
-    assert(gridx != NULL && gridy != NULL && coordx != NULL && coordy != NULL &&
-           ax != NULL && ay != NULL && by != NULL && bx != NULL &&
-           coorx != NULL && coory != NULL && dist != NULL && indx != NULL &&
-           indy != NULL);
-
-    int    s, p, d, i, n, m;
-    int    quadrant;
-    float  theta_p, sin_p, cos_p;
-    float  mov, xi, yi;
-    int    asize, bsize, csize;
-    float* simdata;
-    float  upd;
-    int    ind_data;
-    float  srcx, srcy, detx, dety, dv, vx, vy;
-    float* sum_dist;
-    float  sum_dist2;
-    float *update1, *update2;
-
-    for(i = 0; i < num_iter; i++)
-    {
-        printf("iter=%d\n", i);
-
-        simdata = (float*) calloc((dt * dy * dx), sizeof(float));
-
-        // For each slice
-        for(s = 0; s < dy; s++)
-        {
-            preprocessing(ngridx, ngridy, dx, center1[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            sum_dist = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update1  = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update2  = (float*) calloc((ngridx * ngridy), sizeof(float));
-
-            // For each projection angle
-            for(p = 0; p < dt; p++)
-            {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmod(theta1[p], 2 * M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
-                // For each detector pixel
-                for(d = 0; d < dx; d++)
-                {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = (1 - dx) / 2.0 + d + mov;
-
-                    srcx = xi * cos_p - yi * sin_p;
-                    srcy = xi * sin_p + yi * cos_p;
-                    detx = -xi * cos_p - yi * sin_p;
-                    dety = -xi * sin_p + yi * cos_p;
-
-                    dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-                    vx = (srcx - detx) / dv;
-                    vy = (srcy - dety) / dv;
-
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist2(ngridx, ngridy, csize, coorx, coory, indx, indy,
-                               dist);
-
-                    // Calculate simdata
-                    calc_simdata3(s, p, d, ngridx, ngridy, dt, dx, csize, indx,
-                                  indy, dist, vx, vy, recon1, recon2, recon3,
-                                  axis1,
-                                  simdata);  // Output: simdata
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0;
-                    for(n = 0; n < csize - 1; n++)
-                    {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indy[n] + indx[n] * ngridy] += dist[n];
-                    }
-
-                    // Update
-                    if(sum_dist2 != 0.0)
-                    {
-                        ind_data = d + p * dx + s * dt * dx;
-                        upd = (data1[ind_data] - simdata[ind_data]) / sum_dist2;
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            update1[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vx;
-                            update2[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vy;
-                        }
-                    }
-                }
-            }
-
-            for(m = 0; m < ngridx; m++)
-            {
-                for(n = 0; n < ngridy; n++)
-                {
-                    if(sum_dist[n + m * ngridy] != 0.0)
-                    {
-                        recon1[n + m * ngridy + s * ngridx * ngridy] +=
-                            update1[n + m * ngridy] / sum_dist[n + m * ngridy];
-                        recon2[n + m * ngridy + s * ngridx * ngridy] +=
-                            update2[n + m * ngridy] / sum_dist[n + m * ngridy];
-                    }
-                }
-            }
-
-            free(sum_dist);
-            free(update1);
-            free(update2);
-        }
-
-        free(simdata);
-
-        simdata = (float*) calloc((dt * dy * dx), sizeof(float));
-
-        // For each slice
-        for(s = 0; s < dy; s++)
-        {
-            preprocessing(ngridx, ngridy, dx, center1[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            sum_dist = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update1  = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update2  = (float*) calloc((ngridx * ngridy), sizeof(float));
-
-            // For each projection angle
-            for(p = 0; p < dt; p++)
-            {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmod(theta1[p], 2 * M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
-                // For each detector pixel
-                for(d = 0; d < dx; d++)
-                {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = (1 - dx) / 2.0 + d + mov;
-
-                    srcx = xi * cos_p - yi * sin_p;
-                    srcy = xi * sin_p + yi * cos_p;
-                    detx = -xi * cos_p - yi * sin_p;
-                    dety = -xi * sin_p + yi * cos_p;
-
-                    dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-                    vx = (srcx - detx) / dv;
-                    vy = (srcy - dety) / dv;
-
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist2(ngridx, ngridy, csize, coorx, coory, indx, indy,
-                               dist);
-
-                    // Calculate simdata
-                    calc_simdata3(s, p, d, ngridx, ngridy, dt, dx, csize, indx,
-                                  indy, dist, vx, vy, recon1, recon2, recon3,
-                                  axis2,
-                                  simdata);  // Output: simdata
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0;
-                    for(n = 0; n < csize - 1; n++)
-                    {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indy[n] + indx[n] * ngridy] += dist[n];
-                    }
-
-                    // Update
-                    if(sum_dist2 != 0.0)
-                    {
-                        ind_data = d + p * dx + s * dt * dx;
-                        upd = (data2[ind_data] - simdata[ind_data]) / sum_dist2;
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            update1[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vx;
-                            update2[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vy;
-                        }
-                    }
-                }
-            }
-
-            for(m = 0; m < ngridx; m++)
-            {
-                for(n = 0; n < ngridy; n++)
-                {
-                    if(sum_dist[n + m * ngridy] != 0.0)
-                    {
-                        recon2[s + m * ngridy + n * ngridx * ngridy] +=
-                            update1[n + m * ngridy] / sum_dist[n + m * ngridy];
-                        recon3[s + m * ngridy + n * ngridx * ngridy] +=
-                            update2[n + m * ngridy] / sum_dist[n + m * ngridy];
-                    }
-                }
-            }
-
-            free(sum_dist);
-            free(update1);
-            free(update2);
-        }
-
-        free(simdata);
-
-        simdata = (float*) calloc((dt * dy * dx), sizeof(float));
-
-        // For each slice
-        for(s = 0; s < dy; s++)
-        {
-            preprocessing(ngridx, ngridy, dx, center1[s], &mov, gridx,
-                          gridy);  // Outputs: mov, gridx, gridy
-
-            sum_dist = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update1  = (float*) calloc((ngridx * ngridy), sizeof(float));
-            update2  = (float*) calloc((ngridx * ngridy), sizeof(float));
-
-            // For each projection angle
-            for(p = 0; p < dt; p++)
-            {
-                // Calculate the sin and cos values
-                // of the projection angle and find
-                // at which quadrant on the cartesian grid.
-                theta_p  = fmod(theta1[p], 2 * M_PI);
-                quadrant = calc_quadrant(theta_p);
-                sin_p    = sinf(theta_p);
-                cos_p    = cosf(theta_p);
-
-                // For each detector pixel
-                for(d = 0; d < dx; d++)
-                {
-                    // Calculate coordinates
-                    xi = -ngridx - ngridy;
-                    yi = (1 - dx) / 2.0 + d + mov;
-
-                    srcx = xi * cos_p - yi * sin_p;
-                    srcy = xi * sin_p + yi * cos_p;
-                    detx = -xi * cos_p - yi * sin_p;
-                    dety = -xi * sin_p + yi * cos_p;
-
-                    dv = sqrt(pow(srcx - detx, 2) + pow(srcy - dety, 2));
-                    vx = (srcx - detx) / dv;
-                    vy = (srcy - dety) / dv;
-
-                    calc_coords(ngridx, ngridy, xi, yi, sin_p, cos_p, gridx,
-                                gridy, coordx, coordy);
-
-                    // Merge the (coordx, gridy) and (gridx, coordy)
-                    trim_coords(ngridx, ngridy, coordx, coordy, gridx, gridy,
-                                &asize, ax, ay, &bsize, bx, by);
-
-                    // Sort the array of intersection points (ax, ay) and
-                    // (bx, by). The new sorted intersection points are
-                    // stored in (coorx, coory). Total number of points
-                    // are csize.
-                    sort_intersections(quadrant, asize, ax, ay, bsize, bx, by,
-                                       &csize, coorx, coory);
-
-                    // Calculate the distances (dist) between the
-                    // intersection points (coorx, coory). Find the
-                    // indices of the pixels on the reconstruction grid.
-                    calc_dist2(ngridx, ngridy, csize, coorx, coory, indx, indy,
-                               dist);
-
-                    // Calculate simdata
-                    calc_simdata3(s, p, d, ngridx, ngridy, dt, dx, csize, indx,
-                                  indy, dist, vx, vy, recon1, recon2, recon3,
-                                  axis3,
-                                  simdata);  // Output: simdata
-
-                    // Calculate dist*dist
-                    sum_dist2 = 0.0;
-                    for(n = 0; n < csize - 1; n++)
-                    {
-                        sum_dist2 += dist[n] * dist[n];
-                        sum_dist[indy[n] + indx[n] * ngridy] += dist[n];
-                    }
-
-                    // Update
-                    if(sum_dist2 != 0.0)
-                    {
-                        ind_data = d + p * dx + s * dt * dx;
-                        upd = (data3[ind_data] - simdata[ind_data]) / sum_dist2;
-                        for(n = 0; n < csize - 1; n++)
-                        {
-                            update1[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vx;
-                            update2[indy[n] + indx[n] * ngridy] +=
-                                upd * dist[n] * vy;
-                        }
-                    }
-                }
-            }
-
-            for(m = 0; m < ngridx; m++)
-            {
-                for(n = 0; n < ngridy; n++)
-                {
-                    if(sum_dist[n + m * ngridy] != 0.0)
-                    {
-                        recon1[m + s * ngridy + n * ngridx * ngridy] +=
-                            update1[n + m * ngridy] / sum_dist[n + m * ngridy];
-                        recon3[m + s * ngridy + n * ngridx * ngridy] +=
-                            update2[n + m * ngridy] / sum_dist[n + m * ngridy];
-                    }
-                }
-            }
-
-            free(sum_dist);
-            free(update1);
-            free(update2);
-        }
-
-        free(simdata);
-    }
-
-    free(gridx);
-    free(gridy);
-    free(coordx);
-    free(coordy);
-    free(ax);
-    free(ay);
-    free(bx);
-    free(by);
-    free(coorx);
-    free(coory);
-    free(dist);
-    free(indx);
-    free(indy);
-}
+// Copyright (c) 2015, UChicago Argonne, LLC. All rights reserved.
+
+// Copyright 2015. UChicago Argonne, LLC. This software was produced
+// under U.S. Government contract DE-AC02-06CH11357 for Argonne National
+// Laboratory (ANL), which is operated by UChicago Argonne, LLC for the
+// U.S. Department of Energy. The U.S. Government has rights to use,
+// reproduce, and distribute this software.  NEITHER THE GOVERNMENT NOR
+// UChicago Argonne, LLC MAKES ANY WARRANTY, EXPRESS OR IMPLIED, OR
+// ASSUMES ANY LIABILITY FOR THE USE OF THIS SOFTWARE.  If software is
+// modified to produce derivative works, such modified software should
+// be clearly marked, so as not to confuse it with the version available
+// from ANL.
+
+// Additionally, redistribution and use in source and binary forms, with
+// or without modification, are permitted provided that the following
+// conditions are met:
+
+//     * Redistributions of source code must retain the above copyright
+//       notice, this list of conditions and the following disclaimer.
+
+//     * Redistributions in binary form must reproduce the above copyright
+//       notice, this list of conditions and the following disclaimer in
+//       the documentation and/or other materials provided with the
+//       distribution.
+
+//     * Neither the name of UChicago Argonne, LLC, Argonne National
+//       Laboratory, ANL, the U.S. Government, nor the names of its
+//       contributors may be used to endorse or promote products derived
+//       from this software without specific prior written permission.
+
+// THIS SOFTWARE IS PROVIDED BY UChicago Argonne, LLC AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+// FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL UChicago
+// Argonne, LLC OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+// INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+// BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+// LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+// CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+#include "utils.h"
+
+// One dataset of a vector reconstruction: its sinograms, the rotation
+// centers and angles of its scan, and the axis of the volume normal to its
+// slices. The two components of the field across that axis are the ones
+// its projections measure: x and y for axis 0, y and z for axis 1, and x
+// and z for axis 2.
+typedef struct
+{
+    const float* data;
+    const float* center;
+    const float* theta;
+    int          axis;
+    int          geom;  // first dataset with the same angles
+} vector_set;
+
+typedef struct
+{
+    const vector_set* set;
+    int               nset;
+    int               dy;
+    int               dt;
+    int               dx;
+    float*            recon[3];
+    int               ngridx;
+    int               ngridy;
+    int               num_iter;
+} vector_args;
+
+// Rays of the datasets sharing their angles, traced once for all slices
+// with the same rotation center and every iteration, with the sum of the
+// ray lengths through each pixel, which depends on the geometry alone.
+typedef struct
+{
+    ray_tracer ray;
+    ray_cache  cache;
+    float*     sum_dist;
+} vector_geom;
+
+// Number of slices copied out of the volume at once
+#define VECTOR_BLOCK 16
+
+// Each dataset in turn updates its two components slice by slice. Blocks of
+// slices are copied into contiguous planes holding the two components of
+// each pixel side by side, so that a single pass over the traced ray both
+// projects and backprojects them, and the copies along axes 1 and 2 move
+// whole cache lines. The slices of a dataset are disjoint and split between
+// the threads, which wait for each other before the next dataset cuts the
+// volume along another axis.
+static void
+vector_thread(thread_team* team, int tid, void* arg)
+{
+    const vector_args* a    = (const vector_args*) arg;
+    const int          npix = a->ngridx * a->ngridy;
+    const int          dt   = a->dt;
+    const int          dx   = a->dx;
+
+    vector_geom geom[3];
+    for(int k = 0; k < a->nset; k++)
+    {
+        if(a->set[k].geom != k)
+            continue;
+        init_tracer(&geom[k].ray, PROJ_SIDDON, NULL, a->ngridx, a->ngridy,
+                    dx);
+        init_ray_cache(&geom[k].cache, dt, dx);
+        geom[k].sum_dist = (float*) malloc(npix * sizeof(float));
+        assert(geom[k].sum_dist != NULL);
+    }
+
+    float* slab   = (float*) malloc(VECTOR_BLOCK * 2 * npix * sizeof(float));
+    float* update = (float*) malloc(2 * npix * sizeof(float));
+    float* vx     = (float*) malloc(dt * sizeof(float));
+    float* vy     = (float*) malloc(dt * sizeof(float));
+
+    assert(slab != NULL && update != NULL && vx != NULL && vy != NULL);
+
+    // Strides of the slab: slice, row and column
+    const int pst[3] = { 2 * npix, 2 * a->ngridy, 2 };
+
+    int beg, end;
+    team_range(team, tid, a->dy, &beg, &end);
+
+    for(int i = 0; i < a->num_iter; i++)
+    {
+        for(int k = 0; k < a->nset; k++)
+        {
+            const vector_set* set = a->set + k;
+            vector_geom*      g   = geom + set->geom;
+            float*            r0;
+            float*            r1;
+            int               c0, c1;
+            int               st[3];
+
+            field_comps(set->axis, &c0, &c1);
+            field_strides(set->axis, a->ngridx, a->ngridy, st);
+            r0 = a->recon[c0];
+            r1 = a->recon[c1];
+
+            // The rays run against the direction of the projection
+            for(int p = 0; p < dt; p++)
+            {
+                float theta_p = fmodf(set->theta[p], 2.0f * (float) M_PI);
+                vx[p]         = -cosf(theta_p);
+                vy[p]         = -sinf(theta_p);
+            }
+
+            for(int b0 = beg; b0 < end; b0 += VECTOR_BLOCK)
+            {
+                int nb = (end - b0 < VECTOR_BLOCK) ? end - b0 : VECTOR_BLOCK;
+
+                copy_box(r0 + (size_t) b0 * st[0], st, slab, pst, nb,
+                         a->ngridx, a->ngridy);
+                copy_box(r1 + (size_t) b0 * st[0], st, slab + 1, pst, nb,
+                         a->ngridx, a->ngridy);
+
+                for(int s = b0; s < b0 + nb; s++)
+                {
+                    const float* data  = set->data + s * dt * dx;
+                    float*       plane = slab + (s - b0) * 2 * npix;
+                    const int*   indi;
+                    const float* dist;
+
+                    int fresh = cache_slice(&g->cache, &g->ray, set->theta,
+                                            set->center[s]);
+                    if(fresh)
+                        memset(g->sum_dist, 0, npix * sizeof(float));
+                    memset(update, 0, 2 * npix * sizeof(float));
+
+                    for(int p = 0; p < dt; p++)
+                    {
+                        for(int d = 0; d < dx; d++)
+                        {
+                            int csize =
+                                fetch_ray(&g->cache, &g->ray, set->theta, p,
+                                          d, &indi, &dist);
+
+                            float sim       = 0.0f;
+                            float sum_dist2 = 0.0f;
+                            for(int n = 0; n < csize - 1; n++)
+                            {
+                                const float* w = plane + 2 * indi[n];
+                                sim += (w[0] * vx[p] + w[1] * vy[p]) * dist[n];
+                                sum_dist2 += dist[n] * dist[n];
+                            }
+                            if(fresh)
+                                for(int n = 0; n < csize - 1; n++)
+                                    g->sum_dist[indi[n]] += dist[n];
+
+                            if(sum_dist2 != 0.0f)
+                            {
+                                float upd =
+                                    (data[d + p * dx] - sim) / sum_dist2;
+                                float ux = upd * vx[p];
+                                float uy = upd * vy[p];
+                                for(int n = 0; n < csize - 1; n++)
+                                {
+                                    float* u = update + 2 * indi[n];
+                                    u[0] += ux * dist[n];
+                                    u[1] += uy * dist[n];
+                                }
+                            }
+                        }
+                    }
+
+                    for(int j = 0; j < npix; j++)
+                    {
+                        if(g->sum_dist[j] == 0.0f)
+                            continue;
+                        plane[2 * j] += update[2 * j] / g->sum_dist[j];
+                        plane[2 * j + 1] += update[2 * j + 1] / g->sum_dist[j];
+                    }
+                }
+
+                copy_box(slab, pst, r0 + (size_t) b0 * st[0], st, nb,
+                         a->ngridx, a->ngridy);
+                copy_box(slab + 1, pst, r1 + (size_t) b0 * st[0], st, nb,
+                         a->ngridx, a->ngridy);
+            }
+
+            team_barrier(team);
+        }
+    }
+
+    for(int k = 0; k < a->nset; k++)
+    {
+        if(a->set[k].geom != k)
+            continue;
+        free_tracer(&geom[k].ray);
+        free_ray_cache(&geom[k].cache);
+        free(geom[k].sum_dist);
+    }
+    free(slab);
+    free(update);
+    free(vx);
+    free(vy);
+}
+
+static void
+vector_run(vector_set* set, int nset, int dy, int dt, int dx, float* recon1,
+           float* recon2, float* recon3, int ngridx, int ngridy, int num_iter,
+           int num_thread)
+{
+    // Datasets with the same angles share their rays
+    for(int k = 0; k < nset; k++)
+    {
+        set[k].geom = k;
+        for(int j = 0; j < k; j++)
+        {
+            if(!memcmp(set[j].theta, set[k].theta, dt * sizeof(float)))
+            {
+                set[k].geom = j;
+                break;
+            }
+        }
+        if(set[k].axis != 0)
+            assert(dy == ngridx && dy == ngridy);
+    }
+
+    vector_args args = { .set      = set,
+                         .nset     = nset,
+                         .dy       = dy,
+                         .dt       = dt,
+                         .dx       = dx,
+                         .recon    = { recon1, recon2, recon3 },
+                         .ngridx   = ngridx,
+                         .ngridy   = ngridy,
+                         .num_iter = num_iter };
+
+    run_team((num_thread > 1) ? num_thread : 1, vector_thread, &args);
+}
+
+void
+vector(const float* data, int dy, int dt, int dx, const float* center,
+       const float* theta, float* recon1, float* recon2, int ngridx,
+       int ngridy, int num_iter, int num_thread)
+{
+    vector_set set[1] = { { data, center, theta, 0, 0 } };
+
+    vector_run(set, 1, dy, dt, dx, recon1, recon2, NULL, ngridx, ngridy,
+               num_iter, num_thread);
+}
+
+void
+vector2(const float* data1, const float* data2, int dy, int dt, int dx,
+        const float* center1, const float* center2, const float* theta1,
+        const float* theta2, float* recon1, float* recon2, float* recon3,
+        int ngridx, int ngridy, int num_iter, int axis1, int axis2,
+        int num_thread)
+{
+    vector_set set[2] = { { data1, center1, theta1, axis1, 0 },
+                          { data2, center2, theta2, axis2, 0 } };
+
+    vector_run(set, 2, dy, dt, dx, recon1, recon2, recon3, ngridx, ngridy,
+               num_iter, num_thread);
+}
+
+void
+vector3(const float* data1, const float* data2, const float* data3, int dy,
+        int dt, int dx, const float* center1, const float* center2,
+        const float* center3, const float* theta1, const float* theta2,
+        const float* theta3, float* recon1, float* recon2, float* recon3,
+        int ngridx, int ngridy, int num_iter, int axis1, int axis2, int axis3,
+        int num_thread)
+{
+    vector_set set[3] = { { data1, center1, theta1, axis1, 0 },
+                          { data2, center2, theta2, axis2, 0 },
+                          { data3, center3, theta3, axis3, 0 } };
+
+    vector_run(set, 3, dy, dt, dx, recon1, recon2, recon3, ngridx, ngridy,
+               num_iter, num_thread);
+}
@@ -51,8 +51,11 @@ from __future__ import (absolute_import, division, print_function,
 
 import unittest
 from tomopy.misc.phantom import baboon, barbara, cameraman, checkerboard, \
-    lena, peppers, shepp2d, shepp3d
+    lena, peppers, shepp2d, shepp3d, _ellipsoid, _define_coords, \
+    _array_to_params, _get_shepp_array
 from numpy.testing import assert_array_equal as assert_equals
+from numpy.testing import assert_allclose
+import numpy as np
 
 __author__ = "Doga Gursoy"
 __copyright__ = "Copyright (c) 2015, UChicago Argonne, LLC."
@@ -107,3 +110,18 @@ class TestDistributeJobs(unittest.TestCase):
         assert_equals(shepp3d(size=(6, 8, 10)).shape, (6, 8, 10))
         assert_equals(shepp3d(size=(6, 8, 10)).min(), 0)
         assert_equals(shepp3d(size=6).shape, (6, 6, 6))
+
+    def test_shepp3d_ellipsoids(self):
+        # The rasterizer matches the ellipsoids evaluated on the full grid
+        params = _array_to_params(_get_shepp_array())
+        for size in ((6, 8, 10), (1, 32, 32), (33, 20, 17)):
+            ref = np.zeros(size, dtype='float32')
+            coords = _define_coords(size)
+            for param in params:
+                _ellipsoid(param, out=ref, coords=coords)
+            assert_equals(shepp3d(size), ref.clip(0, np.inf))
+        # Supersampling keeps the volume of the ellipsoids
+        obj = shepp3d(32)
+        aa = shepp3d(32, supersample=3)
+        assert_allclose(aa.sum(), obj.sum(), rtol=2e-2)
+        self.assertGreater(np.unique(aa).size, np.unique(obj).size)
@@ -50,9 +50,11 @@ from __future__ import (absolute_import, division, print_function,
                         unicode_literals)
 
 import unittest
-from tomopy.prep.normalize import normalize, normalize_bg, normalize_nf
+import numpy as np
+from tomopy.prep.normalize import (minus_log, normalize, normalize_bg,
+                                   normalize_nf, normalize_dynamic)
 from ..util import read_file
-from numpy.testing import assert_allclose
+from numpy.testing import assert_allclose, assert_array_equal
 
 __author__ = "Doga Gursoy"
 __copyright__ = "Copyright (c) 2015, UChicago Argonne, LLC."
@@ -68,6 +70,21 @@ class NormalizationTestCase(unittest.TestCase):
                 read_file('dark.npy')),
             read_file('normalize.npy'))
 
+    def test_normalize_fused(self):
+        rng = np.random.RandomState(0)
+        tomo = rng.randint(0, 4096, size=(6, 5, 7)).astype('uint16')
+        flat = rng.randint(2048, 4096, size=(3, 5, 7)).astype('uint16')
+        dark = rng.randint(0, 64, size=(2, 5, 7)).astype('uint16')
+        tomo[0, 0, 0] = 0
+        ref = normalize(tomo.astype('float32'), flat, dark, cutoff=0.9)
+        assert_array_equal(normalize(tomo, flat, dark, cutoff=0.9), ref)
+        ref = minus_log(ref)
+        ref[~np.isfinite(ref)] = 5
+        res = normalize(tomo, flat, dark, cutoff=0.9, minus_log=True,
+                        nonfinite=5, sinogram_order=True)
+        assert_allclose(res, ref.swapaxes(0, 1), rtol=1e-6)
+        self.assertEqual(res[0, 0, 0], 5)
+
     def test_normalize_bg(self):
         assert_allclose(
             normalize_bg(read_file('tomo.npy')),
@@ -81,3 +98,21 @@ class NormalizationTestCase(unittest.TestCase):
                 read_file('dark.npy'),
                 (0, 4, 8, 12, 16)),
             read_file('normalize_nf.npy'))
+
+    def test_normalize_dynamic(self):
+        # Flats and projections mix the same two beam patterns with
+        # random weights; the fitted flats recover the smooth object.
+        rng = np.random.RandomState(1)
+        y, x = np.mgrid[:64, :96]
+        base = 1000 * (1 + 0.2 * np.sin(x / 3.))
+        modes = np.array([np.sin(x / 8. + y / 10.), np.cos(y / 6.)])
+        obj = np.exp(-0.5 * np.exp(-((x - 48)**2 + (y - 32)**2) / 400.))
+        flat = base * (1 + np.tensordot(rng.randn(20, 2) * 0.1, modes, 1))
+        tomo = obj * base * (
+            1 + np.tensordot(rng.randn(10, 2) * 0.1, modes, 1))
+        flat += rng.randn(*flat.shape) * 5 + 50
+        tomo += rng.randn(*tomo.shape) * 5 + 50
+        dark = np.full((2, 64, 96), 50.)
+        err = np.abs(normalize(tomo, flat, dark) - obj).mean()
+        res = normalize_dynamic(tomo, flat, dark)
+        self.assertLess(np.abs(res - obj).mean(), 0.2 * err)
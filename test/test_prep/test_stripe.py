@@ -50,9 +50,14 @@ from __future__ import (absolute_import, division, print_function,
                         unicode_literals)
 
 import unittest
-from tomopy.prep.stripe import remove_stripe_fw, remove_stripe_ti
+import numpy as np
+from scipy.ndimage import median_filter, uniform_filter1d
+from tomopy.prep.stripe import (remove_stripe_fw, remove_stripe_sf,
+                                remove_stripe_ti, remove_stripe_based_sorting,
+                                remove_large_stripe, remove_dead_stripe,
+                                remove_all_stripe)
 from ..util import read_file
-from numpy.testing import assert_allclose
+from numpy.testing import assert_allclose, assert_array_equal
 
 __author__ = "Doga Gursoy"
 __copyright__ = "Copyright (c) 2015, UChicago Argonne, LLC."
@@ -69,3 +74,42 @@ class StripeRemovalTestCase(unittest.TestCase):
         assert_allclose(
             remove_stripe_ti(read_file('proj.npy')),
             read_file('remove_stripe_ti.npy'), rtol=1e-2)
+
+    def test_remove_stripe_sf(self):
+        proj = read_file('proj.npy')
+        avg = proj.mean(axis=0, dtype='float64')
+        ref = proj - (avg - uniform_filter1d(avg, 5, mode='nearest'))
+        orig = proj.copy()
+        assert_allclose(
+            remove_stripe_sf(proj, size=5, ncore=2), ref,
+            rtol=1e-4, atol=1e-5)
+        assert_array_equal(proj, orig)
+
+    def test_remove_stripe_based_sorting(self):
+        proj = read_file('proj.npy')
+        idx = np.argsort(proj, axis=0, kind='stable')
+        sort = np.take_along_axis(proj, idx, axis=0)
+        ref = np.empty_like(proj)
+        np.put_along_axis(ref, idx, median_filter(sort, (1, 1, 5)), axis=0)
+        orig = proj.copy()
+        assert_allclose(
+            remove_stripe_based_sorting(proj, size=5, ncore=2), ref)
+        assert_array_equal(proj, orig)
+
+    def test_remove_stripe_sorting_suite(self):
+        rng = np.random.RandomState(3)
+        y, x = np.mgrid[:180, :128]
+        sino = np.exp(-(x - 64)**2 / 300.) * (1 + 0.3 * np.sin(y / 20.))
+        clean = 1 + 0.5 * sino[:, None, :].astype('float32')
+        proj = clean + rng.rand(180, 2, 128).astype('float32') * 0.05
+        proj[:, :, 20] *= 1.3
+        proj[:, :, 50] = 0.8
+        proj[:, :, 100] += rng.rand(180, 2).astype('float32') * 0.8
+        orig = proj.copy()
+        for func, tol in ((remove_large_stripe, 0.1),
+                          (remove_dead_stripe, 0.05),
+                          (remove_all_stripe, 0.05)):
+            err = np.abs(func(proj, ncore=2) - clean)
+            self.assertLess(err[:, :, (20, 50, 100)].mean(axis=(0, 1)).max(),
+                            tol)
+            assert_array_equal(proj, orig)
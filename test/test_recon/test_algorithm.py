@@ -51,8 +51,11 @@ from __future__ import (absolute_import, division, print_function,
 
 import unittest
 from ..util import read_file
-from tomopy.recon.algorithm import recon
-from numpy.testing import assert_allclose
+from tomopy.recon.algorithm import recon, ReconState
+from tomopy.misc.corr import _get_mask
+from tomopy.misc.phantom import shepp3d
+from tomopy.sim.project import project, angles
+from numpy.testing import assert_allclose, assert_array_equal
 import numpy as np
 
 __author__ = "Doga Gursoy"
@@ -75,6 +78,61 @@ class ReconstructionAlgorithmTestCase(unittest.TestCase):
             recon(self.prj, self.ang, algorithm='bart', num_iter=4),
             read_file('bart.npy'), rtol=1e-2)
 
+    def test_bart_block(self):
+        assert_allclose(
+            recon(self.prj, self.ang, algorithm='bart', num_iter=4,
+                  num_block=4),
+            read_file('bart_block.npy'), rtol=1e-2)
+
+    def test_num_thread(self):
+        # Threads share the rays of a slice without changing the result
+        for projector in ('siddon', 'joseph'):
+            rec = recon(self.prj, self.ang, algorithm='bart', num_iter=2,
+                        projector=projector, num_thread=1)
+            assert_allclose(
+                recon(self.prj, self.ang, algorithm='bart', num_iter=2,
+                      projector=projector, num_thread=3),
+                rec, rtol=1e-4, atol=1e-6)
+            # art visits the rays in another order on several threads
+            rec = recon(self.prj, self.ang, algorithm='art', num_iter=2,
+                        projector=projector, num_thread=2)
+            assert_allclose(
+                recon(self.prj, self.ang, algorithm='art', num_iter=2,
+                      projector=projector, num_thread=3),
+                rec, rtol=1e-4, atol=1e-6)
+            assert_allclose(
+                recon(self.prj, self.ang, algorithm='art', num_iter=2,
+                      projector=projector, num_thread=1),
+                rec, atol=5e-2 * np.abs(rec).max())
+        assert_allclose(
+            recon(self.prj, self.ang, algorithm='bart', num_iter=2,
+                  num_block=4, backprojector='pixel', num_thread=3),
+            recon(self.prj, self.ang, algorithm='bart', num_iter=2,
+                  num_block=4, backprojector='pixel', num_thread=1),
+            rtol=1e-4, atol=1e-6)
+
+    def test_cgls_lsqr(self):
+        obj = shepp3d(64)[30:32]
+        ang = angles(90)
+        prj = project(obj, ang, pad=False)
+        prj += np.random.RandomState(0).normal(0, 0.2, prj.shape)
+        # An eighth of the operator applications of sirt
+        sirt = recon(prj, ang, algorithm='sirt', num_iter=100)
+        err = np.abs(sirt - obj).mean()
+        cgls = recon(prj, ang, algorithm='cgls', num_iter=12)
+        lsqr = recon(prj, ang, algorithm='lsqr', num_iter=12)
+        self.assertLess(np.abs(cgls - obj).mean(), err)
+        assert_allclose(lsqr, cgls, atol=1e-2 * np.abs(cgls).max())
+        # Damping shrinks the solution
+        for algorithm in ('cgls', 'lsqr'):
+            rec = recon(prj, ang, algorithm=algorithm, num_iter=12, damp=2.0)
+            self.assertLess(np.abs(rec).sum(), np.abs(cgls).sum())
+            # A loose tolerance stops early
+            full = recon(prj, ang, algorithm=algorithm, num_iter=30)
+            rec = recon(prj, ang, algorithm=algorithm, num_iter=30, tol=0.1)
+            self.assertGreater(np.abs(rec - full).max(),
+                               1e-2 * np.abs(full).max())
+
     def test_fbp(self):
         assert_allclose(
             recon(self.prj, self.ang, algorithm='fbp'),
@@ -118,11 +176,76 @@ class ReconstructionAlgorithmTestCase(unittest.TestCase):
             recon(self.prj, self.ang, algorithm='mlem', num_iter=4),
             read_file('mlem.npy'), rtol=1e-2)
 
+    def test_mlem_center(self):
+        # The rays cached for a slice are traced again when the rotation
+        # axis changes between slices.
+        center = np.array([23.5, 23.5, 24.5, 23.5], dtype='float32')
+        prj = self.prj[:, :4]
+        for algorithm in ('mlem', 'osem'):
+            rec = recon(prj, self.ang, center=center, algorithm=algorithm,
+                        num_iter=4, ncore=1)
+            for s in range(4):
+                assert_allclose(
+                    rec[s],
+                    recon(prj[:, s:s + 1], self.ang, center=center[s],
+                          algorithm=algorithm, num_iter=4)[0],
+                    rtol=1e-6)
+
     def test_osem(self):
         assert_allclose(
             recon(self.prj, self.ang, algorithm='osem', num_iter=4),
             read_file('osem.npy'), rtol=1e-2)
 
+    def test_osem_block(self):
+        assert_allclose(
+            recon(self.prj, self.ang, algorithm='osem', num_iter=4,
+                  num_block=4),
+            read_file('osem_block.npy'), rtol=1e-2)
+
+    def test_ossart(self):
+        # ossart is another name of bart
+        assert_array_equal(
+            recon(self.prj, self.ang, algorithm='ossart', num_iter=2,
+                  num_block=4, subset_order='golden'),
+            recon(self.prj, self.ang, algorithm='bart', num_iter=2,
+                  num_block=4, subset_order='golden'))
+        # A single subset is sirt
+        assert_allclose(
+            recon(self.prj, self.ang, algorithm='ossart', num_iter=4),
+            recon(self.prj, self.ang, algorithm='sirt', num_iter=4),
+            rtol=1e-4, atol=1e-6)
+        obj = shepp3d(64)[30:32]
+        ang = angles(90)
+        prj = project(obj, ang, pad=False)
+        # Two passes over ten subsets beat ten sirt iterations
+        sirt = recon(prj, ang, algorithm='sirt', num_iter=10)
+        for order in ('sequential', 'bit-reversal', 'golden'):
+            rec = recon(prj, ang, algorithm='ossart', num_iter=2, num_block=10,
+                        subset_order=order)
+            self.assertLess(np.abs(rec - obj).mean(),
+                            np.abs(sirt - obj).mean())
+
+    def test_subset_order(self):
+        obj = shepp3d(64)[30:32]
+        ang = angles(90)
+        prj = project(obj, ang, pad=False)
+        mlem = recon(prj, ang, algorithm='mlem', num_iter=10)
+        for order in ('contiguous', 'sequential', 'bit-reversal', 'golden',
+                      'random'):
+            rec = recon(prj, ang, algorithm='osem', num_iter=2, num_block=10,
+                        subset_order=order)
+            self.assertLess(np.abs(rec - obj).mean(),
+                            np.abs(mlem - obj).mean())
+        # Equal rows of ind_block act as a single order
+        ind = np.random.RandomState(1).permutation(90)
+        assert_allclose(
+            recon(prj, ang, algorithm='bart', num_iter=2, num_block=3,
+                  ind_block=np.stack([ind, ind])),
+            recon(prj, ang, algorithm='bart', num_iter=2, num_block=3,
+                  ind_block=ind), rtol=1e-6)
+        self.assertRaises(
+            ValueError, recon, prj, ang, algorithm='osem', num_block=91)
+
     def test_ospml_hybrid(self):
         assert_allclose(
             recon(self.prj, self.ang, algorithm='ospml_hybrid', num_iter=4),
@@ -143,17 +266,195 @@ class ReconstructionAlgorithmTestCase(unittest.TestCase):
             recon(self.prj, self.ang, algorithm='pml_quad', num_iter=4),
             read_file('pml_quad.npy'), rtol=1e-2)
 
+    def test_pml_neighbors(self):
+        # A single slice has no neighbors across slices
+        prj = self.prj[:, :1]
+        for algorithm in ('pml_quad', 'ospml_hybrid'):
+            assert_allclose(
+                recon(prj, self.ang, algorithm=algorithm, num_iter=4,
+                      neighbors=26),
+                recon(prj, self.ang, algorithm=algorithm, num_iter=4),
+                rtol=1e-5, atol=1e-6)
+            rec = recon(self.prj, self.ang, algorithm=algorithm, num_iter=4,
+                        neighbors=26, ncore=1)
+            self.assertTrue(np.all(np.isfinite(rec)))
+        self.assertRaises(ValueError, recon, self.prj, self.ang,
+                          algorithm='pml_quad', neighbors=4)
+
     def test_sirt(self):
         assert_allclose(
             recon(self.prj, self.ang, algorithm='sirt', num_iter=4),
             read_file('sirt.npy'), rtol=1e-2)
 
+    def test_sirt_projector(self):
+        ref = read_file('sirt.npy')
+        for projector in ('joseph', 'distance'):
+            assert_allclose(
+                recon(self.prj, self.ang, algorithm='sirt', num_iter=4,
+                      projector=projector),
+                ref, atol=0.1 * ref.max())
+        self.assertRaises(ValueError, recon, self.prj, self.ang,
+                          algorithm='sirt', projector='josef')
+
+    def test_backprojector(self):
+        ref = read_file('fbp.npy')
+        assert_allclose(
+            recon(self.prj, self.ang, algorithm='fbp', backprojector='pixel'),
+            ref, atol=0.1 * ref.max())
+        for algorithm in ('sirt', 'mlem'):
+            ref = read_file(algorithm + '.npy')
+            assert_allclose(
+                recon(self.prj, self.ang, algorithm=algorithm, num_iter=4,
+                      backprojector='pixel'),
+                ref, atol=0.1 * ref.max())
+        self.assertRaises(ValueError, recon, self.prj, self.ang,
+                          algorithm='sirt', backprojector='pixels')
+
+    def test_support(self):
+        shape = (self.prj.shape[2], self.prj.shape[2])
+        for algorithm in ('sirt', 'pml_quad', 'tv'):
+            assert_allclose(
+                recon(self.prj, self.ang, algorithm=algorithm, num_iter=4,
+                      support=np.ones(shape, dtype=bool)),
+                read_file(algorithm + '.npy'), rtol=1e-2)
+            rec = recon(self.prj, self.ang, algorithm=algorithm, num_iter=4,
+                        support=0.8)
+            self.assertTrue(np.all(rec[:, ~_get_mask(shape[0], shape[1],
+                                                     0.8)] == 0))
+
+    def test_roi(self):
+        roi = (10, 14, 20, 16)
+        sub = np.s_[:, 10:30, 14:30]
+        for algorithm in ('gridrec', 'fbp'):
+            assert_allclose(
+                recon(self.prj, self.ang, algorithm=algorithm, roi=roi),
+                recon(self.prj, self.ang, algorithm=algorithm)[sub],
+                rtol=1e-3, atol=1e-5)
+        # The interior problem needs enough angles for the exterior model.
+        obj = shepp3d(64)[30:32]
+        ang = angles(128)
+        prj = project(obj, ang)
+        roi = (16, 20, 24, 24)
+        sub = np.s_[:, 16:40, 20:44]
+        for algorithm in ('sirt', 'mlem'):
+            full = recon(prj, ang, algorithm=algorithm, num_iter=10,
+                         num_gridx=64, num_gridy=64)
+            rec = recon(prj, ang, algorithm=algorithm, num_iter=10,
+                        num_gridx=64, num_gridy=64, roi=roi)
+            self.assertEqual(rec.shape, (2, 24, 24))
+            self.assertLess(np.abs(rec - obj[sub]).mean(),
+                            1.2 * np.abs(full[sub] - obj[sub]).mean())
+
+    def test_fold_360(self):
+        obj = shepp3d(64)[30:32]
+        ang = angles(360, 0, 359)
+        prj = project(obj, ang)
+        for algorithm in ('gridrec', 'sirt'):
+            ref = recon(prj[:180], ang[:180], algorithm=algorithm)
+            assert_allclose(
+                recon(prj, ang, algorithm=algorithm, fold_360=True),
+                ref, atol=1e-4 * np.abs(ref).max())
+        # Offset rotation axis, 8 pixels from the left edge of the detector
+        cut = prj.shape[2] // 2 - 8
+        rec = recon(prj[..., cut:], ang, center=8, algorithm='gridrec',
+                    fold_360=True)
+        n = rec.shape[1]
+        ref = recon(prj[:180], ang[:180], algorithm='gridrec', num_gridx=n,
+                    num_gridy=n)
+        assert_allclose(rec, ref, atol=1e-4 * np.abs(ref).max())
+
     def test_tv(self):
         assert_allclose(
             recon(self.prj, self.ang, algorithm='tv', num_iter=4),
             read_file('tv.npy'), rtol=1e-2)
 
+    def test_tv_3d(self):
+        # Noisy projections of a volume that is constant along the slices
+        obj = np.repeat(shepp3d(64)[32:33], 4, axis=0)
+        ang = angles(90)
+        prj = project(obj, ang, pad=False)
+        prj += np.random.RandomState(0).normal(0, 0.5, prj.shape)
+        reg = np.array([1.0], dtype='float32')
+        rec2 = recon(prj, ang, algorithm='tv', num_iter=20, reg_par=reg,
+                     ncore=1)
+        rec3 = recon(prj, ang, algorithm='tv', num_iter=20, reg_par=reg,
+                     ncore=1, tv_3d=True)
+        self.assertLess(np.abs(np.diff(rec3, axis=0)).mean(),
+                        0.5 * np.abs(np.diff(rec2, axis=0)).mean())
+        # A single slice has no neighbors to couple
+        assert_allclose(
+            recon(self.prj[:, :1], self.ang, algorithm='tv', num_iter=4,
+                  tv_3d=True),
+            read_file('tv.npy')[:1], rtol=1e-5, atol=1e-6)
+
     def test_grad(self):
         assert_allclose(
             recon(self.prj, self.ang, algorithm='grad', num_iter=4),
             read_file('grad.npy'), rtol=1e-2)
+
+    def test_init_gridrec(self):
+        obj = shepp3d(64)[30:32]
+        ang = angles(90)
+        prj = project(obj, ang, pad=False)
+        # Two thirds of the iterations from gridrec do better than from scratch
+        cold = recon(prj, ang, algorithm='mlem', num_iter=15)
+        warm = recon(prj, ang, algorithm='mlem', num_iter=10,
+                     init_recon='gridrec')
+        self.assertLess(np.abs(warm - obj).mean(), np.abs(cold - obj).mean())
+        self.assertGreater(warm.min(), 0)
+        with self.assertRaises(ValueError):
+            recon(prj, ang, algorithm='fbp', init_recon='gridrec')
+
+    def test_fan(self):
+        obj = shepp3d(64)[30:32]
+        ang = angles(180, 0, 360)
+        geom = {'source_distance': 80, 'detector_distance': 160}
+        prj = project(obj, ang, **geom)
+        for algorithm in ('sirt', 'mlem'):
+            fan = recon(prj, ang, algorithm=algorithm, num_iter=10,
+                        num_gridx=64, num_gridy=64, **geom)
+            par = recon(prj, ang, algorithm=algorithm, num_iter=10,
+                        num_gridx=64, num_gridy=64)
+            self.assertLess(np.abs(fan - obj).mean(),
+                            0.5 * np.abs(par - obj).mean())
+        with self.assertRaises(ValueError):
+            recon(prj, ang, algorithm='sirt', roi=(16, 16, 32, 32), **geom)
+        # The pixel-driven gather splits its tiles between the threads
+        geom = {'source_distance': 80, 'detector_distance': 160}
+        assert_allclose(
+            recon(prj, ang, algorithm='bart', num_iter=2, num_block=4,
+                  backprojector='pixel', num_gridx=64, num_gridy=64,
+                  num_thread=3, **geom),
+            recon(prj, ang, algorithm='bart', num_iter=2, num_block=4,
+                  backprojector='pixel', num_gridx=64, num_gridy=64,
+                  num_thread=1, **geom),
+            rtol=1e-4, atol=1e-6)
+        # Converging rays are not split between threads by art
+        for geom in ({'source_distance': 100, 'detector_distance': 200},
+                     {'source_distance': 150, 'detector_distance': 450}):
+            prj = project(obj, ang, **geom)
+            assert_array_equal(
+                recon(prj, ang, algorithm='art', num_iter=2, num_gridx=64,
+                      num_gridy=64, num_thread=3, **geom),
+                recon(prj, ang, algorithm='art', num_iter=2, num_gridx=64,
+                      num_gridy=64, num_thread=1, **geom))
+
+    def test_state(self):
+        # Two calls with a state continue where the first one stopped
+        for algorithm in ('tv', 'grad'):
+            state = ReconState()
+            recon(self.prj, self.ang, algorithm=algorithm, num_iter=4,
+                  state=state)
+            self.assertTrue(state.started)
+            rec = recon(self.prj, self.ang, algorithm=algorithm, num_iter=4,
+                        state=state)
+            assert_allclose(
+                rec, recon(self.prj, self.ang, algorithm=algorithm,
+                           num_iter=8), rtol=1e-4, atol=1e-6)
+            # A different projector starts over from the initial guess
+            rec = recon(self.prj, self.ang, algorithm=algorithm, num_iter=4,
+                        projector='joseph', state=state)
+            assert_allclose(
+                rec, recon(self.prj, self.ang, algorithm=algorithm,
+                           num_iter=4, projector='joseph'),
+                rtol=1e-4, atol=1e-6)
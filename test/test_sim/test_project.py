@@ -52,7 +52,9 @@ from __future__ import (absolute_import, division, print_function,
 import unittest
 from ..util import read_file
 from tomopy.sim.project import *
+from tomopy.recon.algorithm import recon
 from numpy.testing import assert_allclose
+import numpy as np
 
 __author__ = "Doga Gursoy"
 __copyright__ = "Copyright (c) 2015, UChicago Argonne, LLC."
@@ -64,3 +66,123 @@ class JobDistributionTestCase(unittest.TestCase):
         assert_allclose(
             project(read_file('obj.npy'), read_file('angle.npy')),
             read_file('proj.npy'), rtol=1e-2)
+
+    def test_project_projector(self):
+        obj = read_file('obj.npy')
+        ang = read_file('angle.npy')
+        ref = read_file('proj.npy')
+        for projector in ('joseph', 'distance'):
+            assert_allclose(
+                project(obj, ang, projector=projector),
+                ref, atol=2e-2 * ref.max())
+        self.assertRaises(ValueError, project, obj, ang, projector='josef')
+
+    def test_project_adjoint(self):
+        # fbp without filtering is the backprojector of the same model
+        obj = read_file('obj.npy')
+        ang = read_file('angle.npy').astype('float32')
+        np.random.seed(0)
+        x = np.random.rand(*obj.shape).astype('float32')
+        for projector in ('siddon', 'joseph', 'distance'):
+            ax = project(x, ang, pad=False, projector=projector)
+            y = np.random.rand(*ax.shape).astype('float32')
+            aty = recon(
+                y, ang, algorithm='fbp', projector=projector,
+                num_gridx=x.shape[1], num_gridy=x.shape[2])
+            assert_allclose(np.sum(ax * y), np.sum(x * aty), rtol=1e-4)
+
+    def test_project_fan(self):
+        obj = read_file('obj.npy')
+        ang = read_file('angle.npy').astype('float32')
+        # A distant source makes the rays nearly parallel
+        ref = project(obj, ang, pad=False)
+        assert_allclose(
+            project(obj, ang, pad=False, source_distance=1e5,
+                    detector_distance=1e5), ref, atol=1e-2 * ref.max())
+        # fbp traces the same fan, and the pixel-driven backprojector
+        # weights the pixels by the density of the rays
+        np.random.seed(0)
+        x = np.random.rand(*obj.shape).astype('float32')
+        geom = {'source_distance': 40, 'detector_distance': 90}
+        for projector in ('siddon', 'joseph', 'distance'):
+            ax = project(x, ang, pad=False, projector=projector, **geom)
+            y = np.random.rand(*ax.shape).astype('float32')
+            for backprojector, rtol in (('ray', 1e-4), ('pixel', 5e-3)):
+                aty = recon(
+                    y, ang, algorithm='fbp', projector=projector,
+                    backprojector=backprojector, num_gridx=x.shape[1],
+                    num_gridy=x.shape[2], **geom)
+                assert_allclose(np.sum(ax * y), np.sum(x * aty), rtol=rtol)
+        with self.assertRaises(ValueError):
+            project(obj, ang, source_distance=10)
+
+    def test_project_phantom(self):
+        # The chords of a sphere of radius r pixels
+        size = (3, 41, 41)
+        sphere = [{'A': 1., 'a': .5, 'b': .5, 'c': .5, 'x0': 0., 'y0': 0.,
+                   'z0': 0., 'phi': 0., 'theta': 0., 'psi': 0.}]
+        ang = angles(7)
+        prj = project_phantom(ang, size, sphere, pad=False,
+                              sinogram_order=True)
+        r = 0.25 * (size[1] - 1)
+        yi = np.arange(size[2]) + 0.5 - 0.5 * size[2]
+        ref = 2 * np.sqrt(np.maximum(r * r - yi * yi, 0))
+        assert_allclose(prj[1], np.tile(ref, (7, 1)), atol=1e-4)
+        # The voxelized phantom converges to the same data
+        from tomopy.misc.phantom import phantom, _array_to_params, \
+            _get_shepp_array
+        ang = read_file('angle.npy')
+        obj = phantom((128, 128, 128), _array_to_params(_get_shepp_array()))
+        ref = project(obj[60:68], ang)
+        prj = project_phantom(ang, 128, ncore=2)[:, 60:68]
+        self.assertLess(np.abs(prj - ref).mean(), 0.05 * np.abs(ref).mean())
+
+    def test_project_detector(self):
+        from scipy.ndimage import convolve1d
+        obj = read_file('obj.npy') * 0.1
+        ang = read_file('angle.npy')
+        ref = project(obj, ang, sinogram_order=True)
+        ku, kv = np.array([1., 2., 1.]) / 4, np.array([1., 1., 1.]) / 3
+        prj = project(obj, ang, sinogram_order=True, blur=(ku, kv))
+        blurred = convolve1d(convolve1d(ref, kv, axis=0, mode='nearest'),
+                             ku, axis=2, mode='nearest')
+        assert_allclose(prj, blurred, atol=1e-5)
+        # The noise of each detector pixel does not depend on the threads
+        prj = project(obj, ang, sinogram_order=True, emission=False,
+                      flux=500, seed=1, ncore=1)
+        assert_allclose(project(obj, ang, sinogram_order=True,
+                                emission=False, flux=500, seed=1, ncore=3),
+                        prj)
+        counts = 500 * prj
+        mean = 500 * np.exp(-ref)
+        assert_allclose(counts, np.round(counts), atol=1e-3)
+        assert_allclose(np.mean((counts - mean) ** 2 / mean), 1, rtol=0.1)
+        prj = project(obj, ang, sinogram_order=True, read_noise=0.5, seed=2)
+        assert_allclose(np.std(prj - ref), 0.5, rtol=0.1)
+        with self.assertRaises(ValueError):
+            project(obj, ang, blur=[0.5, 0.5])
+
+    def test_project_threads(self):
+        obj = read_file('obj.npy')
+        ang = read_file('angle.npy')
+        ref = project(obj, ang, ncore=1)
+        assert_allclose(project(obj, ang, ncore=3), ref, rtol=1e-6)
+        # The rotation center may change from slice to slice
+        center = np.linspace(-2, 2, obj.shape[0]) + ref.shape[2] / 2.
+        prj = project(obj, ang, center=center, ncore=2)
+        for s in range(obj.shape[0]):
+            assert_allclose(
+                prj[:, s], project(obj[s:s + 1], ang, center=center[s])[:, 0],
+                rtol=1e-6)
+
+    def test_project3_axis(self):
+        # The slices normal to axes 1 and 2 are those of transposed volumes
+        np.random.seed(0)
+        x, y, z = np.random.rand(3, 20, 20, 20).astype('float32')
+        ang = read_file('angle.npy')[:12]
+        for axis, u, v, order in ((1, y, z, (2, 1, 0)), (2, x, z, (1, 2, 0))):
+            assert_allclose(
+                project3(x, y, z, ang, axis=axis),
+                project3(np.ascontiguousarray(u.transpose(order)),
+                         np.ascontiguousarray(v.transpose(order)), x, ang,
+                         axis=0), rtol=1e-5, atol=1e-5)
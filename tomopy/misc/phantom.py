@@ -59,6 +59,8 @@ import skimage.transform
 import tifffile
 import os.path
 import logging
+import tomopy.util.extern as extern
+import tomopy.util.mproc as mproc
 
 logger = logging.getLogger(__name__)
 
@@ -284,7 +286,7 @@ def _totuple(size, dim):
     return size
 
 
-def shepp3d(size=128, dtype='float32'):
+def shepp3d(size=128, dtype='float32', supersample=1):
     """
     Load 3D Shepp-Logan image array.
 
@@ -294,6 +296,8 @@ def shepp3d(size=128, dtype='float32'):
         Size of the 3D data.
     dtype : str, optional
         The desired data-type for the array.
+    supersample : int, optional
+        Number of samples per voxel along each axis, see :func:`phantom`.
 
     Returns
     -------
@@ -302,13 +306,17 @@ def shepp3d(size=128, dtype='float32'):
     """
     size = _totuple(size, 3)
     shepp_params = _array_to_params(_get_shepp_array())
-    return phantom(size, shepp_params, dtype).clip(0, np.inf)
+    return phantom(size, shepp_params, dtype,
+                   supersample=supersample).clip(0, np.inf)
 
 
-def phantom(size, params, dtype='float32'):
+def phantom(size, params, dtype='float32', supersample=1, ncore=None):
     """
     Generate a cube of given size using a list of ellipsoid parameters.
 
+    The ellipsoids are rasterized in parallel, tile by tile, over their
+    bounding boxes only.
+
     Parameters
     ----------
     size: tuple of int
@@ -318,22 +326,42 @@ def phantom(size, params, dtype='float32'):
         to include in the cube.
     dtype: str, optional
         Data type of the output ndarray.
+    supersample: int, optional
+        Number of samples per voxel along each axis. Voxels on the surface
+        of an ellipsoid then get its value times the fraction of their
+        samples inside it. Defaults to the voxel centers only.
+    ncore: int, optional
+        Number of threads. Defaults to the number of cores.
 
     Returns
     -------
     ndarray
         3D object filled with the specified ellipsoids.
     """
-    # instantiate ndarray cube
-    obj = np.zeros(size, dtype=dtype)
+    size = tuple(size)
+    if len(size) != 3:
+        raise ValueError("size must have 3 dimensions")
+    if ncore is None:
+        ncore = mproc.mp.cpu_count()
+
+    obj = np.zeros(size, dtype=np.float32)
+    extern.c_phantom(_params_to_ellipsoids(params), obj,
+                     max(1, int(supersample)), max(1, int(ncore)))
+    return obj.astype(dtype, copy=False)
 
-    # define coords
-    coords = _define_coords(size)
 
-    # recursively add ellipsoids to cube
-    for param in params:
-        _ellipsoid(param, out=obj, coords=coords)
-    return obj
+def _params_to_ellipsoids(params):
+    """
+    Packs the value, rotation matrix, center and semi-axes of each
+    ellipsoid into the rows of an array for the C rasterizer.
+    """
+    ell = np.zeros((len(params), 16), dtype=np.float64)
+    for n, p in enumerate(params):
+        ell[n, 0] = p['A']
+        ell[n, 1:10] = _rotation_matrix(p).ravel()
+        ell[n, 10:13] = p['x0'], p['y0'], p['z0']
+        ell[n, 13:16] = p['a'], p['b'], p['c']
+    return ell
 
 
 def _ellipsoid(params, shape=None, out=None, coords=None):
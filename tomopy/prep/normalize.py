@@ -71,7 +71,8 @@ __all__ = ['minus_log',
            'normalize',
            'normalize_bg',
            'normalize_roi',
-           'normalize_nf']
+           'normalize_nf',
+           'normalize_dynamic']
 
 
 def minus_log(arr, ncore=None, out=None):
@@ -100,10 +101,15 @@ def minus_log(arr, ncore=None, out=None):
     return out
 
 
-def normalize(arr, flat, dark, cutoff=None, ncore=None, out=None):
+def normalize(arr, flat, dark, cutoff=None, ncore=None, out=None,
+              minus_log=False, nonfinite=None, sinogram_order=False):
     """
     Normalize raw projection data using the flat and dark field projections.
 
+    The correction, cutoff, minus log and cleanup are applied in a single
+    threaded pass over the data. Raw uint16 projections are read as they
+    are, without a float copy.
+
     Parameters
     ----------
     arr : ndarray
@@ -119,26 +125,53 @@ def normalize(arr, flat, dark, cutoff=None, ncore=None, out=None):
     out : ndarray, optional
         Output array for result. If same as arr,
         process will be done in-place.
+    minus_log : bool, optional
+        Take the minus log of the normalized data.
+    nonfinite : float, optional
+        If given, NaN and infinite values of the result are replaced with
+        this value.
+    sinogram_order : bool, optional
+        Return the data as a stack of sinograms, i.e. with the first two
+        axes of arr swapped.
 
     Returns
     -------
     ndarray
         Normalized 3D tomographic data.
     """
-    arr = dtype.as_float32(arr)
-    l = np.float32(1e-6)
-    flat = np.mean(flat, axis=0, dtype=np.float32)
-    dark = np.mean(dark, axis=0, dtype=np.float32)
+    arr = dtype.as_ndarray(arr)
+    if arr.dtype != np.uint16:
+        arr = dtype.as_float32(arr)
+    arr = np.ascontiguousarray(arr)
+    dt, dy, dx = arr.shape
+    flat = _mean_field(flat, (dy, dx))
+    dark = _mean_field(dark, (dy, dx))
+
+    shape = (dy, dt, dx) if sinogram_order else (dt, dy, dx)
+    if out is None:
+        out = np.empty(shape, dtype=np.float32)
+    elif (out.dtype != np.float32 or out.shape != shape or
+          not out.flags.c_contiguous):
+        raise ValueError(
+            "out must be a contiguous float32 array of shape "
+            "{}".format(shape))
+    elif sinogram_order and np.may_share_memory(arr, out):
+        raise ValueError("sinogram_order can not be done in-place")
+    if cutoff is not None:
+        cutoff = np.float32(cutoff)
+    if nonfinite is not None:
+        nonfinite = np.float32(nonfinite)
 
-    with mproc.set_numexpr_threads(ncore):
-        denom = ne.evaluate('flat-dark')
-        ne.evaluate('where(denom<l,l,denom)', out=denom)
-        out = ne.evaluate('arr-dark', out=out)
-        ne.evaluate('out/denom', out=out, truediv=True)
-        if cutoff is not None:
-            cutoff = np.float32(cutoff)
-            ne.evaluate('where(out>cutoff,cutoff,out)', out=out)
-    return out
+    if ncore is None:
+        ncore = mproc.mp.cpu_count()
+    return extern.c_normalize_log(arr, flat, dark, cutoff, minus_log,
+                                  nonfinite, sinogram_order, out,
+                                  max(1, int(ncore)))
+
+
+def _mean_field(field, shape):
+    field = np.mean(field, axis=0, dtype=np.float32)
+    return np.ascontiguousarray(np.broadcast_to(field, shape))
 
 
 # TODO: replace roi indexes with slc object
@@ -286,3 +319,67 @@ def normalize_nf(tomo, flats, dark, flat_loc,
                 ne.evaluate('where(out_l>cutoff,cutoff,out_l)', out=out_l)
 
     return out
+
+
+def normalize_dynamic(tomo, flats, dark, ncomp=None, downsample=8, niter=3,
+                      cutoff=None, ncore=None, out=None):
+    """
+    Normalize raw 3D projection data with a flat field fitted to each
+    projection (dynamic flat-field correction).
+
+    The flats are reduced to their mean and principal components
+    (eigenflats). For each projection the eigenflat weights are fitted by
+    least squares on a downsampled grid, assuming the transmission of the
+    object is smoother than the flat-field structure, so that beam
+    fluctuations between the flats are followed.
+
+    Parameters
+    ----------
+    tomo : ndarray
+        3D tomographic data.
+    flats : ndarray
+        3D flat field data, preferably spread over the scan.
+    dark : ndarray
+        3D dark field data.
+    ncomp : int, optional
+        Number of eigenflats. By default those carrying more than the
+        average variance of the flats are used.
+    downsample : int, optional
+        Downsampling factor of the grid the weights are fitted on.
+    niter : int, optional
+        Number of least-squares iterations of the fit.
+    cutoff : float, optional
+        Permitted maximum vaue for the normalized data.
+    ncore : int, optional
+        Number of cores that will be assigned to jobs.
+    out : ndarray, optional
+        Output array for result. If same as tomo, process
+        will be done in-place.
+
+    Returns
+    -------
+    ndarray
+        Normalized 3D tomographic data.
+    """
+    tomo = np.ascontiguousarray(dtype.as_float32(tomo))
+    flats = np.ascontiguousarray(dtype.as_float32(flats))
+    dt, dy, dx = tomo.shape
+    dark = _mean_field(dark, (dy, dx))
+    if flats.shape[1:] != (dy, dx):
+        raise ValueError("flats must have the shape of the projections")
+
+    if out is None:
+        out = np.empty_like(tomo)
+    elif (out.dtype != np.float32 or out.shape != tomo.shape or
+          not out.flags.c_contiguous):
+        raise ValueError(
+            "out must be a contiguous float32 array of shape "
+            "{}".format(tomo.shape))
+    if cutoff is not None:
+        cutoff = np.float32(cutoff)
+
+    if ncore is None:
+        ncore = mproc.mp.cpu_count()
+    return extern.c_normalize_dynamic(
+        tomo, flats, dark, 0 if ncomp is None else int(ncomp),
+        int(downsample), int(niter), cutoff, out, max(1, int(ncore)))
@@ -62,9 +62,6 @@ from tomopy.util.misc import (fft, ifft, fft2, ifft2)
 from scipy.ndimage import median_filter
 from scipy import signal
 from scipy.signal import savgol_filter
-from scipy.ndimage import binary_dilation
-from scipy.ndimage import uniform_filter1d
-from scipy import interpolate
 import logging
 logger = logging.getLogger(__name__)
 
@@ -324,6 +321,9 @@ def remove_stripe_sf(tomo, size=5, ncore=None, nchunk=None):
     """
     Normalize raw projection data using a smoothing filter approach.
 
+    The average row of each sinogram is taken in a single sweep over the
+    projections.
+
     Parameters
     ----------
     tomo : ndarray
@@ -333,22 +333,17 @@ def remove_stripe_sf(tomo, size=5, ncore=None, nchunk=None):
     ncore : int, optional
         Number of cores that will be assigned to jobs.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used, the slices are split evenly between the cores.
 
     Returns
     -------
     ndarray
         Corrected 3D tomographic data.
     """
-    tomo = dtype.as_float32(tomo)
-    arr = mproc.distribute_jobs(
-        tomo,
-        func=extern.c_remove_stripe_sf,
-        args=(size,),
-        axis=1,
-        ncore=ncore,
-        nchunk=nchunk)
-    return arr
+    tomo = np.array(tomo, dtype=np.float32, order='C', copy=True)
+    if ncore is None:
+        ncore = mproc.mp.cpu_count()
+    return extern.c_remove_stripe_sf(tomo, int(size), max(1, int(ncore)))
 
 
 def remove_stripe_based_sorting(tomo, size=None, ncore=None, nchunk=None):
@@ -367,57 +362,29 @@ def remove_stripe_based_sorting(tomo, size=None, ncore=None, nchunk=None):
     ncore : int, optional
         Number of cores that will be assigned to jobs.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used, the sinograms are split evenly between the cores.
 
     Returns
     -------
     ndarray
         Corrected 3D tomographic data.
     """
-    arr = mproc.distribute_jobs(
-        tomo,
-        func=_remove_stripe_based_sorting,
-        args=(size,),
-        axis=1,
-        ncore=ncore,
-        nchunk=nchunk)
-    return arr
-
-
-def _create_matindex(nrow, ncol):
-    """
-    Create a 2D array of indexes used for sorting technique
-    """
-    listindex = np.arange(0.0, ncol, 1.0)
-    matindex = np.tile(listindex, (nrow, 1))
-    return matindex
-
-
-def _rs_sort(sinogram, size, matindex):
-    """
-    Remove stripes using the sorting technique.
-    """
-    sinogram = np.transpose(sinogram)
-    matcomb = np.asarray(np.dstack((matindex, sinogram)))
-    matsort = np.asarray(
-        [row[row[:, 1].argsort()] for row in matcomb])
-    matsort[:, :, 1] = median_filter(matsort[:, :, 1], (size, 1))
-    matsortback = np.asarray(
-        [row[row[:, 0].argsort()] for row in matsort])
-    sino_corrected = matsortback[:, :, 1]
-    return np.transpose(sino_corrected)
-
-
-def _remove_stripe_based_sorting(tomo, size):
-    matindex = _create_matindex(tomo.shape[2], tomo.shape[0])
     if size is None:
         if tomo.shape[2] > 2000:
             size = 21
         else:
             size = max(5, int(0.01 * tomo.shape[2]))
-    for m in range(tomo.shape[1]):
-        sino = tomo[:, m, :]
-        tomo[:, m, :] = _rs_sort(sino, size, matindex)
+    return _remove_stripe_sorting(tomo, 'sort', 0, size, size, ncore)
+
+
+def _remove_stripe_sorting(tomo, method, snr, size, sm_size, ncore):
+    # The sinograms of a copy are processed by the C threads, each reusing
+    # its sort buffers and sharing the sort index between the stages.
+    tomo = np.array(tomo, dtype=np.float32, order='C', copy=True)
+    if ncore is None:
+        ncore = mproc.mp.cpu_count()
+    return extern.c_remove_stripe_sorting(
+        tomo, method, snr, int(size), int(sm_size), max(1, int(ncore)))
 
 
 def remove_stripe_based_filtering(
@@ -646,84 +613,14 @@ def remove_large_stripe(tomo, snr=3, size=51, ncore=None, nchunk=None):
     ncore : int, optional
         Number of cores that will be assigned to jobs.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used, the sinograms are split evenly between the cores.
 
     Returns
     -------
     ndarray
         Corrected 3D tomographic data.
     """
-    arr = mproc.distribute_jobs(
-        tomo,
-        func=_remove_large_stripe,
-        args=(snr, size),
-        axis=1,
-        ncore=ncore,
-        nchunk=nchunk)
-    return arr
-
-
-def _detect_stripe(listdata, snr):
-    """
-    Algorithm 4 in the paper. Used to locate stripes.
-    """
-    numdata = len(listdata)
-    listsorted = np.sort(listdata)[::-1]
-    xlist = np.arange(0, numdata, 1.0)
-    ndrop = np.int16(0.25 * numdata)
-    (_slope, _intercept) = np.polyfit(
-        xlist[ndrop:-ndrop - 1], listsorted[ndrop:-ndrop - 1], 1)
-    numt1 = _intercept + _slope * xlist[-1]
-    noiselevel = np.abs(numt1 - _intercept)
-    val1 = np.abs(listsorted[0] - _intercept) / noiselevel
-    val2 = np.abs(listsorted[-1] - numt1) / noiselevel
-    listmask = np.zeros_like(listdata)
-    if (val1 >= snr):
-        upper_thresh = _intercept + noiselevel * snr * 0.5
-        listmask[listdata > upper_thresh] = 1.0
-    if (val2 >= snr):
-        lower_thresh = numt1 - noiselevel * snr * 0.5
-        listmask[listdata <= lower_thresh] = 1.0
-    return listmask
-
-
-def _rs_large(sinogram, snr, size, matindex):
-    """
-    Remove large stripes by: locating stripes, normalizing to remove
-    full stripes, using the sorting technique to remove partial stripes.    
-    """
-    badpixelratio = 0.05
-    (nrow, ncol) = sinogram.shape
-    ndrop = np.int16(badpixelratio * nrow)
-    sinosorted = np.sort(sinogram, axis=0)
-    sinosmoothed = median_filter(sinosorted, (1, size))
-    list1 = np.mean(sinosorted[ndrop:nrow - ndrop], axis=0)
-    list2 = np.mean(sinosmoothed[ndrop:nrow - ndrop], axis=0)
-    listfact = list1 / list2
-    # Locate stripes
-    listmask = _detect_stripe(listfact, snr)
-    listmask = binary_dilation(listmask, iterations=1).astype(listmask.dtype)
-    matfact = np.tile(listfact, (nrow, 1))
-    # Normalize
-    sinogram = sinogram / matfact
-    sinogram1 = np.transpose(sinogram)
-    matcombine = np.asarray(np.dstack((matindex, sinogram1)))
-    matsort = np.asarray(
-        [row[row[:, 1].argsort()] for row in matcombine])
-    matsort[:, :, 1] = np.transpose(sinosmoothed)
-    matsortback = np.asarray(
-        [row[row[:, 0].argsort()] for row in matsort])
-    sino_corrected = np.transpose(matsortback[:, :, 1])
-    listxmiss = np.where(listmask > 0.0)[0]
-    sinogram[:, listxmiss] = sino_corrected[:, listxmiss]
-    return sinogram
-
-
-def _remove_large_stripe(tomo, snr, size):
-    matindex = _create_matindex(tomo.shape[2], tomo.shape[0])
-    for m in range(tomo.shape[1]):
-        sino = tomo[:, m, :]
-        tomo[:, m, :] = _rs_large(sino, snr, size, matindex)
+    return _remove_stripe_sorting(tomo, 'large', snr, size, size, ncore)
 
 
 def remove_dead_stripe(tomo, snr=3, size=51, ncore=None, nchunk=None):
@@ -744,57 +641,14 @@ def remove_dead_stripe(tomo, snr=3, size=51, ncore=None, nchunk=None):
     ncore : int, optional
         Number of cores that will be assigned to jobs.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used, the sinograms are split evenly between the cores.
 
     Returns
     -------
     ndarray
         Corrected 3D tomographic data.
     """
-    arr = mproc.distribute_jobs(
-        tomo,
-        func=_remove_dead_stripe,
-        args=(snr, size),
-        axis=1,
-        ncore=ncore,
-        nchunk=nchunk)
-    return arr
-
-
-def _rs_dead(sinogram, snr, size, matindex):
-    """
-    Remove unresponsive and fluctuating stripes.
-    """
-    sinogram = np.copy(sinogram)  # Make it mutable
-    (nrow, _) = sinogram.shape
-    sinosmoothed = np.apply_along_axis(uniform_filter1d, 0, sinogram, 10)
-    listdiff = np.sum(np.abs(sinogram - sinosmoothed), axis=0)
-    nmean = np.mean(listdiff)
-    listdiffbck = median_filter(listdiff, size)
-    listdiffbck[listdiffbck == 0.0] = nmean
-    listfact = listdiff / listdiffbck
-    listmask = _detect_stripe(listfact, snr)
-    listmask = binary_dilation(listmask, iterations=1).astype(listmask.dtype)
-    listmask[0:2] = 0.0
-    listmask[-2:] = 0.0
-    listx = np.where(listmask < 1.0)[0]
-    listy = np.arange(nrow)
-    matz = sinogram[:, listx]
-    finter = interpolate.interp2d(listx, listy, matz, kind='linear')
-    listxmiss = np.where(listmask > 0.0)[0]
-    if len(listxmiss) > 0:
-        matzmiss = finter(listxmiss, listy)
-        sinogram[:, listxmiss] = matzmiss
-    # Use algorithm 5 to remove residual stripes
-    sinogram = _rs_large(sinogram, snr, size, matindex)
-    return sinogram
-
-
-def _remove_dead_stripe(tomo, snr, size):
-    matindex = _create_matindex(tomo.shape[2], tomo.shape[0])
-    for m in range(tomo.shape[1]):
-        sino = tomo[:, m, :]
-        tomo[:, m, :] = _rs_dead(sino, snr, size, matindex)
+    return _remove_stripe_sorting(tomo, 'dead', snr, size, size, ncore)
 
 
 def remove_all_stripe(tomo, snr=3, la_size=61, sm_size=21, ncore=None, nchunk=None):
@@ -817,27 +671,12 @@ def remove_all_stripe(tomo, snr=3, la_size=61, sm_size=21, ncore=None, nchunk=No
     ncore : int, optional
         Number of cores that will be assigned to jobs.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used, the sinograms are split evenly between the cores.
 
     Returns
     -------
     ndarray
         Corrected 3D tomographic data.
     """
-    arr = mproc.distribute_jobs(
-        tomo,
-        func=_remove_all_stripe,
-        args=(snr, la_size, sm_size),
-        axis=1,
-        ncore=ncore,
-        nchunk=nchunk)
-    return arr
-
-
-def _remove_all_stripe(tomo, snr, la_size, sm_size):
-    matindex = _create_matindex(tomo.shape[2], tomo.shape[0])
-    for m in range(tomo.shape[1]):
-        sino = tomo[:, m, :]
-        sino = _rs_algorithm_6(sino, snr, la_size, matindex)
-        sino = _rs_algorithm_3(sino, sm_size, matindex)
-        tomo[:, m, :] = sino
+    return _remove_stripe_sorting(
+        tomo, 'all', snr, la_size, sm_size, ncore)
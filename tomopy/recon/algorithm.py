@@ -58,7 +58,8 @@ import numpy as np
 import tomopy.util.mproc as mproc
 import tomopy.util.extern as extern
 import tomopy.util.dtype as dtype
-from tomopy.sim.project import get_center
+from tomopy.sim.project import get_center, get_fan, _projectors
+from tomopy.misc.corr import _get_mask
 import logging
 import concurrent.futures as cf
 
@@ -68,29 +69,134 @@ logger = logging.getLogger(__name__)
 __author__ = "Doga Gursoy"
 __copyright__ = "Copyright (c) 2015, UChicago Argonne, LLC."
 __docformat__ = 'restructuredtext en'
-__all__ = ['recon', 'init_tomo']
+__all__ = ['recon', 'init_tomo', 'ReconState']
 
 
 allowed_recon_kwargs = {
-    'art': ['num_gridx', 'num_gridy', 'num_iter'],
+    'art': ['num_gridx', 'num_gridy', 'num_iter', 'projector', 'support',
+            'roi', 'fold_360', 'num_thread', 'source_distance',
+            'detector_distance'],
     'bart': ['num_gridx', 'num_gridy', 'num_iter',
-             'num_block', 'ind_block'],
-    'fbp': ['num_gridx', 'num_gridy', 'filter_name', 'filter_par'],
-    'gridrec': ['num_gridx', 'num_gridy', 'filter_name', 'filter_par'],
-    'mlem': ['num_gridx', 'num_gridy', 'num_iter'],
+             'num_block', 'ind_block', 'subset_order', 'projector',
+             'support', 'roi', 'fold_360', 'backprojector', 'num_thread',
+             'source_distance', 'detector_distance'],
+    'cgls': ['num_gridx', 'num_gridy', 'num_iter', 'damp', 'tol',
+             'projector', 'support', 'roi', 'fold_360', 'source_distance',
+             'detector_distance'],
+    'fbp': ['num_gridx', 'num_gridy', 'filter_name', 'filter_par',
+            'projector', 'support', 'roi', 'fold_360', 'backprojector',
+            'source_distance', 'detector_distance'],
+    'gridrec': ['num_gridx', 'num_gridy', 'filter_name', 'filter_par',
+                'roi', 'fold_360'],
+    'lsqr': ['num_gridx', 'num_gridy', 'num_iter', 'damp', 'tol',
+             'projector', 'support', 'roi', 'fold_360', 'source_distance',
+             'detector_distance'],
+    'mlem': ['num_gridx', 'num_gridy', 'num_iter', 'projector', 'support',
+             'roi', 'fold_360', 'backprojector', 'source_distance',
+             'detector_distance'],
     'osem': ['num_gridx', 'num_gridy', 'num_iter',
-             'num_block', 'ind_block'],
+             'num_block', 'ind_block', 'subset_order', 'projector',
+             'support', 'roi', 'fold_360', 'backprojector',
+             'source_distance', 'detector_distance'],
     'ospml_hybrid': ['num_gridx', 'num_gridy', 'num_iter',
-                     'reg_par', 'num_block', 'ind_block'],
+                     'reg_par', 'num_block', 'ind_block', 'subset_order',
+                     'projector', 'support', 'roi', 'fold_360',
+                     'backprojector', 'neighbors', 'source_distance',
+                     'detector_distance'],
     'ospml_quad': ['num_gridx', 'num_gridy', 'num_iter',
-                   'reg_par', 'num_block', 'ind_block'],
-    'pml_hybrid': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par'],
-    'pml_quad': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par'],
-    'sirt': ['num_gridx', 'num_gridy', 'num_iter'],
-    'tv': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par'],
-    'grad': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par'],
+                   'reg_par', 'num_block', 'ind_block', 'subset_order',
+                   'projector', 'support', 'roi', 'fold_360',
+                   'backprojector', 'neighbors', 'source_distance',
+                   'detector_distance'],
+    'pml_hybrid': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par',
+                   'projector', 'support', 'roi', 'fold_360',
+                   'backprojector', 'neighbors', 'source_distance',
+                   'detector_distance'],
+    'pml_quad': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par',
+                 'projector', 'support', 'roi', 'fold_360', 'backprojector',
+                 'neighbors', 'source_distance', 'detector_distance'],
+    'sirt': ['num_gridx', 'num_gridy', 'num_iter', 'projector', 'support',
+             'roi', 'fold_360', 'backprojector', 'source_distance',
+             'detector_distance'],
+    'tv': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par', 'projector',
+           'support', 'roi', 'fold_360', 'backprojector', 'tv_3d', 'state',
+           'source_distance', 'detector_distance'],
+    'grad': ['num_gridx', 'num_gridy', 'num_iter', 'reg_par', 'projector',
+             'support', 'roi', 'fold_360', 'backprojector', 'state',
+             'source_distance', 'detector_distance'],
 }
 
+# Other names of the algorithms
+_aliases = {'ossart': 'bart'}
+
+
+class ReconState(object):
+    """
+    Solver state of the tv and grad algorithms kept between calls of
+    :func:`recon`, so that a reconstruction can be continued for more
+    iterations without starting over.
+
+    The state is allocated by the first call it is passed to and holds,
+    for each slice, the iterates and step sizes of the solver. It is
+    cleared when the algorithm, the shapes of the data and of the
+    reconstruction, the rotation centers, the projector, the
+    backprojector, the support, the region of interest, the fan beam
+    distances, fold_360 or tv_3d change, or by :meth:`reset`.
+
+    Example
+    -------
+    >>> state = tomopy.ReconState()
+    >>> rec = tomopy.recon(prj, ang, algorithm='tv', num_iter=10, state=state)
+    >>> rec = tomopy.recon(prj, ang, algorithm='tv', num_iter=10, state=state)
+
+    The second call returns the reconstruction after 20 iterations.
+    """
+
+    def __init__(self):
+        self.buffer = None
+        self.key = None
+
+    def reset(self):
+        """Start the next reconstruction over from its initial guess."""
+        self.buffer = None
+        self.key = None
+
+    @property
+    def started(self):
+        """Whether a reconstruction was already run with this state."""
+        return self.buffer is not None
+
+    def _bind(self, algorithm, tomo, center, recon_shape, kwargs):
+        """Allocate the state unless it was left by the same problem.
+
+        Return whether the reconstruction continues from the state.
+        """
+        key = (algorithm, tomo.shape, recon_shape, center.tobytes(),
+               bool(kwargs.get('tv_3d', False)),
+               bool(kwargs.get('fold_360', False)))
+        for kw in ('projector', 'backprojector', 'support', 'roi', 'geom',
+                   'source_distance', 'detector_distance'):
+            value = kwargs.get(kw)
+            if isinstance(value, np.ndarray):
+                value = (value.dtype.str, value.shape, value.tobytes())
+            key += (value, )
+        if self.key == key:
+            return True
+        size = extern.c_state_size(
+            algorithm, tomo.shape[1], tomo.shape[2], recon_shape[1],
+            recon_shape[2])
+        self.buffer = np.zeros((recon_shape[0], size), dtype='float32')
+        self.key = key
+        return False
+
+
+# Algorithms whose multiplicative updates need a positive start.
+_positive_algorithms = ('mlem', 'osem', 'pml_quad', 'pml_hybrid',
+                        'ospml_quad', 'ospml_hybrid')
+
+# Backprojectors of the C ray tracer
+_backprojectors = ('ray', 'pixel')
+
 
 def recon(
         tomo, theta, center=None, sinogram_order=False, algorithm=None,
@@ -116,17 +222,26 @@ def recon(
             Algebraic reconstruction technique :cite:`Kak:98`.
         'bart'
             Block algebraic reconstruction technique.
+        'cgls'
+            Conjugate gradient least squares, the conjugate gradient method
+            on the normal equations.
         'fbp'
             Filtered back-projection algorithm.
         'gridrec'
             Fourier grid reconstruction algorithm :cite:`Dowd:99`,
             :cite:`Rivers:06`.
+        'lsqr'
+            Least squares by Golub-Kahan bidiagonalization, equivalent to
+            cgls in exact arithmetic and more stable for many iterations.
         'mlem'
             Maximum-likelihood expectation maximization algorithm
             :cite:`Dempster:77`.
         'osem'
             Ordered-subset expectation maximization algorithm
             :cite:`Hudson:94`.
+        'ossart'
+            Ordered-subset simultaneous algebraic reconstruction technique,
+            another name of bart.
         'ospml_hybrid'
             Ordered-subset penalized maximum likelihood algorithm with
             weighted linear and quadratic penalties.
@@ -183,11 +298,115 @@ def recon(
     num_block : int, optional
         Number of data blocks for intermediate updating the object.
     ind_block : array of int, optional
-        Order of projections to be used for updating.
+        Order of projections to be used for updating. A 2D array holds one
+        order per row, and iteration i uses row i modulo the number of rows.
+    subset_order : str, optional
+        Order of the projections of the ordered-subset algorithms (bart,
+        osem, ospml_hybrid and ospml_quad), unless ind_block is given. The
+        subsets are consecutive runs of num_block nearly equal parts of this
+        order. When the number of projections is not a multiple of
+        num_block, the projections left over are spread over the subsets,
+        not updated as a last smaller subset.
+
+        'contiguous'
+            Runs of neighbouring projections in the order of the data
+            (default).
+        'sequential'
+            Interleaved subsets of every num_block-th angle, visited in
+            turn.
+        'bit-reversal'
+            Angles visited in bit-reversed order of their rank.
+        'golden'
+            Angles visited in steps of the golden ratio of the angular
+            range.
+        'random'
+            A new seeded random permutation for every iteration.
     reg_par : float, optional
         Regularization parameter for smoothing.
-    init_recon : ndarray, optional
-        Initial guess of the reconstruction.
+    damp : float, optional
+        Tikhonov damping of cgls and lsqr, which minimize
+        ``|Rx - data|^2 + damp^2 |x|^2``. Defaults to 0.
+    tol : float, optional
+        cgls and lsqr stop iterating a slice once the residual of the
+        normal equations falls below tol times its initial value. Defaults
+        to 0, which runs all num_iter iterations.
+    projector : str, optional
+        Projection model used by the iterative algorithms and fbp.
+
+        'siddon'
+            Exact intersection length of the ray with each pixel (default).
+        'joseph'
+            Linear interpolation between the two nearest pixels along the
+            dominant axis of the ray.
+        'distance'
+            Distance-driven model; overlap of the detector pixel footprint
+            with each pixel along the dominant axis of the ray.
+    backprojector : str, optional
+        Backprojection used by the iterative algorithms except art, and fbp.
+
+        'ray'
+            Scatter each ray's update along the pixels traced by the
+            projector (default). This is the exact adjoint of the projector.
+        'pixel'
+            Gather the updates per pixel by interpolating the detector
+            bins each pixel projects onto, in tiles of rows that are
+            independent of each other. It is faster on large grids but
+            unmatched to the projector.
+    neighbors : int, optional
+        Neighborhood of the priors of the pml and ospml algorithms, 8 for
+        the neighbors within a slice (default) or 26 to also smooth across
+        the neighboring slices. Slices are only coupled within the chunk
+        reconstructed by each core.
+    tv_3d : bool, optional
+        Also penalize the differences between neighboring slices in tv,
+        which removes the flicker from slice to slice. Slices are only
+        coupled within the chunk reconstructed by each core.
+    num_thread : int, optional
+        Number of threads sharing the rays of each chunk of slices in art
+        and bart. art updates the rays of a projection in chunks of
+        detector pixels far enough apart to cross disjoint pixels, and bart
+        splits the projections of each subset. Defaults to the cores left
+        over when there are fewer chunks of slices than ncore.
+    state : ReconState, optional
+        Solver state of tv and grad. A state passed to a previous call
+        continues that reconstruction for num_iter more iterations, and
+        init_recon is then ignored.
+    support : float or ndarray, optional
+        Support of the object for the iterative algorithms and fbp. Either
+        the ratio of a circular support's diameter to the smallest grid
+        edge, as in :func:`tomopy.misc.corr.circ_mask`, or a 2D boolean
+        array of shape (num_gridx, num_gridy). Rays are clipped to the
+        support, pixels outside of it are set to zero and never updated,
+        and regularizers ignore them.
+    roi : tuple of int, optional
+        Region of interest (first row, first column, number of rows, number
+        of columns) of the num_gridx x num_gridy grid. Only this region is
+        reconstructed and returned. gridrec prunes its inverse FFT to the
+        region; the iterative algorithms solve the interior problem on the
+        region after subtracting the projections of a coarse gridrec model of
+        the object outside of it from the data.
+    source_distance : float, optional
+        Distance in pixels from a point source to the rotation axis, for data
+        of rays fanning out from the source in the plane of each slice, as in
+        :func:`tomopy.sim.project.project`. The iterative algorithms and fbp
+        trace these rays, and the pixel-driven backprojector weights each
+        pixel by the density of the rays crossing it. Not with roi, fold_360
+        or init_recon='gridrec'.
+    detector_distance : float, optional
+        Distance in pixels from the source to the flat detector of a fan
+        beam. Defaults to source_distance.
+    fold_360 : bool, optional
+        Combine the pairs of projections acquired at opposite angles of a
+        full-rotation scan before reconstructing, which halves the work. The
+        pairs are averaged for a centered rotation axis and stitched with
+        blending weights for an offset one, where the default grid grows to
+        the stitched field of view. Unpaired projections are kept.
+    init_recon : ndarray or 'gridrec', optional
+        Initial guess of the reconstruction. 'gridrec' starts the iterative
+        algorithms from a gridrec reconstruction of the data, computed by
+        each core for its own chunk of slices and scaled to fit the data.
+        The EM algorithms raise it to a small positive value where it is
+        negative. Most algorithms then need fewer iterations.
     ncore : int, optional
         Number of cores that will be assigned to jobs.
     nchunk : int, optional
@@ -243,12 +462,18 @@ def recon(
     # Initialize tomography data.
     tomo = init_tomo(tomo, sinogram_order, sharedmem=False)
 
+    # Fold the opposite projections of full-rotation scans.
+    if kwargs.get('fold_360', False):
+        tomo, theta, center = _fold_360(
+            tomo, theta, get_center(tomo.shape, center))
+
     generic_kwargs = ['num_gridx', 'num_gridy', 'options']
 
     # Generate kwargs for the algorithm.
     kwargs_defaults = _get_algorithm_kwargs(tomo.shape)
 
     if isinstance(algorithm, six.string_types):
+        algorithm = _aliases.get(algorithm, algorithm)
 
         # Check whether we have an allowed method
         if algorithm not in allowed_recon_kwargs:
@@ -264,7 +489,7 @@ def recon(
                     (key, allowed_recon_kwargs[algorithm]))
             else:
                 # Make sure they are numpy arrays.
-                if not isinstance(kwargs[key], (np.ndarray, np.generic)) and not isinstance(kwargs[key], six.string_types):
+                if not isinstance(kwargs[key], (np.ndarray, np.generic, ReconState)) and not isinstance(kwargs[key], six.string_types):
                     kwargs[key] = np.array(value)
 
                 # Make sure reg_par and filter_par is float32.
@@ -272,6 +497,13 @@ def recon(
                     if not isinstance(kwargs[key], np.float32):
                         kwargs[key] = np.array(value, dtype='float32')
 
+        # Ordered subsets follow subset_order unless given.
+        if 'subset_order' in allowed_recon_kwargs[algorithm]:
+            kwargs['ind_block'] = _get_ind_block(
+                theta, kwargs.get('num_block', 1),
+                kwargs.get('subset_order', 'contiguous'),
+                kwargs.get('ind_block'), kwargs.get('num_iter', 1))
+
         # Set kwarg defaults.
         for kw in allowed_recon_kwargs[algorithm]:
             kwargs.setdefault(kw, kwargs_defaults[kw])
@@ -289,11 +521,57 @@ def recon(
     center_arr = get_center(tomo.shape, center)
     args = _get_algorithm_args(theta)
 
+    # Start the iterative algorithms from gridrec in each chunk.
+    warm = None
+    if isinstance(init_recon, six.string_types):
+        if init_recon != 'gridrec' or 'num_iter' not in \
+                allowed_recon_kwargs.get(algorithm, ()):
+            raise ValueError(
+                'init_recon="gridrec" is only for the iterative algorithms')
+        if get_fan(kwargs['source_distance'], kwargs['detector_distance'],
+                   0)[1] > 0:
+            raise ValueError('init_recon="gridrec" needs parallel rays')
+        init_recon = None
+        grid = (kwargs['num_gridx'], kwargs['num_gridy'])
+        warm = {
+            'num_gridx': grid[0],
+            'num_gridy': grid[1],
+            'filter_name': kwargs_defaults['filter_name'],
+            'filter_par': kwargs_defaults['filter_par'],
+            'roi': _get_roi(kwargs['roi'], grid),
+            'positive': algorithm in _positive_algorithms,
+        }
+
     # Initialize reconstruction.
     recon_shape = (tomo.shape[0], kwargs['num_gridx'], kwargs['num_gridy'])
+    if 'roi' in kwargs:
+        tomo, recon_shape = _init_roi(tomo, theta, center_arr, algorithm,
+                                      kwargs)
+    if 'neighbors' in kwargs and kwargs['neighbors'] not in (8, 26):
+        raise ValueError('neighbors must be 8 or 26')
+    if 'projector' in kwargs and kwargs['projector'] not in _projectors:
+        raise ValueError('projector must be one of %s' % (_projectors,))
+    if 'backprojector' in kwargs and \
+            kwargs['backprojector'] not in _backprojectors:
+        raise ValueError(
+            'backprojector must be one of %s' % (_backprojectors,))
     recon = _init_recon(recon_shape, init_recon, sharedmem=False)
+    if 'support' in kwargs:
+        kwargs['support'] = _get_support(kwargs['support'], recon_shape[1:])
+        if kwargs['support'] is not None:
+            recon[:, kwargs['support'] == 0] = 0
+    if 'state' in kwargs:
+        state = kwargs['state']
+        if isinstance(state, ReconState):
+            # A continued reconstruction starts from its state, not gridrec
+            if state._bind(algorithm, tomo, center_arr, recon_shape, kwargs):
+                warm = None
+            kwargs['state'] = state.buffer
+        else:
+            kwargs['state'] = None
     return _dist_recon(
-        tomo, center_arr, recon, _get_func(algorithm), args, kwargs, ncore, nchunk)
+        tomo, center_arr, recon, _get_func(algorithm), args, kwargs, ncore,
+        nchunk, warm)
 
 
 # Convert data to sinogram order
@@ -325,6 +603,184 @@ def _init_recon(shape, init_recon, val=1e-6, sharedmem=True):
     return recon
 
 
+def _get_support(support, shape):
+    """Return the support as a uint8 mask of the given shape, or None."""
+    if support is None or np.ndim(support) == 0 and \
+            np.asarray(support).item() is None:
+        return None
+    if np.ndim(support) == 0:
+        support = _get_mask(shape[0], shape[1], float(support))
+    if np.shape(support) != tuple(shape):
+        raise ValueError(
+            'support must have the shape of the grid %s' % (tuple(shape),))
+    return np.require(support, dtype=np.uint8, requirements="AC")
+
+
+# Subset orders by (theta, num_block, order, rows), reused across calls.
+_ind_block_cache = {}
+
+
+def _get_ind_block(theta, num_block, order, ind_block=None, num_iter=1):
+    """Return the projection orders of the subsets as a 2D int32 array."""
+    dt = np.size(theta)
+    if not 1 <= int(num_block) <= dt:
+        raise ValueError('num_block must be between 1 and %d' % dt)
+    if ind_block is not None and not (
+            np.ndim(ind_block) == 0 and np.asarray(ind_block).item() is None):
+        ind_block = np.require(ind_block, dtype=np.int32, requirements="AC")
+        if ind_block.ndim == 1:
+            ind_block = ind_block.reshape(1, -1)
+        if ind_block.ndim != 2 or ind_block.shape[1] != dt or \
+                ind_block.shape[0] < 1 or np.any(ind_block < 0) or \
+                np.any(ind_block >= dt):
+            raise ValueError(
+                'ind_block must hold rows of %d projection indices' % dt)
+        return ind_block
+    num_block = int(num_block)
+    rows = max(1, int(num_iter)) if order == 'random' else 1
+    theta = dtype.as_float32(theta)
+    key = (theta.tobytes(), num_block, order, rows)
+    if key in _ind_block_cache:
+        return _ind_block_cache[key]
+    if order == 'contiguous':
+        seq = np.arange(dt)
+    elif order == 'sequential':
+        seq = np.concatenate(
+            [np.arange(k, dt, num_block) for k in range(num_block)])
+    elif order == 'bit-reversal':
+        nbits = max(1, int(np.ceil(np.log2(dt))))
+        j = np.arange(1 << nbits)
+        rev = np.zeros_like(j)
+        for b in range(nbits):
+            rev |= ((j >> b) & 1) << (nbits - 1 - b)
+        seq = rev[rev < dt]
+    elif order == 'golden':
+        step = np.mod(np.arange(dt) * (np.sqrt(5) - 1) / 2, 1)
+        seq = np.argsort(np.argsort(step, kind='stable'), kind='stable')
+    elif order == 'random':
+        rng = np.random.RandomState(0)
+        seq = np.stack([rng.permutation(dt) for _ in range(rows)])
+    else:
+        raise ValueError(
+            "subset_order must be 'contiguous', 'sequential', "
+            "'bit-reversal', 'golden' or 'random'")
+    # Positions in seq are angle ranks over half a rotation, except for the
+    # contiguous order, which keeps the order of the data.
+    if order == 'contiguous':
+        rank = np.arange(dt)
+    else:
+        rank = np.argsort(np.mod(theta, np.pi), kind='stable')
+    ind_block = np.require(
+        rank[seq].reshape(rows, dt), dtype=np.int32, requirements="AC")
+    ind_block.setflags(write=False)
+    if len(_ind_block_cache) > 32:
+        _ind_block_cache.clear()
+    _ind_block_cache[key] = ind_block
+    return ind_block
+
+
+def _fold_360(tomo, theta, center, tol=1e-3):
+    """Return the data, angles and rotation axis after folding the
+    projection pairs at opposite angles (within tol radians)."""
+    theta = dtype.as_float32(theta)
+    mate = np.empty(theta.size, dtype=np.int32)
+    nt = extern.c_pair_opposite(theta, tol, mate)
+    if nt == theta.size:
+        return tomo, theta, center
+    # Widen the detector to the stitched field of view, to within a pixel.
+    dx = tomo.shape[2]
+    shift = int(max(0, np.ceil(np.max(dx - 1 - 2 * center))))
+    extra = int(max(0, np.ceil(np.max(2 * center - dx - 1))))
+    out = np.empty((tomo.shape[0], nt, dx + shift + extra), dtype=np.float32)
+    extern.c_fold_360(tomo, center, mate, shift, out)
+    return out, theta[mate != -2], dtype.as_float32(center + shift)
+
+
+def _get_roi(roi, shape):
+    """Return the region of interest as an int32 array, or None."""
+    if roi is None or np.ndim(roi) == 0 and np.asarray(roi).item() is None:
+        return None
+    roi = np.require(roi, dtype=np.int32, requirements="AC")
+    if roi.shape != (4, ) or np.any(roi[:2] < 0) or np.any(roi[2:] < 1) or \
+            roi[0] + roi[2] > shape[0] or roi[1] + roi[3] > shape[1]:
+        raise ValueError(
+            'roi must be (row, column, rows, columns) within the grid %s' %
+            (tuple(shape),))
+    return roi
+
+
+def _init_roi(tomo, theta, center, algorithm, kwargs):
+    """Set up the reconstruction of a region of interest.
+
+    Return the data and the shape of the reconstruction. The ray-driven
+    algorithms reconstruct on a grid of the size of the region offset from
+    the rotation axis. kwargs['geom'] holds the geometry of their rays: that
+    offset followed by the source and detector distances of a fan beam, or
+    None for parallel rays through the full grid.
+    """
+    shape = (kwargs['num_gridx'], kwargs['num_gridy'])
+    roi = _get_roi(kwargs['roi'], shape)
+    kwargs['roi'] = roi
+    kwargs['geom'] = None
+    sod, sdd = get_fan(kwargs.get('source_distance'),
+                       kwargs.get('detector_distance'),
+                       0.5 * np.hypot(*shape))
+    if sdd > 0:
+        if roi is not None or kwargs.get('fold_360', False):
+            raise ValueError('roi and fold_360 need parallel rays')
+        kwargs['geom'] = np.array([0, 0, sod, sdd], dtype=np.float32)
+    if roi is None:
+        return tomo, (tomo.shape[0], ) + shape
+    if algorithm != 'gridrec':
+        kwargs['geom'] = np.array(
+            [roi[0] + 0.5 * roi[2] - 0.5 * shape[0],
+             roi[1] + 0.5 * roi[3] - 0.5 * shape[1], 0, 0],
+            dtype=np.float32)
+        kwargs['num_gridx'], kwargs['num_gridy'] = int(roi[2]), int(roi[3])
+        if algorithm != 'fbp':
+            # Line integrals through the interior of a non-negative object
+            # are non-negative, which also keeps the EM algorithms valid.
+            tomo = tomo - _project_exterior(tomo, theta, center, roi, shape)
+            tomo = np.require(np.maximum(tomo, 0), dtype=np.float32,
+                              requirements="AC")
+    return tomo, (tomo.shape[0], int(roi[2]), int(roi[3]))
+
+
+def _project_exterior(tomo, theta, center, roi, shape):
+    """Return the projections of the object outside of the region of interest.
+
+    The object is modelled by gridrec on detector-binned data, so the cost
+    is at most that of a single full-grid iteration.
+    """
+    dy, dt, dx = tomo.shape
+    theta = dtype.as_float32(theta)
+    f = max(1, min(4, dx // 64))
+    nb = -(-dx // f)
+    binned = np.pad(tomo, ((0, 0), (0, 0), (0, nb * f - dx)), mode='edge')
+    binned = binned.reshape(dy, dt, nb, f).mean(axis=3, dtype=np.float32)
+    center = dtype.as_float32((center + 0.5) / f - 0.5)
+    gx, gy = -(-shape[0] // f), -(-shape[1] // f)
+    obj = recon(binned, theta, center=center, sinogram_order=True,
+                algorithm='gridrec', num_gridx=gx, num_gridy=gy)
+
+    # Remove the coarse pixels centered in the region of interest.
+    x = (np.arange(gx) + 0.5) * f - 0.5 * (gx * f - shape[0])
+    y = (np.arange(gy) + 0.5) * f - 0.5 * (gy * f - shape[1])
+    x = (x >= roi[0]) & (x < roi[0] + roi[2])
+    y = (y >= roi[1]) & (y < roi[1] + roi[3])
+    obj[:, x[:, None] & y[None, :]] = 0
+
+    prj = np.zeros((dy, dt, nb), dtype=np.float32)
+    extern.c_project(obj, center, prj, theta)
+
+    # Interpolate back to the detector pixels.
+    j = np.clip((np.arange(dx) + 0.5) / f - 0.5, 0, nb - 1)
+    j0 = np.floor(j).astype(np.int32)
+    j1 = np.minimum(j0 + 1, nb - 1)
+    w = (j - j0).astype(np.float32)
+    return (1 - w) * prj[..., j0] + w * prj[..., j1]
+
+
 def _get_func(algorithm):
     """Return the c function for the given algorithm.
 
@@ -339,22 +795,54 @@ def _get_func(algorithm):
         return algorithm
 
 
-def _dist_recon(tomo, center, recon, algorithm, args, kwargs, ncore, nchunk):
+def _dist_recon(tomo, center, recon, algorithm, args, kwargs, ncore, nchunk,
+                warm=None):
     axis_size = recon.shape[0]
     ncore, slcs = mproc.get_ncore_slices(axis_size, ncore, nchunk)
 
+    # Cores without a chunk of slices go to the threads of each chunk.
+    if 'num_thread' in kwargs:
+        num_thread = kwargs['num_thread']
+        if num_thread is None or (np.ndim(num_thread) == 0 and
+                                  np.asarray(num_thread).item() is None):
+            nslc = sum(1 for slc in slcs if np.arange(axis_size)[slc].size)
+            num_thread = max(1, ncore // max(1, nslc))
+        kwargs['num_thread'] = max(1, int(num_thread))
+
     if ncore == 1:
         for slc in slcs:
             # run in this thread (useful for debugging)
-            algorithm(tomo[slc], center[slc], recon[slc], *args, **kwargs)
+            _recon_chunk(tomo[slc], center[slc], recon[slc], algorithm, args,
+                         _chunk_kwargs(kwargs, slc), warm)
     else:
         # execute recon on ncore threads
         with cf.ThreadPoolExecutor(ncore) as e:
             for slc in slcs:
-                e.submit(algorithm, tomo[slc], center[slc], recon[slc], *args, **kwargs)
+                e.submit(_recon_chunk, tomo[slc], center[slc], recon[slc],
+                         algorithm, args, _chunk_kwargs(kwargs, slc), warm)
     return recon
 
 
+def _recon_chunk(tomo, center, recon, algorithm, args, kwargs, warm):
+    if warm is not None:
+        # gridrec writes straight into the chunk of the reconstruction. The
+        # detector is padded so that its filter does not wrap around.
+        pad = tomo.shape[-1] // 2
+        padded = np.pad(tomo, ((0, 0), (0, 0), (pad, pad)), mode='edge')
+        extern.c_gridrec(padded, dtype.as_float32(center + pad), recon,
+                         *args, **warm)
+        extern.c_scale_init(tomo, center, recon, *args,
+                            positive=warm['positive'], **kwargs)
+    algorithm(tomo, center, recon, *args, **kwargs)
+
+
+def _chunk_kwargs(kwargs, slc):
+    # the solver state is split into chunks of slices like the recon
+    if kwargs.get('state') is None:
+        return kwargs
+    return dict(kwargs, state=kwargs['state'][slc])
+
+
 def _get_algorithm_args(theta):
     theta = dtype.as_float32(theta)
     return (theta, )
@@ -370,6 +858,20 @@ def _get_algorithm_kwargs(shape):
         'num_iter': dtype.as_int32(1),
         'reg_par': np.ones(10, dtype='float32'),
         'num_block': dtype.as_int32(1),
-        'ind_block': np.arange(0, dt, dtype=np.float32),  # TODO: I think this should be int
+        'ind_block': None,
+        'projector': 'siddon',
+        'support': None,
+        'roi': None,
+        'fold_360': False,
+        'backprojector': 'ray',
+        'neighbors': 8,
+        'num_thread': None,
+        'tv_3d': False,
+        'state': None,
+        'damp': 0.0,
+        'tol': 0.0,
+        'subset_order': 'contiguous',
+        'source_distance': None,
+        'detector_distance': None,
         'options': {},
     }
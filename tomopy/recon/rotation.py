@@ -457,17 +457,24 @@ def write_center(
             Algebraic reconstruction technique :cite:`Kak:98`.
         'bart'
             Block algebraic reconstruction technique.
+        'cgls'
+            Conjugate gradient least squares.
         'fbp'
             Filtered back-projection algorithm.
         'gridrec'
             Fourier grid reconstruction algorithm :cite:`Dowd:99`,
             :cite:`Rivers:06`.
+        'lsqr'
+            Least squares by Golub-Kahan bidiagonalization.
         'mlem'
             Maximum-likelihood expectation maximization algorithm
             :cite:`Dempster:77`.
         'osem'
             Ordered-subset expectation maximization algorithm
             :cite:`Hudson:94`.
+        'ossart'
+            Ordered-subset simultaneous algebraic reconstruction technique,
+            another name of bart.
         'ospml_hybrid'
             Ordered-subset penalized maximum likelihood algorithm with
             weighted linear and quadratic penalties.
@@ -56,6 +56,7 @@ from __future__ import (absolute_import, division, print_function,
 import numpy as np
 import tomopy.util.extern as extern
 import tomopy.util.dtype as dtype
+import tomopy.util.mproc as mproc
 from tomopy.sim.project import get_center
 from tomopy.recon.algorithm import init_tomo
 import logging
@@ -69,7 +70,7 @@ __docformat__ = 'restructuredtext en'
 __all__ = ['vector', 'vector2', 'vector3']
 
 
-def vector(tomo, theta, center=None, num_iter=1):
+def vector(tomo, theta, center=None, num_iter=1, ncore=None):
     tomo = dtype.as_float32(tomo)
     theta = dtype.as_float32(theta)
 
@@ -83,11 +84,12 @@ def vector(tomo, theta, center=None, num_iter=1):
     center_arr = get_center(tomo.shape, center)
 
     extern.c_vector(tomo, center_arr, recon1, recon2, theta, 
-        num_gridx=tomo.shape[2], num_gridy=tomo.shape[2], num_iter=num_iter)
+        num_gridx=tomo.shape[2], num_gridy=tomo.shape[2], num_iter=num_iter,
+        num_thread=_get_num_thread(ncore))
     return recon1, recon2
 
 
-def vector2(tomo1, tomo2, theta1, theta2, center1=None, center2=None, num_iter=1, axis1=1, axis2=2):
+def vector2(tomo1, tomo2, theta1, theta2, center1=None, center2=None, num_iter=1, axis1=1, axis2=2, ncore=None):
     tomo1 = dtype.as_float32(tomo1)
     tomo2 = dtype.as_float32(tomo2)
     theta1 = dtype.as_float32(theta1)
@@ -106,11 +108,12 @@ def vector2(tomo1, tomo2, theta1, theta2, center1=None, center2=None, num_iter=1
     center_arr2 = get_center(tomo2.shape, center2)
 
     extern.c_vector2(tomo1, tomo2, center_arr1, center_arr2, recon1, recon2, recon3, theta1, theta2, 
-        num_gridx=tomo1.shape[2], num_gridy=tomo1.shape[2], num_iter=num_iter, axis1=axis1, axis2=axis2)
+        num_gridx=tomo1.shape[2], num_gridy=tomo1.shape[2], num_iter=num_iter, axis1=axis1, axis2=axis2,
+        num_thread=_get_num_thread(ncore))
     return recon1, recon2, recon3
 
 
-def vector3(tomo1, tomo2, tomo3, theta1, theta2, theta3, center1=None, center2=None, center3=None, num_iter=1, axis1=0, axis2=1, axis3=2):
+def vector3(tomo1, tomo2, tomo3, theta1, theta2, theta3, center1=None, center2=None, center3=None, num_iter=1, axis1=0, axis2=1, axis3=2, ncore=None):
     tomo1 = dtype.as_float32(tomo1)
     tomo2 = dtype.as_float32(tomo2)
     tomo3 = dtype.as_float32(tomo3)
@@ -133,5 +136,13 @@ def vector3(tomo1, tomo2, tomo3, theta1, theta2, theta3, center1=None, center2=N
     center_arr3 = get_center(tomo3.shape, center3)
 
     extern.c_vector3(tomo1, tomo2, tomo3, center_arr1, center_arr2, center_arr3, recon1, recon2, recon3, theta1, theta2, theta3,  
-        num_gridx=tomo1.shape[2], num_gridy=tomo1.shape[2], num_iter=num_iter, axis1=axis1, axis2=axis2, axis3=axis3)
-    return recon1, recon2, recon3
\ No newline at end of file
+        num_gridx=tomo1.shape[2], num_gridy=tomo1.shape[2], num_iter=num_iter, axis1=axis1, axis2=axis2, axis3=axis3,
+        num_thread=_get_num_thread(ncore))
+    return recon1, recon2, recon3
+
+
+def _get_num_thread(ncore):
+    # The slices are split between ncore threads of the C engine.
+    if ncore is None:
+        ncore = mproc.mp.cpu_count()
+    return max(1, int(ncore))
@@ -67,6 +67,7 @@ __copyright__ = "Copyright (c) 2015, UChicago Argonne, LLC."
 __docformat__ = 'restructuredtext en'
 __all__ = ['angles',
            'project',
+           'project_phantom',
            'project2',
            'project3',
            'fan_to_para',
@@ -76,6 +77,9 @@ __all__ = ['angles',
            'add_salt_pepper',
            'add_focal_spot_blur']
 
+# Projection models of the C ray tracer
+_projectors = ('siddon', 'joseph', 'distance')
+
 
 def add_gaussian(tomo, mean=0, std=None):
     """
@@ -177,7 +181,9 @@ def _round_to_even(num):
 
 def project(
         obj, theta, center=None, emission=True, pad=True,
-        sinogram_order=False, ncore=None, nchunk=None):
+        sinogram_order=False, ncore=None, nchunk=None, projector='siddon',
+        source_distance=None, detector_distance=None, blur=None, flux=None,
+        read_noise=None, seed=None):
     """
     Project x-rays through a given 3D object.
 
@@ -199,15 +205,46 @@ def project(
         Determines whether output data is a stack of sinograms (True, y-axis first axis)
         or a stack of radiographs (False, theta first axis).
     ncore : int, optional
-        Number of cores that will be assigned to jobs.
+        Number of threads sharing the projection angles.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used. The slices are projected in blocks of a fixed size.
+    projector : str, optional
+        Projection model, one of 'siddon' (default), 'joseph' or
+        'distance'. See :func:`tomopy.recon.algorithm.recon`.
+    source_distance : float, optional
+        Distance in pixels from a point source to the rotation axis. The
+        rays of each slice then fan out from the source instead of being
+        parallel. The source must lie outside of the object. With pad, the
+        projection image width holds the magnified object.
+    detector_distance : float, optional
+        Distance in pixels from the source to the flat detector of a fan
+        beam. Defaults to source_distance, a detector at the rotation axis.
+    blur : array or tuple of arrays, optional
+        Detector blur, such as that of the focal spot. A kernel applied
+        along the detector rows, or a tuple of the kernels applied along the
+        rows and across the slices. The kernels have odd lengths, at most 15
+        across the slices, and are normalized to unit sum. The blur acts on
+        the intensity when emission is False or flux is given, and on the
+        line integrals otherwise.
+    flux : float, optional
+        Photons per detector pixel of the open beam. The counts of the
+        attenuated beam then get Poisson noise, and the data are the noisy
+        transmission, or its negative logarithm when emission is True.
+    read_noise : float, optional
+        Standard deviation of Gaussian noise added to the readout, in
+        photons when flux is given and in data units otherwise.
+    seed : int, optional
+        Seed of the noise. Each detector pixel has its own random stream,
+        so the noise does not depend on ncore. Defaults to a seed drawn
+        from numpy.random.
 
     Returns
     -------
     ndarray
         3D tomographic data.
     """
+    if projector not in _projectors:
+        raise ValueError('projector must be one of %s' % (_projectors,))
     obj = dtype.as_float32(obj)
     theta = dtype.as_float32(theta)
 
@@ -215,8 +252,15 @@ def project(
     oy, ox, oz = obj.shape
     dt = theta.size
     dy = oy
+    radius = 0.5 * np.sqrt(ox * ox + oz * oz)
+    sod, sdd = get_fan(source_distance, detector_distance, radius)
     if pad is True:
-        dx = _round_to_even(np.sqrt(ox * ox + oz * oz) + 2)
+        if sdd > 0:
+            # Width of the shadow of the circle holding the object
+            dx = _round_to_even(
+                2 * radius * sdd / np.sqrt(sod * sod - radius * radius) + 2)
+        else:
+            dx = _round_to_even(np.sqrt(ox * ox + oz * oz) + 2)
     elif pad is False:
         dx = ox
     shape = dy, dt, dx
@@ -224,15 +268,20 @@ def project(
     tomo[:] = 0.0
     center = get_center(shape, center)
 
-    tomo = mproc.distribute_jobs(
-        (obj, center, tomo),
-        func=extern.c_project,
-        args=(theta,),
-        axis=0,
-        ncore=ncore,
-        nchunk=nchunk)
+    # The detector model is applied by the projector as it writes the data.
+    blur_u, blur_v = _get_blur(blur)
+    detector = blur_u is not None or blur_v is not None or \
+        bool(flux) or bool(read_noise)
+    if blur_v is not None and np.unique(center).size > 1:
+        raise ValueError('blur across the slices needs a single center')
+    if seed is None:
+        seed = np.random.randint(2**31)
+
+    extern.c_project(obj, center, tomo, theta, projector,
+                     _get_num_thread(ncore), sod, sdd, blur_u, blur_v,
+                     flux or 0, read_noise or 0, int(seed) % 2**31, emission)
     # NOTE: returns sinogram order with emmission=True
-    if not emission:
+    if not emission and not detector:
         # convert data to be transmission type
         np.exp(-tomo, tomo)
     if not sinogram_order:
@@ -244,6 +293,78 @@ def project(
     return tomo
 
 
+def project_phantom(
+        theta, size=128, params=None, center=None, emission=True, pad=True,
+        sinogram_order=False, ncore=None):
+    """
+    Project x-rays through a phantom of ellipsoids analytically.
+
+    The data are the exact line integrals through the ellipsoids of
+    :func:`tomopy.misc.phantom.phantom` on a grid of the given size, in the
+    geometry of :func:`project`, without voxelizing the phantom. The angles
+    are shared between ncore threads.
+
+    Parameters
+    ----------
+    theta : array
+        Projection angles in radian.
+    size : int or tuple of int, optional
+        Size of the 3D grid of the phantom.
+    params : list of dict, optional
+        Parameters of the ellipsoids as for
+        :func:`tomopy.misc.phantom.phantom`. Defaults to the modified
+        Shepp-Logan phantom of :func:`tomopy.misc.phantom.shepp3d`, without
+        its clipping of negative values.
+    center: array, optional
+        Location of rotation axis.
+    emission : bool, optional
+        Determines whether output data is emission or transmission type.
+    pad : bool, optional
+        If True, the diagonal length of the grid cross-section is the
+        projection image width, otherwise the grid size.
+    sinogram_order: bool, optional
+        Determines whether output data is a stack of sinograms (True, y-axis first axis)
+        or a stack of radiographs (False, theta first axis).
+    ncore : int, optional
+        Number of threads sharing the projection angles.
+
+    Returns
+    -------
+    ndarray
+        3D tomographic data.
+    """
+    from tomopy.misc.phantom import _totuple, _array_to_params, \
+        _get_shepp_array, _params_to_ellipsoids
+
+    theta = dtype.as_float32(theta)
+    size = _totuple(size, 3)
+    if params is None:
+        params = _array_to_params(_get_shepp_array())
+    oy, ox, oz = size
+    if ox < 2 or oz < 2:
+        raise ValueError('the slices need at least 2 x 2 pixels')
+
+    dt = theta.size
+    dy = oy
+    if pad is True:
+        dx = _round_to_even(np.sqrt(ox * ox + oz * oz) + 2)
+    elif pad is False:
+        dx = ox
+    shape = dy, dt, dx
+    tomo = dtype.empty_shared_array(shape)
+    tomo[:] = 0.0
+    center = get_center(shape, center)
+
+    extern.c_phantom_project(_params_to_ellipsoids(params), size, tomo,
+                             center, theta, _get_num_thread(ncore))
+    if not emission:
+        np.exp(-tomo, tomo)
+    if not sinogram_order:
+        tomo = np.swapaxes(tomo, 0, 1)
+        tomo = dtype.as_sharedmem(tomo, copy=True)
+    return tomo
+
+
 def project2(
         objx, objy, theta, center=None, emission=True, pad=True,
         sinogram_order=False, axis=0, ncore=None, nchunk=None):
@@ -268,9 +389,9 @@ def project2(
         Determines whether output data is a stack of sinograms (True, y-axis first axis)
         or a stack of radiographs (False, theta first axis).
     ncore : int, optional
-        Number of cores that will be assigned to jobs.
+        Number of threads sharing the projection angles.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used. The slices are projected in blocks of a fixed size.
 
     Returns
     -------
@@ -294,7 +415,8 @@ def project2(
     tomo[:] = 0.0
     center = get_center(shape, center)
 
-    extern.c_project2(objx, objy, center, tomo, theta)
+    extern.c_project2(objx, objy, center, tomo, theta,
+                      _get_num_thread(ncore))
     
     # NOTE: returns sinogram order with emmission=True
     if not emission:
@@ -334,9 +456,9 @@ def project3(
         Determines whether output data is a stack of sinograms (True, y-axis first axis)
         or a stack of radiographs (False, theta first axis).
     ncore : int, optional
-        Number of cores that will be assigned to jobs.
+        Number of threads sharing the projection angles.
     nchunk : int, optional
-        Chunk size for each core.
+        Not used. The slices are projected in blocks of a fixed size.
 
     Returns
     -------
@@ -362,7 +484,8 @@ def project3(
     tomo[:] = 0.0
     center = get_center(shape, center)
 
-    extern.c_project3(objx, objy, objz, center, tomo, theta, axis)
+    extern.c_project3(objx, objy, objz, center, tomo, theta, axis,
+                      _get_num_thread(ncore))
     
     # NOTE: returns sinogram order with emmission=True
     if not emission:
@@ -377,6 +500,12 @@ def project3(
     return tomo
 
 
+def _get_num_thread(ncore):
+    if ncore is None:
+        ncore = mproc.mp.cpu_count()
+    return max(1, int(ncore))
+
+
 def get_center(shape, center):
     if center is None:
         center = np.ones(shape[0], dtype='float32') * (shape[2] / 2.)
@@ -385,6 +514,51 @@ def get_center(shape, center):
     return dtype.as_float32(center)
 
 
+def _get_blur(blur):
+    """Return the normalized blur kernels along the detector rows and
+    across the slices, None for no blur."""
+    kernels = blur if isinstance(blur, tuple) else (blur, None)
+    if len(kernels) != 2:
+        raise ValueError('blur must be a kernel or a tuple of two kernels')
+    out = []
+    for k, kmax in zip(kernels, (None, 15)):
+        if k is None:
+            out.append(None)
+            continue
+        k = np.asarray(k, dtype=np.float32).ravel()
+        if k.size % 2 == 0 or (kmax is not None and k.size > kmax):
+            raise ValueError('blur kernels must have an odd length, at most '
+                             '15 across the slices')
+        out.append(np.require(k / k.sum(), dtype=np.float32,
+                              requirements="AC") if k.size > 1 else None)
+    return tuple(out)
+
+
+def _is_none(value):
+    return value is None or np.ndim(value) == 0 and \
+        np.asarray(value).item() is None
+
+
+def get_fan(source_distance, detector_distance, radius):
+    """Return the source to rotation axis and source to detector distances
+    of a fan beam, or zeros for parallel rays.
+
+    The source must lie outside of the circle of the given radius about the
+    rotation axis. The detector defaults to the rotation axis.
+    """
+    if _is_none(source_distance):
+        if not _is_none(detector_distance):
+            raise ValueError('detector_distance requires source_distance')
+        return 0., 0.
+    sod = float(source_distance)
+    sdd = sod if _is_none(detector_distance) else float(detector_distance)
+    if sod <= radius or sdd <= 0:
+        raise ValueError(
+            'source_distance must exceed %g pixels and detector_distance '
+            'must be positive' % radius)
+    return sod, sdd
+
+
 def fan_to_para(tomo, dist, geom):
     """
     Convert fan-beam data to parallel-beam data.
@@ -68,12 +68,16 @@ __docformat__ = 'restructuredtext en'
 __all__ = ['as_ndarray',
            'as_dtype',
            'as_float32',
+           'as_float64',
            'as_int32',
            'as_uint8',
            'as_uint16',
            'as_c_float_p',
+           'as_c_double_p',
            'as_c_int',
            'as_c_int_p',
+           'as_c_uint8_p',
+           'as_c_uint16_p',
            'as_c_float',
            'as_c_char_p',
            'as_c_void_p']
@@ -96,6 +100,11 @@ def as_float32(arr):
     return as_dtype(arr, np.float32)
 
 
+def as_float64(arr):
+    arr = as_ndarray(arr, np.float64)
+    return as_dtype(arr, np.float64)
+
+
 def as_int32(arr):
     arr = as_ndarray(arr, np.int32)
     return as_dtype(arr, np.int32)
@@ -112,19 +121,46 @@ def as_uint8(arr):
 
 
 def as_c_float_p(arr):
+    # None maps to a NULL pointer for optional arrays
+    if arr is None:
+        return None
     c_float_p = ctypes.POINTER(ctypes.c_float)
     return arr.ctypes.data_as(c_float_p)
 
 
+def as_c_double_p(arr):
+    # None maps to a NULL pointer for optional arrays
+    if arr is None:
+        return None
+    c_double_p = ctypes.POINTER(ctypes.c_double)
+    return arr.ctypes.data_as(c_double_p)
+
+
 def as_c_int(arr):
     return ctypes.c_int(arr)
 
 
 def as_c_int_p(arr):
+    # None maps to a NULL pointer for optional arrays
+    if arr is None:
+        return None
     c_int_p = ctypes.POINTER(ctypes.c_int)
     return arr.ctypes.data_as(c_int_p)
 
 
+def as_c_uint8_p(arr):
+    # None maps to a NULL pointer for optional arrays
+    if arr is None:
+        return None
+    c_uint8_p = ctypes.POINTER(ctypes.c_uint8)
+    return arr.ctypes.data_as(c_uint8_p)
+
+
+def as_c_uint16_p(arr):
+    c_uint16_p = ctypes.POINTER(ctypes.c_uint16)
+    return arr.ctypes.data_as(c_uint16_p)
+
+
 def as_c_float(arr):
     return ctypes.c_float(arr)
 
@@ -67,16 +67,23 @@ __author__ = "Doga Gursoy"
 __copyright__ = "Copyright (c) 2015, UChicago Argonne, LLC."
 __docformat__ = 'restructuredtext en'
 __all__ = ['c_shared_lib',
+           'c_phantom',
+           'c_phantom_project',
            'c_project',
            'c_project2',
            'c_project3',
            'c_normalize_bg',
+           'c_normalize_log',
+           'c_normalize_dynamic',
            'c_remove_stripe_sf',
+           'c_remove_stripe_sorting',
            'c_sample',
            'c_art',
            'c_bart',
+           'c_cgls',
            'c_fbp',
            'c_gridrec',
+           'c_lsqr',
            'c_mlem',
            'c_osem',
            'c_ospml_hybrid',
@@ -84,12 +91,14 @@ __all__ = ['c_shared_lib',
            'c_pml_hybrid',
            'c_pml_quad',
            'c_sirt',
+           'c_state_size',
            'c_tv',
            'c_grad',
            'c_vector',
            'c_vector2',
            'c_vector3',
-           'c_remove_ring']
+           'c_remove_ring',
+           'c_scale_init']
 
 
 def c_shared_lib(lib_name):
@@ -126,27 +135,122 @@ def c_normalize_bg(tomo, air):
         dtype.as_c_int(air))
 
 
-def c_remove_stripe_sf(tomo, size):
-    # TODO: we should fix this elsewhere...
-    # TOMO object must be contiguous for c function to work
-    contiguous_tomo = np.require(tomo, requirements="AC")
+def c_normalize_log(arr, flat, dark, cutoff, minus_log, nonfinite,
+                    sinogram_order, out, num_thread=1):
+    dt, dy, dx = arr.shape
+    u16 = arr.dtype == np.uint16
+    data = dtype.as_c_uint16_p(arr) if u16 else dtype.as_c_float_p(arr)
+
+    LIB_TOMOPY.normalize_log.restype = dtype.as_c_void_p()
+    LIB_TOMOPY.normalize_log(
+        data,
+        dtype.as_c_int(int(u16)),
+        dtype.as_c_int(dt),
+        dtype.as_c_int(dy),
+        dtype.as_c_int(dx),
+        dtype.as_c_float_p(flat),
+        dtype.as_c_float_p(dark),
+        dtype.as_c_int(cutoff is not None),
+        dtype.as_c_float(0 if cutoff is None else cutoff),
+        dtype.as_c_int(int(minus_log)),
+        dtype.as_c_int(nonfinite is not None),
+        dtype.as_c_float(0 if nonfinite is None else nonfinite),
+        dtype.as_c_int(int(sinogram_order)),
+        dtype.as_c_float_p(out),
+        dtype.as_c_int(num_thread))
+    return out
+
+
+def c_normalize_dynamic(arr, flats, dark, ncomp, downsample, niter, cutoff,
+                        out, num_thread=1):
+    dt, dy, dx = arr.shape
+
+    LIB_TOMOPY.normalize_dynamic.restype = dtype.as_c_void_p()
+    LIB_TOMOPY.normalize_dynamic(
+        dtype.as_c_float_p(arr),
+        dtype.as_c_int(dt),
+        dtype.as_c_int(dy),
+        dtype.as_c_int(dx),
+        dtype.as_c_float_p(flats),
+        dtype.as_c_int(flats.shape[0]),
+        dtype.as_c_float_p(dark),
+        dtype.as_c_int(ncomp),
+        dtype.as_c_int(downsample),
+        dtype.as_c_int(niter),
+        dtype.as_c_int(cutoff is not None),
+        dtype.as_c_float(0 if cutoff is None else cutoff),
+        dtype.as_c_float_p(out),
+        dtype.as_c_int(num_thread))
+    return out
+
+
+def c_remove_stripe_sf(tomo, size, num_thread=1):
     dx, dy, dz = tomo.shape
-    istart = 0
-    iend = dy
 
     LIB_TOMOPY.remove_stripe_sf.restype = dtype.as_c_void_p()
     LIB_TOMOPY.remove_stripe_sf(
-        dtype.as_c_float_p(contiguous_tomo),
+        dtype.as_c_float_p(tomo),
         dtype.as_c_int(dx),
         dtype.as_c_int(dy),
         dtype.as_c_int(dz),
         dtype.as_c_int(size),
-        dtype.as_c_int(istart),
-        dtype.as_c_int(iend))
-    tomo[:] = contiguous_tomo[:]
+        dtype.as_c_int(num_thread))
+    return tomo
+
+
+def c_remove_stripe_sorting(tomo, method, snr, size, sm_size, num_thread=1):
+    dx, dy, dz = tomo.shape
+
+    LIB_TOMOPY.remove_stripe_sorting.restype = dtype.as_c_void_p()
+    LIB_TOMOPY.remove_stripe_sorting(
+        dtype.as_c_float_p(tomo),
+        dtype.as_c_int(dx),
+        dtype.as_c_int(dy),
+        dtype.as_c_int(dz),
+        dtype.as_c_char_p(method),
+        dtype.as_c_float(snr),
+        dtype.as_c_int(size),
+        dtype.as_c_int(sm_size),
+        dtype.as_c_int(num_thread))
+    return tomo
 
 
-def c_project(obj, center, tomo, theta):
+def c_phantom(ell, obj, supersample=1, num_thread=1):
+    n0, n1, n2 = obj.shape
+    LIB_TOMOPY.phantom.restype = dtype.as_c_void_p()
+    LIB_TOMOPY.phantom(
+        dtype.as_c_double_p(ell),
+        dtype.as_c_int(ell.shape[0]),
+        dtype.as_c_float_p(obj),
+        dtype.as_c_int(n0),
+        dtype.as_c_int(n1),
+        dtype.as_c_int(n2),
+        dtype.as_c_int(supersample),
+        dtype.as_c_int(num_thread))
+    return obj
+
+
+def c_phantom_project(ell, size, tomo, center, theta, num_thread=1):
+    dy, dt, dx = tomo.shape
+    LIB_TOMOPY.phantom_project.restype = dtype.as_c_void_p()
+    LIB_TOMOPY.phantom_project(
+        dtype.as_c_double_p(ell),
+        dtype.as_c_int(ell.shape[0]),
+        dtype.as_c_int(size[0]),
+        dtype.as_c_int(size[1]),
+        dtype.as_c_int(size[2]),
+        dtype.as_c_float_p(tomo),
+        dtype.as_c_int(dt),
+        dtype.as_c_int(dx),
+        dtype.as_c_float_p(center),
+        dtype.as_c_float_p(theta),
+        dtype.as_c_int(num_thread))
+    return tomo
+
+
+def c_project(obj, center, tomo, theta, projector='siddon', num_thread=1,
+              source_distance=0, detector_distance=0, blur_u=None,
+              blur_v=None, flux=0, noise=0, seed=0, emission=True):
     # TODO: we should fix this elsewhere...
     # TOMO object must be contiguous for c function to work
 
@@ -176,11 +280,23 @@ def c_project(obj, center, tomo, theta):
         dtype.as_c_int(dt),
         dtype.as_c_int(dx),
         dtype.as_c_float_p(center),
-        dtype.as_c_float_p(theta))
+        dtype.as_c_float_p(theta),
+        dtype.as_c_char_p(projector),
+        dtype.as_c_float(source_distance),
+        dtype.as_c_float(detector_distance),
+        dtype.as_c_float_p(blur_u),
+        dtype.as_c_int(0 if blur_u is None else blur_u.size),
+        dtype.as_c_float_p(blur_v),
+        dtype.as_c_int(0 if blur_v is None else blur_v.size),
+        dtype.as_c_float(flux),
+        dtype.as_c_float(noise),
+        dtype.as_c_int(seed),
+        dtype.as_c_int(int(emission)),
+        dtype.as_c_int(num_thread))
     tomo[:] = contiguous_tomo[:]
 
 
-def c_project2(objx, objy, center, tomo, theta):
+def c_project2(objx, objy, center, tomo, theta, num_thread=1):
     # TODO: we should fix this elsewhere...
     # TOMO object must be contiguous for c function to work
 
@@ -211,11 +327,12 @@ def c_project2(objx, objy, center, tomo, theta):
         dtype.as_c_int(dt),
         dtype.as_c_int(dx),
         dtype.as_c_float_p(center),
-        dtype.as_c_float_p(theta))
+        dtype.as_c_float_p(theta),
+        dtype.as_c_int(num_thread))
     tomo[:] = contiguous_tomo[:]
 
 
-def c_project3(objx, objy, objz, center, tomo, theta, axis):
+def c_project3(objx, objy, objz, center, tomo, theta, axis, num_thread=1):
     # TODO: we should fix this elsewhere...
     # TOMO object must be contiguous for c function to work
 
@@ -248,7 +365,8 @@ def c_project3(objx, objy, objz, center, tomo, theta, axis):
         dtype.as_c_int(dx),
         dtype.as_c_float_p(center),
         dtype.as_c_float_p(theta),
-        dtype.as_c_int(axis))
+        dtype.as_c_int(axis),
+        dtype.as_c_int(num_thread))
     tomo[:] = contiguous_tomo[:]
 
 
@@ -266,6 +384,31 @@ def c_sample(mode, arr, dx, dy, dz, level, axis, out):
     return out
 
 
+def c_pair_opposite(theta, tol, mate):
+    LIB_TOMOPY.pair_opposite.restype = ctypes.c_int
+    return LIB_TOMOPY.pair_opposite(
+        dtype.as_c_float_p(theta),
+        dtype.as_c_int(theta.size),
+        dtype.as_c_float(tol),
+        dtype.as_c_int_p(mate))
+
+
+def c_fold_360(tomo, center, mate, shift, out):
+    dy, dt, dx = tomo.shape
+    LIB_TOMOPY.fold_360.restype = dtype.as_c_void_p()
+    LIB_TOMOPY.fold_360(
+        dtype.as_c_float_p(tomo),
+        dtype.as_c_int(dy),
+        dtype.as_c_int(dt),
+        dtype.as_c_int(dx),
+        dtype.as_c_float_p(center),
+        dtype.as_c_int_p(mate),
+        dtype.as_c_int(shift),
+        dtype.as_c_int(out.shape[2]),
+        dtype.as_c_float_p(out))
+    return out
+
+
 def c_art(tomo, center, recon, theta, **kwargs):
     if len(tomo.shape) == 2:
         # no y-axis (only one slice)
@@ -285,7 +428,11 @@ def c_art(tomo, center, recon, theta, **kwargs):
             dtype.as_c_float_p(recon),
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
-            dtype.as_c_int(kwargs['num_iter']))
+            dtype.as_c_int(kwargs['num_iter']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_int(kwargs['num_thread']))
 
 
 def c_bart(tomo, center, recon, theta, **kwargs):
@@ -309,7 +456,40 @@ def c_bart(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_int(kwargs['num_iter']),
             dtype.as_c_int(kwargs['num_block']),
-            dtype.as_c_float_p(kwargs['ind_block']))  # TODO: I think this should be int_p
+            dtype.as_c_int_p(kwargs['ind_block']),
+            dtype.as_c_int(kwargs['ind_block'].shape[0]),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']),
+            dtype.as_c_int(kwargs['num_thread']))
+
+
+def c_cgls(tomo, center, recon, theta, **kwargs):
+    if len(tomo.shape) == 2:
+        # no y-axis (only one slice)
+        dy = 1
+        dt, dx = tomo.shape
+    else:
+        dy, dt, dx = tomo.shape
+
+    LIB_TOMOPY.cgls.restype = dtype.as_c_void_p()
+    return LIB_TOMOPY.cgls(
+            dtype.as_c_float_p(tomo),
+            dtype.as_c_int(dy),
+            dtype.as_c_int(dt),
+            dtype.as_c_int(dx),
+            dtype.as_c_float_p(center),
+            dtype.as_c_float_p(theta),
+            dtype.as_c_float_p(recon),
+            dtype.as_c_int(kwargs['num_gridx']),
+            dtype.as_c_int(kwargs['num_gridy']),
+            dtype.as_c_int(kwargs['num_iter']),
+            dtype.as_c_float(kwargs['damp']),
+            dtype.as_c_float(kwargs['tol']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']))
 
 
 def c_fbp(tomo, center, recon, theta, **kwargs):
@@ -332,7 +512,11 @@ def c_fbp(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_char_p(kwargs['filter_name']),
-            dtype.as_c_float_p(kwargs['filter_par']))  # filter_par
+            dtype.as_c_float_p(kwargs['filter_par']),  # filter_par
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']))
 
 
 def c_gridrec(tomo, center, recon, theta, **kwargs):
@@ -355,7 +539,60 @@ def c_gridrec(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_char_p(kwargs['filter_name']),
-            dtype.as_c_float_p(kwargs['filter_par']))
+            dtype.as_c_float_p(kwargs['filter_par']),
+            dtype.as_c_int_p(kwargs['roi']))
+
+
+def c_scale_init(tomo, center, recon, theta, positive, **kwargs):
+    if len(tomo.shape) == 2:
+        # no y-axis (only one slice)
+        dy = 1
+        dt, dx = tomo.shape
+    else:
+        dy, dt, dx = tomo.shape
+
+    LIB_TOMOPY.scale_init.restype = dtype.as_c_void_p()
+    return LIB_TOMOPY.scale_init(
+            dtype.as_c_float_p(tomo),
+            dtype.as_c_int(dy),
+            dtype.as_c_int(dt),
+            dtype.as_c_int(dx),
+            dtype.as_c_float_p(center),
+            dtype.as_c_float_p(theta),
+            dtype.as_c_float_p(recon),
+            dtype.as_c_int(kwargs['num_gridx']),
+            dtype.as_c_int(kwargs['num_gridy']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_int(int(positive)))
+
+
+def c_lsqr(tomo, center, recon, theta, **kwargs):
+    if len(tomo.shape) == 2:
+        # no y-axis (only one slice)
+        dy = 1
+        dt, dx = tomo.shape
+    else:
+        dy, dt, dx = tomo.shape
+
+    LIB_TOMOPY.lsqr.restype = dtype.as_c_void_p()
+    return LIB_TOMOPY.lsqr(
+            dtype.as_c_float_p(tomo),
+            dtype.as_c_int(dy),
+            dtype.as_c_int(dt),
+            dtype.as_c_int(dx),
+            dtype.as_c_float_p(center),
+            dtype.as_c_float_p(theta),
+            dtype.as_c_float_p(recon),
+            dtype.as_c_int(kwargs['num_gridx']),
+            dtype.as_c_int(kwargs['num_gridy']),
+            dtype.as_c_int(kwargs['num_iter']),
+            dtype.as_c_float(kwargs['damp']),
+            dtype.as_c_float(kwargs['tol']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']))
 
 
 def c_mlem(tomo, center, recon, theta, **kwargs):
@@ -377,7 +614,11 @@ def c_mlem(tomo, center, recon, theta, **kwargs):
             dtype.as_c_float_p(recon),
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
-            dtype.as_c_int(kwargs['num_iter']))
+            dtype.as_c_int(kwargs['num_iter']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']))
 
 
 def c_osem(tomo, center, recon, theta, **kwargs):
@@ -401,7 +642,12 @@ def c_osem(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_int(kwargs['num_iter']),
             dtype.as_c_int(kwargs['num_block']),
-            dtype.as_c_float_p(kwargs['ind_block']))  # TODO: should be int?
+            dtype.as_c_int_p(kwargs['ind_block']),
+            dtype.as_c_int(kwargs['ind_block'].shape[0]),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']))
 
 
 def c_ospml_hybrid(tomo, center, recon, theta, **kwargs):
@@ -426,7 +672,13 @@ def c_ospml_hybrid(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_iter']),
             dtype.as_c_float_p(kwargs['reg_par']),
             dtype.as_c_int(kwargs['num_block']),
-            dtype.as_c_float_p(kwargs['ind_block']))  # TODO: should be int?
+            dtype.as_c_int_p(kwargs['ind_block']),
+            dtype.as_c_int(kwargs['ind_block'].shape[0]),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']),
+            dtype.as_c_int(kwargs['neighbors']))
 
 
 def c_ospml_quad(tomo, center, recon, theta, **kwargs):
@@ -451,7 +703,13 @@ def c_ospml_quad(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_iter']),
             dtype.as_c_float_p(kwargs['reg_par']),
             dtype.as_c_int(kwargs['num_block']),
-            dtype.as_c_float_p(kwargs['ind_block']))  # TODO: should be int?
+            dtype.as_c_int_p(kwargs['ind_block']),
+            dtype.as_c_int(kwargs['ind_block'].shape[0]),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']),
+            dtype.as_c_int(kwargs['neighbors']))
 
 
 def c_pml_hybrid(tomo, center, recon, theta, **kwargs):
@@ -474,7 +732,12 @@ def c_pml_hybrid(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_int(kwargs['num_iter']),
-            dtype.as_c_float_p(kwargs['reg_par']))
+            dtype.as_c_float_p(kwargs['reg_par']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']),
+            dtype.as_c_int(kwargs['neighbors']))
 
 
 def c_pml_quad(tomo, center, recon, theta, **kwargs):
@@ -497,7 +760,12 @@ def c_pml_quad(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_int(kwargs['num_iter']),
-            dtype.as_c_float_p(kwargs['reg_par']))
+            dtype.as_c_float_p(kwargs['reg_par']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']),
+            dtype.as_c_int(kwargs['neighbors']))
 
 
 def c_sirt(tomo, center, recon, theta, **kwargs):
@@ -519,7 +787,11 @@ def c_sirt(tomo, center, recon, theta, **kwargs):
             dtype.as_c_float_p(recon),
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
-            dtype.as_c_int(kwargs['num_iter']))
+            dtype.as_c_int(kwargs['num_iter']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']))
 
 def c_tv(tomo, center, recon, theta, **kwargs):
     if len(tomo.shape) == 2:
@@ -541,7 +813,13 @@ def c_tv(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_int(kwargs['num_iter']),
-            dtype.as_c_float_p(kwargs['reg_par']))
+            dtype.as_c_float_p(kwargs['reg_par']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']),
+            dtype.as_c_int(int(kwargs['tv_3d'])),
+            dtype.as_c_float_p(kwargs['state']))
 
 def c_grad(tomo, center, recon, theta, **kwargs):
     if len(tomo.shape) == 2:
@@ -563,7 +841,22 @@ def c_grad(tomo, center, recon, theta, **kwargs):
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_int(kwargs['num_iter']),
-            dtype.as_c_float_p(kwargs['reg_par']))
+            dtype.as_c_float_p(kwargs['reg_par']),
+            dtype.as_c_char_p(kwargs['projector']),
+            dtype.as_c_uint8_p(kwargs['support']),
+            dtype.as_c_float_p(kwargs['geom']),
+            dtype.as_c_char_p(kwargs['backprojector']),
+            dtype.as_c_float_p(kwargs['state']))
+
+def c_state_size(algorithm, dt, dx, ngridx, ngridy):
+    # number of floats of the solver state of one slice
+    func = getattr(LIB_TOMOPY, algorithm + '_state_size')
+    func.restype = ctypes.c_int
+    return func(
+            dtype.as_c_int(dt),
+            dtype.as_c_int(dx),
+            dtype.as_c_int(ngridx),
+            dtype.as_c_int(ngridy))
 
 def c_vector(tomo, center, recon1, recon2, theta, **kwargs):
     if len(tomo.shape) == 2:
@@ -585,7 +878,8 @@ def c_vector(tomo, center, recon1, recon2, theta, **kwargs):
             dtype.as_c_float_p(recon2),
             dtype.as_c_int(kwargs['num_gridx']),
             dtype.as_c_int(kwargs['num_gridy']),
-            dtype.as_c_int(kwargs['num_iter']))
+            dtype.as_c_int(kwargs['num_iter']),
+            dtype.as_c_int(kwargs['num_thread']))
 
 
 def c_vector2(tomo1, tomo2, center1, center2, recon1, recon2, recon3, theta1, theta2, axis1, axis2, **kwargs):
@@ -614,7 +908,8 @@ def c_vector2(tomo1, tomo2, center1, center2, recon1, recon2, recon3, theta1, th
             dtype.as_c_int(kwargs['num_gridy']),
             dtype.as_c_int(kwargs['num_iter']),
             dtype.as_c_int(axis1),
-            dtype.as_c_int(axis2))
+            dtype.as_c_int(axis2),
+            dtype.as_c_int(kwargs['num_thread']))
 
 
 def c_vector3(tomo1, tomo2, tomo3, center1, center2, center3, recon1, recon2, recon3, theta1, theta2, theta3, axis1, axis2, axis3, **kwargs):
@@ -647,7 +942,8 @@ def c_vector3(tomo1, tomo2, tomo3, center1, center2, center3, recon1, recon2, re
             dtype.as_c_int(kwargs['num_iter']),
             dtype.as_c_int(axis1),
             dtype.as_c_int(axis2),
-            dtype.as_c_int(axis3))
+            dtype.as_c_int(axis3),
+            dtype.as_c_int(kwargs['num_thread']))
 
 
 